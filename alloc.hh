@@ -0,0 +1,193 @@
+#pragma once
+#include "cpplox.hh"
+#include "stack.hh"
+
+// Allocation accounting per subsystem. Memory is requested either
+// through an Allocator<T, subsystem> handle, or through plain new while
+// a Scope for the subsystem is active on the thread. This is the single
+// place where a subsystem could be switched to an arena or pool.
+//
+// Accounting is part of the LOX_STATS build; without it allocate() and
+// deallocate() are plain operator new/delete.
+namespace alloc {
+        enum subsystem {
+                OTHER, SCANNER, PARSER, ENVIRONMENT, INTERPRETER, HEAP,
+                SUBSYSTEMS
+        };
+
+        const std::string subsystem_strs[] = {
+                "other", "scanner", "parser", "environment", "interpreter", "heap",
+        };
+
+        class Counters {
+        public:
+                std::atomic<uint64_t> allocations = 0;
+                std::atomic<uint64_t> frees = 0;
+                std::atomic<uint64_t> bytes = 0;
+                std::atomic<int64_t> live = 0;
+                std::atomic<int64_t> peak = 0;
+        };
+
+        namespace {
+                [[maybe_unused]] Counters counters[SUBSYSTEMS];
+                thread_local subsystem current = OTHER;
+
+                // keeps the 16 byte alignment of malloc
+                class alignas(16) Header {
+                public:
+                        uint64_t size;
+                        subsystem tag;
+                };
+        }
+
+        // attributes plain allocations on this thread to a subsystem
+        class Scope {
+                subsystem previous;
+
+        public:
+                Scope(
+                        subsystem s
+                ) : previous(current)
+                {
+                        current = s;
+                }
+
+                ~Scope() {
+                        current = previous;
+                }
+
+                Scope(const Scope&) = delete;
+                fn operator=(const Scope&) -> Scope& = delete;
+        };
+
+#ifdef LOX_STATS
+        fn allocate(size_t size, subsystem tag) -> void* {
+                auto h = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+                if (h == nullptr) {
+                        throw std::bad_alloc();
+                }
+                h->size = size;
+                h->tag = tag;
+
+                auto& c = counters[tag];
+                c.allocations.fetch_add(1, std::memory_order_relaxed);
+                c.bytes.fetch_add(size, std::memory_order_relaxed);
+                int64_t live = c.live.fetch_add(size, std::memory_order_relaxed) + size;
+                auto peak = c.peak.load(std::memory_order_relaxed);
+                while (live > peak && !c.peak.compare_exchange_weak(
+                        peak, live, std::memory_order_relaxed)) {
+                }
+                return h + 1;
+        }
+
+        fn deallocate(void* p) {
+                if (p == nullptr) {
+                        return;
+                }
+                auto h = static_cast<Header*>(p) - 1;
+                auto& c = counters[h->tag];
+                c.frees.fetch_add(1, std::memory_order_relaxed);
+                c.live.fetch_sub(h->size, std::memory_order_relaxed);
+                std::free(h);
+        }
+#else
+        fn allocate(size_t size, subsystem) -> void* {
+                return ::operator new(size);
+        }
+
+        fn deallocate(void* p) {
+                ::operator delete(p);
+        }
+#endif
+
+        fn allocate(size_t size) -> void* {
+                return allocate(size, current);
+        }
+
+        // std allocator handle tagged with a subsystem
+        template<class T, subsystem S>
+        class Allocator {
+        public:
+                using value_type = T;
+
+                Allocator() = default;
+
+                template<class U>
+                Allocator(const Allocator<U, S>&) {}
+
+                template<class U>
+                struct rebind {
+                        using other = Allocator<U, S>;
+                };
+
+                fn allocate(size_t n) -> T* {
+                        return static_cast<T*>(alloc::allocate(n * sizeof(T), S));
+                }
+
+                fn deallocate(T* p, size_t) {
+                        alloc::deallocate(p);
+                }
+
+                // syntax trees nest as deep as their source, a node is
+                // destroyed on a new stack segment when the stack runs low,
+                // past the stack limit too
+                template<class U>
+                fn destroy(U* p) {
+                        if constexpr (S == PARSER) {
+                                stack::guard([&] {
+                                        p->~U();
+                                }, false);
+                        } else {
+                                p->~U();
+                        }
+                }
+
+                friend fn operator==(const Allocator&, const Allocator&) -> bool {
+                        return true;
+                }
+        };
+
+        // shared_ptr with object and control block in one tagged allocation
+        template<class T, subsystem S, class... Args>
+        fn make_shared(Args&&... args) -> std::shared_ptr<T> {
+                return std::allocate_shared<T>(
+                        Allocator<T, S>(), std::forward<Args>(args)...
+                );
+        }
+
+        fn report(std::ostream& out) {
+#ifdef LOX_STATS
+                out << "---- allocations ----\n";
+                out << std::format(
+                        "{:<14}{:>12}{:>12}{:>14}{:>14}{:>14}\n",
+                        "subsystem", "allocs", "frees", "bytes", "live", "peak live"
+                );
+                for (size_t s = 0; s < SUBSYSTEMS; ++s) {
+                        auto& c = counters[s];
+                        out << std::format(
+                                "{:<14}{:>12}{:>12}{:>14}{:>14}{:>14}\n",
+                                subsystem_strs[s],
+                                c.allocations.load(), c.frees.load(), c.bytes.load(),
+                                c.live.load(), c.peak.load()
+                        );
+                }
+#else
+                out << "allocations           disabled, build with -DLOX_STATS\n";
+#endif
+        }
+}
+
+#ifdef LOX_STATS
+// every plain new goes through the accounting of the current scope
+fn operator new(size_t size) -> void* {
+        return alloc::allocate(size);
+}
+
+fn operator delete(void* p) noexcept -> void {
+        alloc::deallocate(p);
+}
+
+fn operator delete(void* p, size_t) noexcept -> void {
+        alloc::deallocate(p);
+}
+#endif
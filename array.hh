@@ -0,0 +1,66 @@
+#pragma once
+#include "cpplox.hh"
+#include "alloc.hh"
+#include "gc.hh"
+#include "simd.hh"
+
+// Contiguous array of numbers. Arrays are reference values, bulk
+// arithmetic, comparisons and reductions run on the simd kernels.
+namespace array {
+        class Array : public gc::Object {
+        public:
+                std::vector<double, alloc::Allocator<double, alloc::INTERPRETER>> data;
+
+                Array(
+                        size_t n,
+                        double fill
+                ) : data(n, fill)
+                {}
+
+                fn size() const -> size_t {
+                        return data.size();
+                }
+
+                fn external() const -> size_t override {
+                        return data.size() * sizeof(double);
+                }
+        };
+
+        using array_ptr = Array*;
+
+        namespace {
+                gc::Traced<Array> traced;
+        }
+
+        fn make(size_t n, double fill = 0.0) -> array_ptr {
+                gc::heap().reserve(n * sizeof(double));
+                auto a = gc::make<Array>(n, fill);
+                gc::heap().external(a->external());
+                return a;
+        }
+
+        fn is_array(const std::any& v) -> bool {
+                return v.type() == typeid(array_ptr);
+        }
+
+        // element-wise a op b, either side may be a number
+        fn map(simd::op o, const std::any& a, const std::any& b) -> array_ptr {
+                const Array* aa = is_array(a) ? std::any_cast<array_ptr>(a) : nullptr;
+                const Array* ba = is_array(b) ? std::any_cast<array_ptr>(b) : nullptr;
+                double as = aa ? 0.0 : std::any_cast<double>(a);
+                double bs = ba ? 0.0 : std::any_cast<double>(b);
+
+                auto result = make(aa ? aa->size() : ba->size());
+                simd::map(
+                        o,
+                        aa ? aa->data.data() : nullptr, as,
+                        ba ? ba->data.data() : nullptr, bs,
+                        result->data.data(), result->size()
+                );
+                return result;
+        }
+
+        fn equal(const Array& a, const Array& b) -> bool {
+                return a.data == b.data;
+        }
+}
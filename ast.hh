@@ -1,6 +1,8 @@
 #pragma once
 #include "cpplox.hh"
 #include "token.hh"
+#include "stats.hh"
+#include "cache.hh"
 
 namespace ast {
         template<class R>
@@ -12,6 +14,17 @@ namespace ast {
         class Unary;
         class Variable;
         class Assign;
+        class Call;
+        class Index;
+        class IndexSet;
+        class ArrayLiteral;
+        class MapLiteral;
+        class Logical;
+        class Get;
+        class Set;
+        class Super;
+        class NumberBinary;
+        class StringAdd;
 
         template<class R>
         class Visitor {
@@ -24,10 +37,24 @@ namespace ast {
                 virtual fn visitUnaryExpr(Unary& expr) -> R = 0;
                 virtual fn visitVariableExpr(Variable& expr) -> R = 0;
                 virtual fn visitAssignExpr(Assign& expr) -> R = 0;
+                virtual fn visitCallExpr(Call& expr) -> R = 0;
+                virtual fn visitIndexExpr(Index& expr) -> R = 0;
+                virtual fn visitIndexSetExpr(IndexSet& expr) -> R = 0;
+                virtual fn visitArrayLiteralExpr(ArrayLiteral& expr) -> R = 0;
+                virtual fn visitMapLiteralExpr(MapLiteral& expr) -> R = 0;
+                virtual fn visitLogicalExpr(Logical& expr) -> R = 0;
+                virtual fn visitGetExpr(Get& expr) -> R = 0;
+                virtual fn visitSetExpr(Set& expr) -> R = 0;
+                virtual fn visitSuperExpr(Super& expr) -> R = 0;
+                virtual fn visitNumberBinaryExpr(NumberBinary& expr) -> R = 0;
+                virtual fn visitStringAddExpr(StringAdd& expr) -> R = 0;
         };
 
         class Expr {
         public:
+                Expr() {
+                        STATS_ADD(ast_nodes, 1);
+                }
                 virtual ~Expr() = default;
                 virtual fn accept(Visitor<std::any>& visitor) -> std::any = 0;
         };
@@ -37,6 +64,15 @@ namespace ast {
                 std::shared_ptr<Expr> left;
                 token::Token op;
                 std::shared_ptr<Expr> right;
+                // quickened forms, see Quickened; made on first use and
+                // kept with the site, so one still running deeper in a
+                // recursion stays valid when the site is swapped again
+                std::unique_ptr<NumberBinary> number;
+                std::unique_ptr<StringAdd> string;
+                // times a quickened form went back to this node, past
+                // max_deopts the site stays generic
+                uint8_t deopts = 0;
+                static constexpr uint8_t max_deopts = 4;
 
                 fn accept(Visitor<std::any>& visitor) -> std::any {
                         return visitor.visitBinaryExpr(*this);
@@ -97,9 +133,25 @@ namespace ast {
                 {}
         };
 
+        // where a name is found at run time, decided by the resolver
+        enum binding {
+                // by name in the environment chain
+                ENVIRONMENT,
+                // in the flat upvalues of the running closure
+                UPVALUE,
+                // the running closure itself, a local function
+                // reading its own name
+                SELF,
+        };
+
         class Variable : public Expr {
         public:
                 token::Token name;
+                binding where = ENVIRONMENT;
+                // index into the upvalues if where is UPVALUE
+                int upvalue = -1;
+                // the variable lives in a shared cell
+                bool boxed = false;
 
                 fn accept(Visitor<std::any>& visitor) -> std::any {
                         return visitor.visitVariableExpr(*this);
@@ -115,6 +167,12 @@ namespace ast {
         public:
                 token::Token name;
                 std::shared_ptr<Expr> value;
+                // as in Variable, never SELF
+                binding where = ENVIRONMENT;
+                int upvalue = -1;
+                bool boxed = false;
+                // the name in trace::strings(), see trace::Tracer::assign
+                uint32_t trace_name = 0;
 
                 fn accept(Visitor<std::any>& visitor) -> std::any {
                         return visitor.visitAssignExpr(*this);
@@ -126,4 +184,221 @@ namespace ast {
                 ) : name(t), value(v)
                 {}
         };
+
+        class Get : public Expr {
+        public:
+                std::shared_ptr<Expr> object;
+                token::Token name;
+                cache::Cache cache;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitGetExpr(*this);
+                }
+
+                Get(
+                        std::shared_ptr<Expr> o,
+                        token::Token n
+                ) : object(o), name(n)
+                {}
+        };
+
+        class Set : public Expr {
+        public:
+                std::shared_ptr<Expr> object;
+                token::Token name;
+                std::shared_ptr<Expr> value;
+                cache::Cache cache;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitSetExpr(*this);
+                }
+
+                Set(
+                        std::shared_ptr<Expr> o,
+                        token::Token n,
+                        std::shared_ptr<Expr> v
+                ) : object(o), name(n), value(v)
+                {}
+        };
+
+        // super.method, bound to this
+        class Super : public Expr {
+        public:
+                token::Token keyword;
+                token::Token method;
+                // resolved like any other name
+                std::shared_ptr<Variable> superclass;
+                std::shared_ptr<Variable> self;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitSuperExpr(*this);
+                }
+
+                Super(
+                        token::Token k,
+                        token::Token m,
+                        std::shared_ptr<Variable> s,
+                        std::shared_ptr<Variable> t
+                ) : keyword(k), method(m), superclass(s), self(t)
+                {}
+        };
+
+        class Call : public Expr {
+        public:
+                std::shared_ptr<Expr> callee;
+                token::Token paren;
+                std::vector<std::shared_ptr<Expr>> arguments;
+                // callee if it is obj.name, called without binding
+                Get* method;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitCallExpr(*this);
+                }
+
+                Call(
+                        std::shared_ptr<Expr> c,
+                        token::Token p,
+                        std::vector<std::shared_ptr<Expr>> a
+                ) : callee(c), paren(p), arguments(a),
+                        method(dynamic_cast<Get*>(c.get()))
+                {}
+        };
+
+        class Index : public Expr {
+        public:
+                std::shared_ptr<Expr> object;
+                token::Token bracket;
+                std::shared_ptr<Expr> index;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitIndexExpr(*this);
+                }
+
+                Index(
+                        std::shared_ptr<Expr> o,
+                        token::Token b,
+                        std::shared_ptr<Expr> i
+                ) : object(o), bracket(b), index(i)
+                {}
+        };
+
+        class IndexSet : public Expr {
+        public:
+                std::shared_ptr<Expr> object;
+                token::Token bracket;
+                std::shared_ptr<Expr> index;
+                std::shared_ptr<Expr> value;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitIndexSetExpr(*this);
+                }
+
+                IndexSet(
+                        std::shared_ptr<Expr> o,
+                        token::Token b,
+                        std::shared_ptr<Expr> i,
+                        std::shared_ptr<Expr> v
+                ) : object(o), bracket(b), index(i), value(v)
+                {}
+        };
+
+        class ArrayLiteral : public Expr {
+        public:
+                token::Token bracket;
+                std::vector<std::shared_ptr<Expr>> elements;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitArrayLiteralExpr(*this);
+                }
+
+                ArrayLiteral(
+                        token::Token b,
+                        std::vector<std::shared_ptr<Expr>> e
+                ) : bracket(b), elements(e)
+                {}
+        };
+
+        class MapLiteral : public Expr {
+        public:
+                token::Token brace;
+                std::vector<std::shared_ptr<Expr>> keys;
+                std::vector<std::shared_ptr<Expr>> values;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitMapLiteralExpr(*this);
+                }
+
+                MapLiteral(
+                        token::Token b,
+                        std::vector<std::shared_ptr<Expr>> k,
+                        std::vector<std::shared_ptr<Expr>> v
+                ) : brace(b), keys(k), values(v)
+                {}
+        };
+
+        // and / or, the right side is evaluated only when needed
+        class Logical : public Expr {
+        public:
+                std::shared_ptr<Expr> left;
+                token::Token op;
+                std::shared_ptr<Expr> right;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitLogicalExpr(*this);
+                }
+
+                Logical(
+                        std::shared_ptr<Expr> l,
+                        token::Token o,
+                        std::shared_ptr<Expr> r
+                ) : left(l), op(o), right(r)
+                {}
+        };
+
+        // A binary site quickened to the operands it has seen. The
+        // interpreter swaps it in for the generic node in the parent once a
+        // run saw fitting operands, it checks them with one guard and swaps
+        // the generic node back on a miss. The slot keeps owning the generic
+        // node and points at its quickened form with an alias. Quickened
+        // nodes are made at run time only, the resolver never sees them.
+        class Quickened : public Expr {
+        public:
+                // the node it stands for and is owned by, with the operands
+                Binary* generic;
+
+                Quickened(
+                        Binary* g
+                ) : generic(g)
+                {}
+        };
+
+        // arithmetic or a comparison of two numbers
+        class NumberBinary : public Quickened {
+        public:
+                // the operator of generic, picked when quickened
+                std::any (*apply)(double, double);
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitNumberBinaryExpr(*this);
+                }
+
+                NumberBinary(
+                        Binary* g,
+                        std::any (*a)(double, double)
+                ) : Quickened(g), apply(a)
+                {}
+        };
+
+        // + of two strings
+        class StringAdd : public Quickened {
+        public:
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitStringAddExpr(*this);
+                }
+
+                StringAdd(
+                        Binary* g
+                ) : Quickened(g)
+                {}
+        };
 }
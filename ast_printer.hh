@@ -6,27 +6,27 @@
 namespace ast_printer {
         class AstPrinter : public ast::Visitor<std::any> {
                 fn parenthesize(
-                        std::wstring name,
+                        std::string name,
                         std::vector<std::shared_ptr<ast::Expr>> exprs
-                ) -> std::wstring {
-                        std::wstring builder;
-                        builder.append(L"(").append(name);
+                ) -> std::string {
+                        std::string builder;
+                        builder.append("(").append(name);
                         for (auto& expr : exprs) {
-                                builder.append(L" ");
+                                builder.append(" ");
                                 builder.append(
-                                        std::any_cast<std::wstring>(
+                                        std::any_cast<std::string>(
                                                 expr->accept(*this)
                                         )
                                 );
                         }
-                        builder.append(L")");
+                        builder.append(")");
 
                         return builder;
                 }
 
         public:
-                fn print(std::shared_ptr<ast::Expr> expr) -> std::wstring {
-                        return std::any_cast<std::wstring>(
+                fn print(std::shared_ptr<ast::Expr> expr) -> std::string {
+                        return std::any_cast<std::string>(
                                 expr->accept(*this)
                         );
                 }
@@ -40,16 +40,16 @@ namespace ast_printer {
 
                 fn visitGroupingExpr(ast::Grouping& expr) -> std::any {
                         return parenthesize(
-                                L"group",
+                                "group",
                                 {expr.expression}
                         );
                 }
 
                 fn visitLiteralExpr(ast::Literal& expr) -> std::any {
                         if (!expr.value.has_value()) {
-                                return L"nil";
+                                return "nil";
                         }
-                        return utils::to_wstring(expr.value);
+                        return utils::to_string(expr.value);
                 }
 
                 fn visitUnaryExpr(ast::Unary& expr) -> std::any {
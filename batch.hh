@@ -0,0 +1,849 @@
+#pragma once
+#include "cpplox.hh"
+#include "utils.hh"
+#include "errors.hh"
+#include "ast.hh"
+#include "stmt.hh"
+#include "interpreter.hh"
+#include "output.hh"
+#include "simd.hh"
+#include "stack.hh"
+
+// Batch mode of --batch: one script run over every record of a table.
+// The columns of the input are globals named by their headers; after a
+// record's run the result global holds its entry of the output column.
+//
+// A script of var, assignment, if and block statements over number and
+// boolean columns is compiled to a Plan instead. Every expression of it
+// runs over a block of records at once on the simd kernels, an if picks
+// between what its branches assigned. Anything else (calls, strings,
+// loops, print) runs record by record on one interpreter.
+//
+// Tables are read from CSV with a header line, or from the binary
+// format of read_binary().
+namespace batch {
+        enum kind : uint8_t {
+                NUMBER,
+                BOOL,
+                STRING,
+        };
+
+        class Column {
+        public:
+                std::string name;
+                kind type = NUMBER;
+                // numbers, 1 and 0 for booleans
+                std::vector<double> numbers;
+                std::vector<std::string> strings;
+
+                fn size() const -> size_t {
+                        return type == STRING ? strings.size() : numbers.size();
+                }
+
+                fn value(size_t row) const -> std::any {
+                        switch (type) {
+                        case NUMBER: return numbers[row];
+                        case BOOL:   return numbers[row] != 0;
+                        default:     return strings[row];
+                        }
+                }
+
+                // a row as text, the way print writes it
+                fn text(size_t row) const -> std::string {
+                        if (type == STRING) {
+                                return strings[row];
+                        }
+                        if (type == BOOL) {
+                                return numbers[row] != 0 ? "true" : "false";
+                        }
+                        char buf[output::number_size];
+                        return std::string(buf, output::format_number(buf, numbers[row]));
+                }
+
+                // every row as text, for a value of another kind
+                fn to_strings() {
+                        if (type == STRING) {
+                                return;
+                        }
+                        strings.reserve(numbers.size());
+                        for (size_t i = 0; i < numbers.size(); ++i) {
+                                strings.push_back(text(i));
+                        }
+                        numbers = {};
+                        type = STRING;
+                }
+        };
+
+        class Table {
+        public:
+                std::vector<Column> columns;
+                size_t rows = 0;
+        };
+
+        namespace {
+                constexpr std::string_view magic = "LOXCOL1\n";
+
+                fn parse_number(std::string_view s, double& d) -> bool {
+                        auto end = s.data() + s.size();
+                        auto [p, ec] = std::from_chars(s.data(), end, d);
+                        return !s.empty() && ec == std::errc() && p == end;
+                }
+
+                // fields of RFC 4180 records, unquoted ones are views of
+                // the text
+                class CsvReader {
+                        std::string_view text;
+                        size_t pos = 0;
+                        // quoted fields, unescaped
+                        std::deque<std::string> quoted;
+
+                        fn field(bool& last) -> std::string_view {
+                                std::string_view value;
+                                if (pos < text.size() && text[pos] == '"') {
+                                        auto& s = quoted.emplace_back();
+                                        pos++;
+                                        while (true) {
+                                                if (pos >= text.size()) {
+                                                        throw std::runtime_error("batch: unterminated quote in CSV input");
+                                                }
+                                                char c = text[pos++];
+                                                if (c != '"') {
+                                                        s.push_back(c);
+                                                } else if (pos < text.size() && text[pos] == '"') {
+                                                        s.push_back('"');
+                                                        pos++;
+                                                } else {
+                                                        break;
+                                                }
+                                        }
+                                        value = s;
+                                        while (pos < text.size() && text[pos] == '\r') {
+                                                pos++;
+                                        }
+                                        if (pos < text.size() && text[pos] != ',' && text[pos] != '\n') {
+                                                throw std::runtime_error("batch: text after a closing quote in CSV input");
+                                        }
+                                } else {
+                                        auto start = pos;
+                                        while (pos < text.size() && text[pos] != ',' && text[pos] != '\n') {
+                                                pos++;
+                                        }
+                                        value = text.substr(start, pos - start);
+                                        if (value.ends_with('\r')) {
+                                                value.remove_suffix(1);
+                                        }
+                                }
+
+                                last = pos >= text.size() || text[pos] == '\n';
+                                pos++;
+                                return value;
+                        }
+
+                public:
+                        CsvReader(
+                                std::string_view t
+                        ) : text(t)
+                        {}
+
+                        // false at the end of the text, blank lines are
+                        // skipped
+                        fn record(std::vector<std::string_view>& fields) -> bool {
+                                while (pos < text.size()) {
+                                        fields.clear();
+                                        bool last = false;
+                                        while (!last) {
+                                                fields.push_back(field(last));
+                                        }
+                                        if (fields.size() > 1 || !fields[0].empty()) {
+                                                return true;
+                                        }
+                                }
+                                return false;
+                        }
+                };
+
+                // the kind every cell of a column fits
+                fn classify(Column& c, const std::vector<std::string_view>& cells) {
+                        c.numbers.reserve(cells.size());
+                        double d;
+                        for (auto s : cells) {
+                                if (!parse_number(s, d)) {
+                                        break;
+                                }
+                                c.numbers.push_back(d);
+                        }
+                        if (c.numbers.size() == cells.size()) {
+                                c.type = NUMBER;
+                                return;
+                        }
+
+                        c.numbers.clear();
+                        for (auto s : cells) {
+                                if (s != "true" && s != "false") {
+                                        break;
+                                }
+                                c.numbers.push_back(s == "true");
+                        }
+                        if (c.numbers.size() == cells.size()) {
+                                c.type = BOOL;
+                                return;
+                        }
+
+                        c.numbers = {};
+                        c.type = STRING;
+                        c.strings.assign(cells.begin(), cells.end());
+                }
+
+                // bounds-checked reads of the binary format
+                class Bytes {
+                        std::string_view data;
+                        size_t pos = 0;
+
+                public:
+                        Bytes(
+                                std::string_view d
+                        ) : data(d)
+                        {}
+
+                        fn take(size_t n) -> std::string_view {
+                                if (n > data.size() - pos) {
+                                        throw std::runtime_error("batch: truncated binary input");
+                                }
+                                auto s = data.substr(pos, n);
+                                pos += n;
+                                return s;
+                        }
+
+                        template<class T>
+                        fn get() -> T {
+                                T v;
+                                std::memcpy(&v, take(sizeof(T)).data(), sizeof(T));
+                                return v;
+                        }
+                };
+
+                template<class T>
+                fn put(output::Writer& w, T v) {
+                        w.write(std::string_view(reinterpret_cast<const char*>(&v), sizeof(T)));
+                }
+        }
+
+        // A header line of column names and one record per line. A
+        // column is numbers if every cell is one, booleans if every cell
+        // is true or false, and strings otherwise.
+        fn read_csv(std::string_view text) -> Table {
+                CsvReader reader(text);
+                std::vector<std::string_view> fields;
+                if (!reader.record(fields)) {
+                        throw std::runtime_error("batch: CSV input has no header");
+                }
+                Table t;
+                for (auto name : fields) {
+                        t.columns.emplace_back().name = name;
+                }
+
+                std::vector<std::vector<std::string_view>> cells(t.columns.size());
+                while (reader.record(fields)) {
+                        if (fields.size() != cells.size()) {
+                                throw std::runtime_error(std::format(
+                                        "batch: record {} has {} fields, the header {}",
+                                        t.rows + 1, fields.size(), cells.size()
+                                ));
+                        }
+                        for (size_t i = 0; i < fields.size(); ++i) {
+                                cells[i].push_back(fields[i]);
+                        }
+                        t.rows++;
+                }
+                for (size_t i = 0; i < cells.size(); ++i) {
+                        classify(t.columns[i], cells[i]);
+                }
+                return t;
+        }
+
+        // magic, u64 records, u32 columns, the kind (u8) and name (u32
+        // length and bytes) of each column, then the data of one column
+        // after the other: numbers as f64, booleans as u8, strings as u32
+        // length and bytes. Integers and floats in host byte order.
+        fn read_binary(std::string_view data) -> Table {
+                Bytes in(data);
+                if (in.take(magic.size()) != magic) {
+                        throw std::runtime_error("batch: not a binary table");
+                }
+                Table t;
+                t.rows = in.get<uint64_t>();
+                t.columns.resize(in.get<uint32_t>());
+                for (auto& c : t.columns) {
+                        auto type = in.get<uint8_t>();
+                        if (type > STRING) {
+                                throw std::runtime_error(std::format("batch: unknown column kind {}", type));
+                        }
+                        c.type = kind(type);
+                        c.name = in.take(in.get<uint32_t>());
+                }
+                for (auto& c : t.columns) {
+                        if (c.type == NUMBER) {
+                                auto bytes = in.take(t.rows * sizeof(double));
+                                c.numbers.resize(t.rows);
+                                std::memcpy(c.numbers.data(), bytes.data(), bytes.size());
+                        } else if (c.type == BOOL) {
+                                auto bytes = in.take(t.rows);
+                                c.numbers.assign(bytes.begin(), bytes.end());
+                        } else {
+                                c.strings.reserve(t.rows);
+                                for (size_t i = 0; i < t.rows; ++i) {
+                                        c.strings.emplace_back(in.take(in.get<uint32_t>()));
+                                }
+                        }
+                }
+                return t;
+        }
+
+        // binary if it starts with the magic, CSV otherwise
+        fn load(const std::string& path) -> Table {
+                auto data = utils::get_file(path);
+                if (data.starts_with(magic)) {
+                        return read_binary(data);
+                }
+                return read_csv(data);
+        }
+
+        // a field quoted if it has to be
+        fn write_field(output::Writer& w, std::string_view s) {
+                if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+                        w.write(s);
+                        return;
+                }
+                w.write(std::string_view("\""));
+                for (auto q = s.find('"'); q != std::string_view::npos; q = s.find('"')) {
+                        w.write(s.substr(0, q + 1));
+                        w.write(std::string_view("\""));
+                        s.remove_prefix(q + 1);
+                }
+                w.write(s);
+                w.write(std::string_view("\""));
+        }
+
+        fn write_csv(output::Writer& w, const Table& t) {
+                for (size_t i = 0; i < t.columns.size(); ++i) {
+                        if (i > 0) {
+                                w.write(std::string_view(","));
+                        }
+                        write_field(w, t.columns[i].name);
+                }
+                w.newline();
+                for (size_t row = 0; row < t.rows; ++row) {
+                        for (size_t i = 0; i < t.columns.size(); ++i) {
+                                auto& c = t.columns[i];
+                                if (i > 0) {
+                                        w.write(std::string_view(","));
+                                }
+                                if (c.type == NUMBER) {
+                                        w.write(c.numbers[row]);
+                                } else if (c.type == BOOL) {
+                                        w.write(std::string_view(c.numbers[row] != 0 ? "true" : "false"));
+                                } else {
+                                        write_field(w, c.strings[row]);
+                                }
+                        }
+                        w.newline();
+                }
+        }
+
+        fn write_binary(output::Writer& w, const Table& t) {
+                w.write(magic);
+                put<uint64_t>(w, t.rows);
+                put<uint32_t>(w, t.columns.size());
+                for (auto& c : t.columns) {
+                        put<uint8_t>(w, c.type);
+                        put<uint32_t>(w, c.name.size());
+                        w.write(std::string_view(c.name));
+                }
+                for (auto& c : t.columns) {
+                        if (c.type == NUMBER) {
+                                w.write(std::string_view(
+                                        reinterpret_cast<const char*>(c.numbers.data()),
+                                        c.numbers.size() * sizeof(double)
+                                ));
+                        } else if (c.type == BOOL) {
+                                for (auto d : c.numbers) {
+                                        put<uint8_t>(w, d != 0);
+                                }
+                        } else {
+                                for (auto& s : c.strings) {
+                                        put<uint32_t>(w, s.size());
+                                        w.write(std::string_view(s));
+                                }
+                        }
+                }
+        }
+
+        // an operand of the plan: a register, or a constant
+        class Value {
+        public:
+                kind type;
+                // a column of the input below Plan::inputs, the result
+                // of an op above; -1 for a constant
+                int reg = -1;
+                double constant = 0;
+
+                fn same(const Value& o) const -> bool {
+                        return type == o.type && reg == o.reg && (reg >= 0 || constant == o.constant);
+                }
+        };
+
+        // one kernel over a block of records
+        class Op {
+        public:
+                // simd::map of o, or simd::select by c if select is set
+                simd::op o;
+                bool select;
+                Value a;
+                Value b;
+                Value c;
+        };
+
+        // a script compiled to kernels over the columns of a table
+        class Plan {
+        public:
+                static constexpr size_t block = 1024;
+
+                std::string result_name;
+                // registers of the input columns, the ops' come after
+                size_t inputs = 0;
+                std::vector<Op> ops;
+                Value result;
+
+                fn run(const Table& in) -> Column {
+                        Column out;
+                        out.name = result_name;
+                        out.type = result.type;
+                        out.numbers.resize(in.rows);
+
+                        // ops the result does not depend on are left out
+                        std::vector<bool> live(ops.size());
+                        auto mark = [&](const Value& v) {
+                                if (v.reg >= int(inputs)) {
+                                        live[v.reg - inputs] = true;
+                                }
+                        };
+                        mark(result);
+                        for (size_t k = ops.size(); k-- > 0;) {
+                                if (live[k]) {
+                                        mark(ops[k].a);
+                                        mark(ops[k].b);
+                                        mark(ops[k].c);
+                                }
+                        }
+
+                        std::vector<double> temps(ops.size() * block);
+                        std::vector<const double*> regs(inputs + ops.size());
+                        auto at = [&](const Value& v) -> const double* {
+                                return v.reg >= 0 ? regs[v.reg] : nullptr;
+                        };
+                        for (size_t start = 0; start < in.rows; start += block) {
+                                size_t n = std::min(block, in.rows - start);
+                                for (size_t i = 0; i < inputs; ++i) {
+                                        regs[i] = in.columns[i].numbers.data() + start;
+                                }
+                                for (size_t k = 0; k < ops.size(); ++k) {
+                                        if (!live[k]) {
+                                                continue;
+                                        }
+                                        auto& op = ops[k];
+                                        auto dst = temps.data() + k * block;
+                                        if (op.select) {
+                                                simd::select(at(op.c), at(op.a), op.a.constant, at(op.b), op.b.constant, dst, n);
+                                        } else {
+                                                simd::map(op.o, at(op.a), op.a.constant, at(op.b), op.b.constant, dst, n);
+                                        }
+                                        regs[inputs + k] = dst;
+                                }
+                                auto to = out.numbers.data() + start;
+                                if (result.reg >= 0) {
+                                        std::copy_n(regs[result.reg], n, to);
+                                } else {
+                                        std::fill_n(to, n, result.constant);
+                                }
+                        }
+                        return out;
+                }
+        };
+
+        // Builds a plan by walking the script once with every name bound
+        // to the value it holds at that point. Blocks restore the names
+        // they shadow, an if merges the names its branches assigned.
+        class Compiler : public ast::Visitor<std::any>,
+                         public stmt::Visitor<std::any>
+        {
+                // what no kernel does, the script runs record by record
+                class unsupported {};
+
+                Plan& plan;
+                std::unordered_map<std::string, Value> names;
+                // names declared in the open blocks, with what they hid
+                std::vector<std::vector<std::pair<std::string, std::optional<Value>>>> scopes;
+                // an assignment here would run for some records only
+                bool conditional = false;
+
+                fn compile(std::shared_ptr<ast::Expr>& expr) -> Value {
+                        return std::any_cast<Value>(stack::guard([&] {
+                                return expr->accept(*this);
+                        }));
+                }
+
+                fn compile(const std::shared_ptr<stmt::Stmt>& statement) -> void {
+                        if (statement != nullptr) {
+                                stack::guard([&] {
+                                        statement->accept(*this);
+                                });
+                        }
+                }
+
+                fn map(simd::op o, kind type, Value a, Value b) -> Value {
+                        if (a.reg < 0 && b.reg < 0) {
+                                double r;
+                                simd::map(o, &a.constant, 0, &b.constant, 0, &r, 1);
+                                return Value{type, -1, r};
+                        }
+                        plan.ops.push_back(Op{o, false, a, b, {}});
+                        return Value{type, int(plan.inputs + plan.ops.size() - 1)};
+                }
+
+                fn select(Value c, Value a, Value b) -> Value {
+                        if (c.reg < 0) {
+                                return c.constant != 0 ? a : b;
+                        }
+                        if (a.same(b)) {
+                                return a;
+                        }
+                        if (a.type != b.type) {
+                                throw unsupported();
+                        }
+                        plan.ops.push_back(Op{simd::ADD, true, a, b, c});
+                        return Value{a.type, int(plan.inputs + plan.ops.size() - 1)};
+                }
+
+                // the truth of a value as a boolean, numbers are true
+                static fn truth(const Value& v) -> Value {
+                        if (v.type == BOOL) {
+                                return v;
+                        }
+                        return Value{BOOL, -1, 1};
+                }
+
+                static fn require(const Value& v, kind type) {
+                        if (v.type != type) {
+                                throw unsupported();
+                        }
+                }
+
+        public:
+                Compiler(
+                        Plan& p,
+                        const Table& in
+                ) : plan(p)
+                {
+                        plan.inputs = in.columns.size();
+                        for (size_t i = 0; i < in.columns.size(); ++i) {
+                                auto& c = in.columns[i];
+                                if (c.type != STRING) {
+                                        names[c.name] = Value{c.type, int(i)};
+                                }
+                        }
+                }
+
+                // false if a statement has no kernel
+                fn compile(std::vector<std::shared_ptr<stmt::Stmt>>& statements) -> bool {
+                        try {
+                                for (auto& statement : statements) {
+                                        compile(statement);
+                                }
+                        } catch (unsupported&) {
+                                return false;
+                        }
+                        auto result = names.find(plan.result_name);
+                        if (result == names.end()) {
+                                return false;
+                        }
+                        plan.result = result->second;
+                        return true;
+                }
+
+                fn visitLiteralExpr(ast::Literal& expr) -> std::any {
+                        if (auto d = std::any_cast<double>(&expr.value)) {
+                                return Value{NUMBER, -1, *d};
+                        }
+                        if (auto b = std::any_cast<bool>(&expr.value)) {
+                                return Value{BOOL, -1, double(*b)};
+                        }
+                        throw unsupported();
+                }
+
+                fn visitGroupingExpr(ast::Grouping& expr) -> std::any {
+                        return compile(expr.expression);
+                }
+
+                fn visitUnaryExpr(ast::Unary& expr) -> std::any {
+                        auto right = compile(expr.right);
+                        if (expr.op.type == token::MINUS) {
+                                require(right, NUMBER);
+                                return map(simd::MUL, NUMBER, right, Value{NUMBER, -1, -1});
+                        }
+                        return map(simd::EQ, BOOL, truth(right), Value{BOOL, -1, 0});
+                }
+
+                fn visitBinaryExpr(ast::Binary& expr) -> std::any {
+                        auto left = compile(expr.left);
+                        auto right = compile(expr.right);
+                        simd::op o;
+                        switch (expr.op.type) {
+                        case token::PLUS:          o = simd::ADD; break;
+                        case token::MINUS:         o = simd::SUB; break;
+                        case token::STAR:          o = simd::MUL; break;
+                        case token::SLASH:         o = simd::DIV; break;
+                        case token::LESS:          o = simd::LT; break;
+                        case token::LESS_EQUAL:    o = simd::LE; break;
+                        case token::GREATER:       o = simd::GT; break;
+                        case token::GREATER_EQUAL: o = simd::GE; break;
+                        case token::EQUAL_EQUAL:
+                        case token::BANG_EQUAL: {
+                                bool equal = expr.op.type == token::EQUAL_EQUAL;
+                                // a number is never equal to a boolean
+                                if (left.type != right.type) {
+                                        return Value{BOOL, -1, double(!equal)};
+                                }
+                                return map(equal ? simd::EQ : simd::NE, BOOL, left, right);
+                        }
+                        default:
+                                throw unsupported();
+                        }
+                        require(left, NUMBER);
+                        require(right, NUMBER);
+                        return map(o, o >= simd::LT ? BOOL : NUMBER, left, right);
+                }
+
+                fn visitNumberBinaryExpr(ast::NumberBinary& expr) -> std::any {
+                        return visitBinaryExpr(*expr.generic);
+                }
+
+                fn visitLogicalExpr(ast::Logical& expr) -> std::any {
+                        auto left = compile(expr.left);
+                        auto saved = conditional;
+                        conditional = true;
+                        auto right = compile(expr.right);
+                        conditional = saved;
+                        // a number is true, and ends or and goes on in and
+                        if (left.type == NUMBER) {
+                                return expr.op.type == token::OR ? left : right;
+                        }
+                        require(right, BOOL);
+                        if (expr.op.type == token::OR) {
+                                return select(left, Value{BOOL, -1, 1}, right);
+                        }
+                        return select(left, right, Value{BOOL, -1, 0});
+                }
+
+                fn visitVariableExpr(ast::Variable& expr) -> std::any {
+                        auto v = names.find(expr.name.lexeme);
+                        if (v == names.end()) {
+                                throw unsupported();
+                        }
+                        return v->second;
+                }
+
+                fn visitAssignExpr(ast::Assign& expr) -> std::any {
+                        auto value = compile(expr.value);
+                        auto v = names.find(expr.name.lexeme);
+                        if (conditional || v == names.end()) {
+                                throw unsupported();
+                        }
+                        v->second = value;
+                        return value;
+                }
+
+                fn visitCallExpr(ast::Call&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitIndexExpr(ast::Index&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitIndexSetExpr(ast::IndexSet&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitArrayLiteralExpr(ast::ArrayLiteral&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitMapLiteralExpr(ast::MapLiteral&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitGetExpr(ast::Get&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitSetExpr(ast::Set&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitSuperExpr(ast::Super&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitStringAddExpr(ast::StringAdd&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitExpressionStmt(stmt::Expression& stmt) -> std::any {
+                        compile(stmt.expression);
+                        return {};
+                }
+
+                fn visitVarStmt(stmt::Var& stmt) -> std::any {
+                        if (stmt.initializer == nullptr) {
+                                throw unsupported();
+                        }
+                        auto value = compile(stmt.initializer);
+                        auto& name = stmt.name.lexeme;
+                        if (!scopes.empty()) {
+                                auto old = names.find(name);
+                                scopes.back().emplace_back(
+                                        name,
+                                        old != names.end() ? std::optional(old->second) : std::nullopt
+                                );
+                        }
+                        names[name] = value;
+                        return {};
+                }
+
+                fn visitBlockStmt(stmt::Block& stmt) -> std::any {
+                        if (stmt.deferred.tokens != nullptr) {
+                                parser::expand(stmt);
+                        }
+                        scopes.emplace_back();
+                        for (auto& statement : stmt.statements) {
+                                compile(statement);
+                        }
+                        auto& declared = scopes.back();
+                        for (auto d = declared.rbegin(); d != declared.rend(); ++d) {
+                                if (d->second) {
+                                        names[d->first] = *d->second;
+                                } else {
+                                        names.erase(d->first);
+                                }
+                        }
+                        scopes.pop_back();
+                        return {};
+                }
+
+                fn visitIfStmt(stmt::If& stmt) -> std::any {
+                        auto c = truth(compile(stmt.condition.expr));
+                        if (c.reg < 0) {
+                                compile(c.constant != 0 ? stmt.then_branch : stmt.else_branch);
+                                return {};
+                        }
+
+                        auto before = names;
+                        compile(stmt.then_branch);
+                        auto then_names = std::move(names);
+                        names = std::move(before);
+                        compile(stmt.else_branch);
+                        if (then_names.size() != names.size()) {
+                                throw unsupported();
+                        }
+                        for (auto& [name, value] : names) {
+                                auto t = then_names.find(name);
+                                if (t == then_names.end()) {
+                                        throw unsupported();
+                                }
+                                value = select(c, t->second, value);
+                        }
+                        return {};
+                }
+
+                fn visitPrintStmt(stmt::Print&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitImportStmt(stmt::Import&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitWhileStmt(stmt::While&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitFunctionStmt(stmt::Function&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitReturnStmt(stmt::Return&) -> std::any {
+                        throw unsupported();
+                }
+
+                fn visitClassStmt(stmt::Class&) -> std::any {
+                        throw unsupported();
+                }
+        };
+
+        // the plan of a script over in, nullptr if some of it has no kernel
+        fn compile(
+                std::vector<std::shared_ptr<stmt::Stmt>>& statements,
+                const Table& in,
+                const std::string& result
+        ) -> std::unique_ptr<Plan> {
+                auto plan = std::make_unique<Plan>();
+                plan->result_name = result;
+                if (!Compiler(*plan, in).compile(statements)) {
+                        return nullptr;
+                }
+                return plan;
+        }
+
+        // The script once per record on one interpreter, its globals stay
+        // between records. The first result decides the kind of the
+        // column, a result of another kind turns it into strings.
+        fn run_rows(
+                interpreter::Interpreter& it,
+                const std::vector<std::shared_ptr<stmt::Stmt>>& statements,
+                const Table& in,
+                const std::string& result
+        ) -> Column {
+                Column out;
+                out.name = result;
+                for (size_t row = 0; row < in.rows; ++row) {
+                        for (auto& c : in.columns) {
+                                it.define(c.name, c.value(row));
+                        }
+                        std::any value;
+                        try {
+                                it.run(statements);
+                                value = it.global(result);
+                        } catch (errors::runtime_panic& err) {
+                                throw errors::runtime_panic(
+                                        err.token,
+                                        std::format("{} (record {})", err.what(), row + 1)
+                                );
+                        }
+
+                        auto d = std::any_cast<double>(&value);
+                        auto b = std::any_cast<bool>(&value);
+                        if (row == 0) {
+                                out.type = d ? NUMBER : b ? BOOL : STRING;
+                        }
+                        if (d && out.type == NUMBER) {
+                                out.numbers.push_back(*d);
+                        } else if (b && out.type == BOOL) {
+                                out.numbers.push_back(*b);
+                        } else {
+                                out.to_strings();
+                                out.strings.push_back(it.show(value));
+                        }
+                }
+                return out;
+        }
+}
@@ -0,0 +1,483 @@
+// Microbenchmarks for the scanner, parser and interpreter over the
+// synthetic corpora in corpus.hh. Human readable results go to stderr,
+// JSON to stdout.
+//
+//   bench [filter]        runs benchmarks whose name contains filter
+//   bench --corpus dir    writes the corpora to dir/<name>.lox instead
+//   bench --stress dir n  writes the programs nested n deep to dir
+
+#include "../cpplox.hh"
+#include "../errors.hh"
+#include "../scanner.hh"
+#include "../parser.hh"
+#include "../interpreter.hh"
+#include "../output.hh"
+#include "../simd.hh"
+#include "../hashmap.hh"
+#include "../object.hh"
+#include "../batch.hh"
+#include "../trace.hh"
+#include "corpus.hh"
+#include "bench.hh"
+
+// discards everything, only the interpreter is measured
+class NullSink : public output::Sink {
+public:
+        fn write(const char*, size_t) -> void {}
+};
+
+// instances held outside any interpreter, alive across collections
+class Bodies : public gc::Roots {
+public:
+        std::vector<object::instance_ptr> all;
+
+        fn trace(gc::Tracer& t) -> void {
+                for (auto b : all) {
+                        t.object(b);
+                }
+        }
+};
+
+fn main(int argc, char* argv[]) -> int {
+        std::vector<std::pair<std::string, std::string>> sources = {
+                {"deep_expressions", corpus::deep_expressions(2000, 40)},
+                {"many_globals",     corpus::many_globals(20000)},
+                {"nested_blocks",    corpus::nested_blocks(2000, 16)},
+                {"string_heavy",     corpus::string_heavy(20000)},
+                {"number_heavy",     corpus::number_heavy(20000)},
+        };
+
+        if (argc == 3 && std::string(argv[1]) == "--corpus") {
+                for (auto& [name, source] : sources) {
+                        std::ofstream f(std::filesystem::path(argv[2]) / (name + ".lox"));
+                        f << source;
+                }
+                return 0;
+        }
+        if (argc == 4 && std::string(argv[1]) == "--stress") {
+                for (auto& [name, source] : corpus::deep_nesting(std::stoul(argv[3]))) {
+                        std::ofstream f(std::filesystem::path(argv[2]) / (name + ".lox"));
+                        f << source;
+                }
+                return 0;
+        }
+
+        bench::Suite suite(argc > 1 ? argv[1] : "");
+        NullSink null;
+        output::Writer out(null);
+
+        for (auto& [name, source] : sources) {
+                scanner::Scanner sc(source);
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                if (errors::hadError) {
+                        std::cerr << "bench: corpus " << name << " does not parse\n";
+                        return 1;
+                }
+
+                suite.run("scanner/" + name, source.size(), [&] {
+                        scanner::Scanner sc(source);
+                        auto t = sc.scan_tokens();
+                });
+
+                suite.run("parser/" + name, source.size(), [&] {
+                        parser::Parser pr(tokens);
+                        auto s = pr.parse();
+                });
+
+                suite.run("interpreter/" + name, 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+
+                if (errors::had_runtime_error) {
+                        std::cerr << "bench: corpus " << name << " fails at runtime\n";
+                        return 2;
+                }
+        }
+
+        // a large module that runs a twentieth of itself, from source
+        // to the end of its run, its bodies deferred or parsed up front
+        auto library = corpus::library(4000, 20);
+        for (auto defer : {true, false}) {
+                suite.run(std::format("startup/library_{}", defer ? "deferred" : "eager"), library.size(), [&] {
+                        parser::defer = defer;
+                        scanner::Scanner sc(library);
+                        parser::Parser pr(sc.scan_tokens());
+                        auto statements = pr.parse();
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+        }
+        parser::defer = true;
+        if (errors::hadError || errors::had_runtime_error) {
+                std::cerr << "bench: corpus library fails\n";
+                return 2;
+        }
+
+        // nesting far past the native stack, scanned, parsed, run and
+        // freed in each iteration
+        for (auto& [name, source] : corpus::deep_nesting(100'000)) {
+                suite.run("stress/" + name, source.size(), [&] {
+                        scanner::Scanner sc(source);
+                        auto tokens = sc.scan_tokens();
+                        parser::Parser pr(tokens);
+                        auto statements = pr.parse();
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+                if (errors::hadError || errors::had_runtime_error) {
+                        std::cerr << "bench: stress " << name << " fails\n";
+                        return 2;
+                }
+        }
+
+        // array kernels against plain loops over the same data
+        constexpr size_t n = 1'000'000;
+        std::vector<double> xs(n), ys(n), zs(n);
+        for (size_t i = 0; i < n; ++i) {
+                xs[i] = i * 0.5;
+                ys[i] = n - i;
+        }
+        volatile double sink;
+
+        suite.run("array/sum_scalar", n * sizeof(double), [&] {
+                sink = std::accumulate(xs.begin(), xs.end(), 0.0);
+        });
+        suite.run("array/sum_kernel", n * sizeof(double), [&] {
+                sink = simd::reduce(simd::SUM, xs.data(), n);
+        });
+        suite.run("array/add_scalar", 2 * n * sizeof(double), [&] {
+                for (size_t i = 0; i < n; ++i) {
+                        zs[i] = xs[i] + ys[i];
+                }
+        });
+        suite.run("array/add_kernel", 2 * n * sizeof(double), [&] {
+                simd::map(simd::ADD, xs.data(), 0, ys.data(), 0, zs.data(), n);
+        });
+        suite.run("array/dot_kernel", 2 * n * sizeof(double), [&] {
+                sink = simd::dot(xs.data(), ys.data(), n);
+        });
+        (void)sink;
+
+        // lookup heavy map workloads against std::unordered_map
+        constexpr size_t keys = 10'000;
+        std::vector<std::any> names, numbers;
+        for (size_t i = 0; i < keys; ++i) {
+                names.push_back(std::format("rule_{}_threshold", i * 7919));
+                numbers.push_back(static_cast<double>(i * 7919));
+        }
+        for (auto& [name, ks] : {std::pair{"string", &names}, std::pair{"number", &numbers}}) {
+                hashmap::Map swiss;
+                std::vector<hashmap::Key> prepared(keys);
+                for (size_t i = 0; i < keys; ++i) {
+                        hashmap::Key::from((*ks)[i], prepared[i]);
+                        swiss.set(prepared[i], static_cast<double>(i));
+                }
+                suite.run(std::format("map/{}_lookup_swiss", name), 0, [&] {
+                        for (auto& k : prepared) {
+                                sink = std::any_cast<double>(*swiss.find(k));
+                        }
+                });
+                suite.run(std::format("map/{}_lookup_swiss_by_value", name), 0, [&] {
+                        for (auto& v : *ks) {
+                                uint64_t hash = 0;
+                                hashmap::Key::hash_of(v, hash);
+                                sink = std::any_cast<double>(*swiss.find(v, hash));
+                        }
+                });
+        }
+        {
+                std::unordered_map<std::string, std::any> strings;
+                std::unordered_map<double, std::any> doubles;
+                for (size_t i = 0; i < keys; ++i) {
+                        strings[std::any_cast<std::string&>(names[i])] = static_cast<double>(i);
+                        doubles[std::any_cast<double>(numbers[i])] = static_cast<double>(i);
+                }
+                suite.run("map/string_lookup_unordered", 0, [&] {
+                        for (auto& v : names) {
+                                sink = std::any_cast<double>(strings.find(std::any_cast<std::string&>(v))->second);
+                        }
+                });
+                suite.run("map/number_lookup_unordered", 0, [&] {
+                        for (auto& v : numbers) {
+                                sink = std::any_cast<double>(doubles.find(std::any_cast<double>(v))->second);
+                        }
+                });
+        }
+
+        // 10M native calls per iteration, through the interpreter's
+        // call path and environment lookup of the callee
+        for (auto [name, call] : {
+                std::pair{"native/abs", "abs(x);"},
+                std::pair{"native/pow", "pow(x, 2);"},
+                std::pair{"native/clock", "clock();"},
+        }) {
+                scanner::Scanner sc(std::string("var x = -1.5;\n") + call);
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                interpreter::Interpreter it(out);
+                it.interpret({statements[0]});
+                suite.run(name, 0, [&] {
+                        for (size_t i = 0; i < 10'000'000; ++i) {
+                                statements[1]->accept(it);
+                        }
+                });
+        }
+
+        // the loop of bench/loop.lox, scaled down to 1M iterations
+        {
+                scanner::Scanner sc(
+                        "var sum = 0;\n"
+                        "for (var i = 0; i < 1000000; i = i + 1) {\n"
+                        "        sum = sum + i;\n"
+                        "}\n"
+                );
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                suite.run("interpreter/loop_1m", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+                // every limit on and out of reach, the cost of the checks
+                limits::Limits quota;
+                quota.depth = 1 << 20;
+                quota.string_length = 1 << 30;
+                quota.steps = uint64_t(1) << 40;
+                quota.time_ms = 60'000;
+                suite.run("interpreter/loop_1m_limited", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.set_limits(quota);
+                        it.interpret(statements);
+                });
+                // a debugger attached without breakpoints, the probe on
+                // every statement; loop_1m is the same run without one
+                int null = ::open("/dev/null", O_RDWR);
+                debugger::Debugger debug(null, null, false);
+                suite.run("interpreter/loop_1m_debug", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.set_debugger(&debug);
+                        it.interpret(statements);
+                });
+                ::close(null);
+                // a record per statement and assignment into the ring
+                trace::Tracer tracer("/dev/null");
+                suite.run("interpreter/loop_1m_traced", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.set_tracer(&tracer);
+                        it.interpret(statements);
+                });
+        }
+
+        // a field read through a site cache against a per-instance
+        // name table, 10k instances with 8 fields each
+        {
+                constexpr size_t instances = 10'000;
+                const std::string fields[] = {"x", "y", "z", "w", "vx", "vy", "vz", "mass"};
+                auto klass = object::make_class("Body", nullptr);
+                Bodies roots;
+                auto& bodies = roots.all;
+                std::vector<std::unordered_map<std::string, std::any>> tables(instances);
+                for (size_t i = 0; i < instances; ++i) {
+                        auto b = object::make_instance(klass);
+                        for (auto& f : fields) {
+                                b->shape = b->shape->add(f);
+                                b->fields.push_back(static_cast<double>(i));
+                                tables[i][f] = static_cast<double>(i);
+                        }
+                        bodies.push_back(b);
+                }
+                const std::string name = "mass";
+                suite.run("object/field_read_unordered", 0, [&] {
+                        for (auto& t : tables) {
+                                sink = std::any_cast<double>(t.find(name)->second);
+                        }
+                });
+                cache::Cache site;
+                suite.run("object/field_read_shape_cache", 0, [&] {
+                        for (auto& b : bodies) {
+                                auto e = site.find(b->shape->id);
+                                if (e == nullptr) {
+                                        cache::Entry entry;
+                                        entry.shape = b->shape->id;
+                                        entry.slot = b->shape->find(name);
+                                        e = &site.add(std::move(entry));
+                                }
+                                sink = std::any_cast<double>(b->fields[e->slot]);
+                        }
+                });
+        }
+
+        // field and method heavy scripts, monomorphic and polymorphic
+        for (auto [name, source] : {
+                std::pair{"object/fields_100k",
+                        "class Vec { init(x, y) { this.x = x; this.y = y; } }\n"
+                        "var v = Vec(0, 1);\n"
+                        "for (var i = 0; i < 100000; i = i + 1) {\n"
+                        "        v.x = v.x + v.y;\n"
+                        "        v.y = v.x - v.y;\n"
+                        "}\n"},
+                std::pair{"object/methods_100k",
+                        "class Counter {\n"
+                        "        init() { this.n = 0; }\n"
+                        "        add(k) { this.n = this.n + k; }\n"
+                        "}\n"
+                        "var c = Counter();\n"
+                        "for (var i = 0; i < 100000; i = i + 1) c.add(i);\n"},
+                std::pair{"object/polymorphic_100k",
+                        "class A { init() { this.v = 1; } }\n"
+                        "class B { init() { this.u = 0; this.v = 2; } }\n"
+                        "class C { init() { this.v = 3; this.u = 0; } }\n"
+                        "var xs = {0: A(), 1: B(), 2: C()};\n"
+                        "var sum = 0;\n"
+                        "for (var i = 0; i < 100000; i = i + 1) {\n"
+                        "        sum = sum + xs[i - floor(i / 3) * 3].v;\n"
+                        "}\n"},
+        }) {
+                scanner::Scanner sc(source);
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                suite.run(name, 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+        }
+
+        // calls through the global name, and through an upvalue
+        for (auto [name, source] : {
+                std::pair{"interpreter/fib_20",
+                        "fun fib(n) {\n"
+                        "        if (n < 2) return n;\n"
+                        "        return fib(n - 1) + fib(n - 2);\n"
+                        "}\n"
+                        "fib(20);\n"},
+                std::pair{"interpreter/counter_100k",
+                        "fun counter() {\n"
+                        "        var n = 0;\n"
+                        "        fun next() { n = n + 1; return n; }\n"
+                        "        return next;\n"
+                        "}\n"
+                        "var c = counter();\n"
+                        "for (var i = 0; i < 100000; i = i + 1) c();\n"},
+        }) {
+                scanner::Scanner sc(source);
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                suite.run(name, 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+        }
+
+        // binary sites quickened to their operands against generic ones,
+        // each run on a fresh tree so the generic one stays generic
+        for (auto [name, source] : {
+                std::pair{"interpreter/arith_1m",
+                        "var x = 0;\n"
+                        "for (var i = 0; i < 1000000; i = i + 1) {\n"
+                        "        x = x * 0.5 + i - 1;\n"
+                        "}\n"},
+                std::pair{"interpreter/concat_100k",
+                        "for (var i = 0; i < 100000; i = i + 1) {\n"
+                        "        var s = \"key\" + \"-\" + \"value\";\n"
+                        "}\n"},
+        }) {
+                for (auto quicken : {true, false}) {
+                        scanner::Scanner sc(source);
+                        auto tokens = sc.scan_tokens();
+                        parser::Parser pr(tokens);
+                        auto statements = pr.parse();
+                        suite.run(std::string(name) + (quicken ? "" : "_generic"), 0, [&] {
+                                interpreter::Interpreter it(out);
+                                it.set_quickening(quicken);
+                                it.interpret(statements);
+                        });
+                }
+        }
+
+        // rings of instances, garbage cycles only a trace frees
+        {
+                scanner::Scanner sc(
+                        "class Node { init(next) { this.next = next; } }\n"
+                        "for (var i = 0; i < 2000; i = i + 1) {\n"
+                        "        var first = Node(nil);\n"
+                        "        var last = first;\n"
+                        "        for (var j = 0; j < 50; j = j + 1) last = Node(last);\n"
+                        "        first.next = last;\n"
+                        "}\n"
+                );
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+                suite.run("gc/rings_100k", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        it.interpret(statements);
+                });
+        }
+
+        // one rule over a table of orders, on column kernels and record
+        // by record
+        {
+                scanner::Scanner sc(
+                        "var total = price * qty;\n"
+                        "var discount = 0;\n"
+                        "if (total > 1000 and member) discount = total * 0.1;\n"
+                        "else if (qty >= 10) discount = 5;\n"
+                        "var result = total - discount;\n"
+                );
+                auto tokens = sc.scan_tokens();
+                parser::Parser pr(tokens);
+                auto statements = pr.parse();
+
+                auto csv = corpus::records(1'000'000);
+                suite.run("batch/read_csv_1m", csv.size(), [&] {
+                        auto t = batch::read_csv(csv);
+                });
+                auto table = batch::read_csv(csv);
+                auto plan = batch::compile(statements, table, "result");
+                if (plan == nullptr) {
+                        std::cerr << "bench: the batch rule has no plan\n";
+                        return 2;
+                }
+                auto small = batch::read_csv(corpus::records(100'000));
+
+                // records per second of the last benchmark, if it ran
+                auto rate = [&](const std::string& name, size_t records) {
+                        if (suite.enabled(name)) {
+                                std::cerr << std::format(
+                                        "{:<36} {:>14.0f} records/s\n",
+                                        name, records * 1e9 / suite.all().back().ns_per_iter
+                                );
+                        }
+                };
+                suite.run("batch/rule_1m_columnar", 0, [&] {
+                        auto c = plan->run(table);
+                });
+                rate("batch/rule_1m_columnar", table.rows);
+                suite.run("batch/rule_100k_rows", 0, [&] {
+                        interpreter::Interpreter it(out);
+                        auto c = batch::run_rows(it, statements, small, "result");
+                });
+                rate("batch/rule_100k_rows", small.rows);
+        }
+
+        std::string script = std::format(
+                "var a = array({}, 1.5);\nvar b = a * 2 + a;\nprint sum(b) + dot(a, b);\n", n
+        );
+        scanner::Scanner sc(script);
+        auto tokens = sc.scan_tokens();
+        parser::Parser pr(tokens);
+        auto statements = pr.parse();
+        suite.run("interpreter/array_script", 0, [&] {
+                interpreter::Interpreter it(out);
+                it.interpret(statements);
+        });
+
+        std::cout << suite.json();
+        return 0;
+}
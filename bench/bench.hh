@@ -0,0 +1,92 @@
+#pragma once
+#include "../cpplox.hh"
+
+namespace bench {
+        class Result {
+        public:
+                std::string name;
+                size_t iterations;
+                double ns_per_iter;
+                size_t bytes;
+        };
+
+        // Runs each benchmark in batches until min_time has passed and
+        // keeps the fastest batch average.
+        class Suite {
+                std::vector<Result> results;
+                std::string filter;
+                std::chrono::nanoseconds min_time;
+
+                static fn now() -> std::chrono::steady_clock::time_point {
+                        return std::chrono::steady_clock::now();
+                }
+
+        public:
+                Suite(
+                        std::string f,
+                        std::chrono::nanoseconds t = std::chrono::milliseconds(500)
+                ) : filter(f), min_time(t)
+                {}
+
+                fn enabled(const std::string& name) -> bool {
+                        return filter.empty() || name.find(filter) != std::string::npos;
+                }
+
+                // bytes is the input size per iteration, 0 if not applicable
+                fn run(const std::string& name, size_t bytes, std::function<void()> body) {
+                        if (!enabled(name)) {
+                                return;
+                        }
+
+                        // warm up and size the batch to roughly 1/10 of min_time
+                        auto start = now();
+                        body();
+                        auto once = std::max<int64_t>((now() - start).count(), 1);
+                        size_t batch = std::max<int64_t>(min_time.count() / 10 / once, 1);
+
+                        double best = std::numeric_limits<double>::max();
+                        size_t iterations = 0;
+                        auto deadline = now() + min_time;
+                        do {
+                                auto t = now();
+                                for (size_t i = 0; i < batch; ++i) {
+                                        body();
+                                }
+                                std::chrono::duration<double, std::nano> d = now() - t;
+                                best = std::min(best, d.count() / batch);
+                                iterations += batch;
+                        } while (now() < deadline);
+
+                        results.push_back(Result{name, iterations, best, bytes});
+                        std::cerr << std::format(
+                                "{:<36} {:>14.0f} ns/iter {:>10} iters",
+                                name, best, iterations
+                        );
+                        if (bytes > 0) {
+                                std::cerr << std::format(" {:>9.1f} MB/s", bytes / best * 1e3);
+                        }
+                        std::cerr << std::endl;
+                }
+
+                fn all() const -> const std::vector<Result>& {
+                        return results;
+                }
+
+                fn json() -> std::string {
+                        std::string out = "{\n";
+                        out += std::format("  \"compiler\": \"{}\",\n", __VERSION__);
+                        out += "  \"benchmarks\": [\n";
+                        for (size_t i = 0; i < results.size(); ++i) {
+                                auto& r = results[i];
+                                out += std::format(
+                                        "    {{\"name\": \"{}\", \"iterations\": {}, "
+                                        "\"ns_per_iter\": {:.1f}, \"bytes\": {}}}{}\n",
+                                        r.name, r.iterations, r.ns_per_iter, r.bytes,
+                                        (i + 1 < results.size()) ? "," : ""
+                                );
+                        }
+                        out += "  ]\n}\n";
+                        return out;
+                }
+        };
+}
@@ -0,0 +1,203 @@
+#pragma once
+#include "../cpplox.hh"
+
+// Synthetic Lox sources for the benchmarks. Every generator is
+// deterministic, so results are comparable between releases.
+namespace corpus {
+        namespace {
+                fn nested_expr(std::string& out, size_t depth, size_t seed) {
+                        static const char* ops[] = {" + ", " - ", " * ", " / "};
+                        if (depth == 0) {
+                                out += std::to_string(seed % 97 + 1);
+                                return;
+                        }
+                        out += "(";
+                        out += std::to_string(seed % 13 + 1);
+                        out += ops[seed % 4];
+                        nested_expr(out, depth - 1, seed * 31 + 7);
+                        out += ")";
+                }
+        }
+
+        // lines of parenthesised arithmetic nested depth levels deep
+        fn deep_expressions(size_t lines, size_t depth) -> std::string {
+                std::string out;
+                for (size_t i = 0; i < lines; ++i) {
+                        out += "print ";
+                        nested_expr(out, depth, i);
+                        out += ";\n";
+                }
+                return out;
+        }
+
+        // n global definitions followed by n reads and reassignments
+        fn many_globals(size_t n) -> std::string {
+                std::string out;
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format("var global_{} = {};\n", i, i);
+                }
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format(
+                                "global_{} = global_{} + global_{};\n",
+                                i, (i * 7) % n, (i * 13) % n
+                        );
+                }
+                return out;
+        }
+
+        // count groups of blocks nested depth deep, the innermost
+        // block reads variables from every enclosing level
+        fn nested_blocks(size_t count, size_t depth) -> std::string {
+                std::string out;
+                for (size_t c = 0; c < count; ++c) {
+                        for (size_t d = 0; d < depth; ++d) {
+                                out += std::format("{{ var level_{} = {};\n", d, d);
+                        }
+                        out += "print level_0";
+                        for (size_t d = 1; d < depth; ++d) {
+                                out += std::format(" + level_{}", d);
+                        }
+                        out += ";\n";
+                        out += std::string(depth, '}');
+                        out += "\n";
+                }
+                return out;
+        }
+
+        // string literals and concatenation
+        fn string_heavy(size_t n) -> std::string {
+                std::string out = "var acc = \"\";\n";
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format(
+                                "var s_{} = \"record {} of the report\" + \", status \" + \"ok\";\n",
+                                i % 64, i
+                        );
+                        out += std::format("print s_{} + \" / \" + \"done\";\n", i % 64);
+                }
+                return out;
+        }
+
+        // arithmetic on number literals and variables
+        fn number_heavy(size_t n) -> std::string {
+                std::string out = "var x = 1.5;\nvar y = 2.25;\n";
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format(
+                                "x = (x * {}.5 + y / {}) - {}.125;\n",
+                                i % 7 + 1, i % 11 + 1, i % 5
+                        );
+                        out += "y = -x * 0.5 + y;\n";
+                }
+                out += "print x + y;\n";
+                return out;
+        }
+
+        // n records of an order table as CSV, for the batch mode
+        fn records(size_t n) -> std::string {
+                static const char* regions[] = {"north", "south", "east", "west"};
+                std::string out = "id,price,qty,member,region\n";
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format(
+                                "{},{}.{},{},{},{}\n",
+                                i, i * 7919 % 2000, i % 100, i % 17 + 1,
+                                i % 3 == 0 ? "true" : "false", regions[i % 4]
+                        );
+                }
+                return out;
+        }
+
+        // A library of n functions and n / 4 classes of which the
+        // script only calls every stride-th, as a large module does
+        fn library(size_t n, size_t stride) -> std::string {
+                std::string out;
+                for (size_t i = 0; i < n; ++i) {
+                        out += std::format(
+                                "fun helper_{}(a, b) {{\n"
+                                "        var total = 0;\n"
+                                "        for (var i = 0; i < a; i = i + 1) {{\n"
+                                "                if (i * {} > b) total = total + i; else total = total - 1;\n"
+                                "        }}\n"
+                                "        var label = \"helper\" + \"_{}\";\n"
+                                "        return {{\"total\": total, \"label\": label, \"a\": a}};\n"
+                                "}}\n",
+                                i, i % 7 + 1, i
+                        );
+                        if (i % 4 == 0) {
+                                out += std::format(
+                                        "class Shape_{} {{\n"
+                                        "        init(w, h) {{ this.w = w; this.h = h; }}\n"
+                                        "        area() {{ return this.w * this.h; }}\n"
+                                        "        scaled(k) {{ return Shape_{}(this.w * k, this.h * k); }}\n"
+                                        "}}\n",
+                                        i, i
+                                );
+                        }
+                }
+                out += "var sum = 0;\n";
+                for (size_t i = 0; i < n; i += stride) {
+                        out += std::format("sum = sum + helper_{}(3, {})[\"total\"];\n", i, i);
+                        if (i % 4 == 0) {
+                                out += std::format("sum = sum + Shape_{}(2, 3).scaled(2).area();\n", i);
+                        }
+                }
+                return out;
+        }
+
+        // Programs nested depth deep in one way each, past what the native
+        // stack would hold. The generators loop, they do not recurse.
+        fn deep_nesting(size_t depth) -> std::vector<std::pair<std::string, std::string>> {
+                std::string parens = "print ";
+                for (size_t i = 0; i < depth; ++i) {
+                        parens += "(1 + ";
+                }
+                parens += "1" + std::string(depth, ')') + ";\n";
+
+                std::string chain = "print 1";
+                for (size_t i = 0; i < depth; ++i) {
+                        chain += " + 1";
+                }
+                chain += ";\n";
+
+                std::string unary = "print ";
+                for (size_t i = 0; i < depth; ++i) {
+                        unary += "- ";
+                }
+                unary += "1;\n";
+
+                std::string blocks;
+                for (size_t i = 0; i < depth; ++i) {
+                        blocks += "{ ";
+                }
+                blocks += "print \"bottom\"; " + std::string(depth, '}') + "\n";
+
+                std::string ifs;
+                for (size_t i = 0; i < depth; ++i) {
+                        ifs += "if (true) ";
+                }
+                ifs += "print \"bottom\";\n";
+
+                std::string assignment = "var a;\n";
+                for (size_t i = 0; i < depth; ++i) {
+                        assignment += "a = ";
+                }
+                assignment += "1;\nprint a;\n";
+
+                std::string recursion = std::format(
+                        "fun down(n) {{\n"
+                        "        if (n == 0) return 0;\n"
+                        "        return 1 + down(n - 1);\n"
+                        "}}\n"
+                        "print down({});\n",
+                        depth
+                );
+
+                return {
+                        {"deep_parens",     parens},
+                        {"long_chain",      chain},
+                        {"deep_unary",      unary},
+                        {"deep_blocks",     blocks},
+                        {"deep_ifs",        ifs},
+                        {"deep_assignment", assignment},
+                        {"deep_recursion",  recursion},
+                };
+        }
+}
@@ -0,0 +1,60 @@
+// Executions per second of a small program compiled once and run through
+// the embedding API, against compiling it every time. Links with
+// libcpplox.a and uses lib/lox.hh only. Human readable results go to
+// stderr, JSON to stdout.
+//
+//   embed [filter]        runs benchmarks whose name contains filter
+
+#include "../cpplox.hh"
+#include "../lib/lox.hh"
+#include "bench.hh"
+
+// discards everything, only the runs are measured
+class NullOutput : public lox::Output {
+public:
+        fn write(const char*, size_t) -> void {}
+};
+
+fn main(int argc, char* argv[]) -> int {
+        const std::string source =
+                "fun fib(n) {\n"
+                "        if (n < 2) return n;\n"
+                "        return fib(n - 1) + fib(n - 2);\n"
+                "}\n"
+                "class Order {\n"
+                "        init(qty, price) { this.qty = qty; this.price = price; }\n"
+                "        total() { return this.qty * this.price; }\n"
+                "}\n"
+                "var total = 0;\n"
+                "for (var i = 0; i < 20; i = i + 1) {\n"
+                "        total = total + Order(i, price).total();\n"
+                "}\n"
+                "var label = name + \": \" + \"done\";\n"
+                "print fib(10);\n";
+        const lox::Globals globals = {{"price", 2.5}, {"name", std::string("order")}};
+
+        bench::Suite suite(argc > 1 ? argv[1] : "");
+        NullOutput null;
+        auto program = lox::Program::compile(source);
+
+        suite.run("embed/compile_and_run", 0, [&] {
+                lox::Program::compile(source).run(&null, globals);
+        });
+        suite.run("embed/run_fresh_state", 0, [&] {
+                program.run(&null, globals);
+        });
+        lox::State state(&null);
+        suite.run("embed/run_reset_state", 0, [&] {
+                state.reset();
+                for (auto& [name, value] : globals) {
+                        state.set(name, value);
+                }
+                program.run(state);
+        });
+
+        for (auto& r : suite.all()) {
+                std::cerr << std::format("{:<36} {:>14.0f} executions/s\n", r.name, 1e9 / r.ns_per_iter);
+        }
+        std::cout << suite.json();
+        return 0;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include "cpplox.hh"
+#include "native.hh"
+#include "array.hh"
+#include "hashmap.hh"
+#include "simd.hh"
+#include "output.hh"
+#include "utils.hh"
+
+// The standard host functions, bound as globals in every interpreter.
+namespace builtins {
+        namespace {
+                fn key_hash(native::Call& call, std::any& key) -> uint64_t {
+                        uint64_t hash = 0;
+                        if (!hashmap::Key::hash_of(key, hash)) {
+                                throw call.error("Map keys must be numbers, strings or booleans.");
+                        }
+                        return hash;
+                }
+
+                fn length(native::Call& call, std::any& v) -> double {
+                        if (auto a = std::any_cast<array::array_ptr>(&v)) {
+                                return (*a)->size();
+                        }
+                        if (auto m = std::any_cast<hashmap::map_ptr>(&v)) {
+                                return (*m)->size();
+                        }
+                        if (auto s = std::any_cast<std::string>(&v)) {
+                                // code points
+                                size_t n = 0;
+                                for (size_t pos = 0; pos < s->size(); ++n) {
+                                        utils::decode_utf8(*s, pos);
+                                }
+                                return n;
+                        }
+                        throw call.error("Argument 1 of 'len' must be an array, a map or a string.");
+                }
+
+                fn install(native::Registry& r) {
+                        using native::Function;
+                        using native::Call;
+                        using native::argument;
+
+                        // ---------------- time and math ----------------
+
+                        r.define("clock", [] {
+                                return std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now().time_since_epoch()
+                                ).count();
+                        });
+                        r.define("sqrt",  [](double x) { return std::sqrt(x); });
+                        r.define("abs",   [](double x) { return std::fabs(x); });
+                        r.define("floor", [](double x) { return std::floor(x); });
+                        r.define("ceil",  [](double x) { return std::ceil(x); });
+                        r.define("exp",   [](double x) { return std::exp(x); });
+                        r.define("log",   [](double x) { return std::log(x); });
+                        r.define("sin",   [](double x) { return std::sin(x); });
+                        r.define("cos",   [](double x) { return std::cos(x); });
+                        r.define("pow",   [](double x, double y) { return std::pow(x, y); });
+
+                        // ------------------- strings -------------------
+
+                        r.define_variadic("str", 1, 1, [](const Function&, Call& call) -> std::any {
+                                auto& v = call.args[0];
+                                if (!v.has_value()) {
+                                        return std::string("nil");
+                                }
+                                if (auto d = std::any_cast<double>(&v)) {
+                                        char buf[output::number_size];
+                                        return std::string(buf, output::format_number(buf, *d));
+                                }
+                                if (auto b = std::any_cast<bool>(&v)) {
+                                        return std::string(*b ? "true" : "false");
+                                }
+                                if (auto s = std::any_cast<std::string>(&v)) {
+                                        return *s;
+                                }
+                                throw call.error("Argument 1 of 'str' must be a number, a string, a boolean or nil.");
+                        });
+                        // nil if s is not a number
+                        r.define("num", [](const std::string& s) -> std::any {
+                                double d;
+                                auto res = std::from_chars(s.data(), s.data() + s.size(), d);
+                                if (res.ec != std::errc() || res.ptr != s.data() + s.size()) {
+                                        return {};
+                                }
+                                return d;
+                        });
+                        r.define_variadic("len", 1, 1, [](const Function&, Call& call) -> std::any {
+                                return length(call, call.args[0]);
+                        });
+
+                        // ------------------- arrays --------------------
+
+                        r.define_variadic("array", 1, 2, [](const Function& self, Call& call) -> std::any {
+                                auto n = argument<double>(self, call, 0);
+                                if (n < 0 || n != static_cast<size_t>(n)) {
+                                        throw call.error("Array length must be a non-negative integer.");
+                                }
+                                double fill = call.count == 2 ? argument<double>(self, call, 1) : 0.0;
+                                return array::make(static_cast<size_t>(n), fill);
+                        });
+                        r.define("sum", [](array::Array& a) {
+                                return simd::reduce(simd::SUM, a.data.data(), a.size());
+                        });
+                        r.define_variadic("min", 1, 1, [](const Function& self, Call& call) -> std::any {
+                                auto& a = argument<array::Array&>(self, call, 0);
+                                if (a.size() == 0) {
+                                        throw call.error("Array is empty.");
+                                }
+                                return simd::reduce(simd::MIN, a.data.data(), a.size());
+                        });
+                        r.define_variadic("max", 1, 1, [](const Function& self, Call& call) -> std::any {
+                                auto& a = argument<array::Array&>(self, call, 0);
+                                if (a.size() == 0) {
+                                        throw call.error("Array is empty.");
+                                }
+                                return simd::reduce(simd::MAX, a.data.data(), a.size());
+                        });
+                        r.define_variadic("dot", 2, 2, [](const Function& self, Call& call) -> std::any {
+                                auto& a = argument<array::Array&>(self, call, 0);
+                                auto& b = argument<array::Array&>(self, call, 1);
+                                if (a.size() != b.size()) {
+                                        throw call.error("Array lengths differ.");
+                                }
+                                return simd::dot(a.data.data(), b.data.data(), a.size());
+                        });
+
+                        // -------------------- maps ---------------------
+
+                        r.define_variadic("has", 2, 2, [](const Function& self, Call& call) -> std::any {
+                                auto& m = argument<hashmap::Map&>(self, call, 0);
+                                auto& k = call.args[1];
+                                return m.find(k, key_hash(call, k)) != nullptr;
+                        });
+                        // nil or the third argument if the key is missing
+                        r.define_variadic("get", 2, 3, [](const Function& self, Call& call) -> std::any {
+                                auto& m = argument<hashmap::Map&>(self, call, 0);
+                                auto& k = call.args[1];
+                                if (auto v = m.find(k, key_hash(call, k))) {
+                                        return *v;
+                                }
+                                return call.count == 3 ? call.args[2] : std::any();
+                        });
+                        r.define_variadic("delete", 2, 2, [](const Function& self, Call& call) -> std::any {
+                                auto& m = argument<hashmap::Map&>(self, call, 0);
+                                key_hash(call, call.args[1]);
+                                hashmap::Key key;
+                                hashmap::Key::from(call.args[1], key);
+                                return m.erase(key);
+                        });
+                        // keys(m)[0] .. keys(m)[len(m) - 1]
+                        r.define("keys", [](hashmap::Map& m) {
+                                auto keys = hashmap::make();
+                                m.each([&](const hashmap::Key& key, std::any&) {
+                                        hashmap::Key index;
+                                        hashmap::Key::from(static_cast<double>(keys->size()), index);
+                                        keys->set(std::move(index), key.to_any());
+                                });
+                                return keys;
+                        });
+                }
+        }
+
+        fn registry() -> native::Registry& {
+                static native::Registry r = [] {
+                        native::Registry r;
+                        install(r);
+                        return r;
+                }();
+                return r;
+        }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "cpplox.hh"
+
+namespace function {
+        class Closure;
+}
+
+namespace object {
+        class Shape;
+}
+
+// Inline cache of one property site in the ast. An entry maps the shape of
+// an instance seen at the site to where the property was found, so a hit
+// costs a compare per entry instead of a name lookup. Shapes are keyed by
+// id, ids are never reused, so an entry can not outlive its meaning; and a
+// matching instance keeps its class alive, with its shapes and methods. A
+// site stays monomorphic with one shape and holds up to `ways`, newer
+// shapes then replace older ones in turn.
+namespace cache {
+        class Entry {
+        public:
+                // 0 for an empty entry
+                uint64_t shape = 0;
+                // field slot, -1 for a method
+                int32_t slot = -1;
+                function::Closure* method = nullptr;
+                // set sites adding a field: the shape it leads to
+                object::Shape* to = nullptr;
+        };
+
+        class Cache {
+        public:
+                static constexpr size_t ways = 4;
+
+                std::array<Entry, ways> entries;
+                // entry replaced by the next miss
+                size_t next = 0;
+
+                fn find(uint64_t shape) -> Entry* {
+                        for (auto& e : entries) {
+                                if (e.shape == shape) {
+                                        return &e;
+                                }
+                        }
+                        return nullptr;
+                }
+
+                fn add(Entry e) -> Entry& {
+                        auto& slot = entries[next];
+                        next = (next + 1) % ways;
+                        slot = std::move(e);
+                        return slot;
+                }
+        };
+}
@@ -6,31 +6,168 @@
 #include "ast_printer.hh"
 #include "parser.hh"
 #include "interpreter.hh"
+#include "module.hh"
+#include "output.hh"
+#include "stats.hh"
+#include "profiler.hh"
+#include "alloc.hh"
+#include "gc.hh"
+#include "limits.hh"
+#include "debugger.hh"
+#include "batch.hh"
+#include "trace.hh"
 
 class Lox {
-        fn run(std::wstring& source) {
-                // scan tokens
-                scanner::Scanner sc(source);
-                auto tokens = sc.scan_tokens();
+        module::Loader loader;
+        output::Writer& out = output::stdout_writer();
+        bool show_stats = false;
+        bool show_allocs = false;
+        bool show_gc = false;
+        // --no-quicken, binary sites stay generic
+        bool quicken = true;
+        // --max-*, a breach is a runtime error
+        limits::Limits quota;
+        // --debug[=socket], commands on stdin or the socket
+        bool debugging = false;
+        std::string debug_socket;
+        std::unique_ptr<debugger::Debugger> debug;
+        // --profile, collapsed stacks go to profile_path
+        std::unique_ptr<profiler::Profiler> prof;
+        std::string profile_path = "cpplox.folded";
+        // --trace, the last statements go to trace_path on failure
+        bool tracing = false;
+        std::unique_ptr<trace::Tracer> tracer;
+        std::string trace_path = "cpplox.trace";
+        // the REPL's interpreter, its globals live across inputs
+        std::unique_ptr<interpreter::Interpreter> session;
+        // :time, latency of each REPL input
+        bool timing = false;
+        // --batch=table, the script runs once per record of it
+        std::string batch_input;
+        // --batch-out=file, CSV or binary by extension; stdout if empty
+        std::string batch_output;
+        // --batch-result=name, the global of a record's result
+        std::string batch_result = "result";
+        // --no-columnar, record by record even if a plan fits
+        bool columnar = true;
 
-                // parse ast from tokens
-                parser::Parser pr(tokens);
-                auto statements = pr.parse();
-                std::wcout << "parsing" << std::endl;
+        fn interpret(
+                interpreter::Interpreter& it,
+                std::vector<std::shared_ptr<stmt::Stmt>>& statements,
+                const std::string* file
+        ) {
+                stats::Phase t(stats::INTERPRET);
+                if (prof != nullptr) {
+                        it.set_profiler(prof.get());
+                        prof->enter(file, 0);
+                        prof->start();
+                }
+                it.interpret(statements);
+                if (prof != nullptr) {
+                        prof->stop();
+                        prof->leave();
+                }
+        }
+
+        fn execute(module::Module& root) {
+                auto& statements = root.statements;
+                auto file = &root.path;
+                out.write(std::string_view("parsing"));
+                out.newline();
                 // stop on syntax error
                 if (errors::hadError) {
                         return;
                 }
 
                 // interpret
-                std::wcout << "\n-----result-----" << std::endl;
-                interpreter::Interpreter it;
-                it.interpret(statements);
+                out.newline();
+                out.write(std::string_view("-----result-----"));
+                out.newline();
+                interpreter::Interpreter it(out);
+                it.set_root(&root);
+                it.set_quickening(quicken);
+                it.set_limits(quota);
+                if (debug != nullptr) {
+                        it.set_debugger(debug.get());
+                }
+                it.set_tracer(tracer.get());
+                interpret(it, statements, file);
+        }
+
+        // brackets left open by the tokens, the input goes on if above 0
+        static fn open_brackets(const std::vector<token::Token>& tokens) -> int {
+                int depth = 0;
+                for (auto& t : tokens) {
+                        switch (t.type) {
+                        case token::LEFT_PAREN:
+                        case token::LEFT_BRACE:
+                        case token::LEFT_BRACKET:
+                                depth++;
+                                break;
+                        case token::RIGHT_PAREN:
+                        case token::RIGHT_BRACE:
+                        case token::RIGHT_BRACKET:
+                                depth--;
+                                break;
+                        default:
+                                break;
+                        }
+                }
+                return depth;
+        }
+
+        // one REPL input, scanned and parsed on its own and run by the
+        // session; false if it leaves brackets open and needs more lines
+        fn run(const std::string& source) -> bool {
+                auto start = stats::wall_now();
+
+                // scan tokens
+                std::vector<token::Token> tokens;
+                {
+                        stats::Phase t(stats::SCAN);
+                        scanner::Scanner sc(source);
+                        tokens = sc.scan_tokens();
+                }
+                if (!errors::hadError && open_brackets(tokens) > 0) {
+                        return false;
+                }
+                auto scanned = stats::wall_now();
+
+                // parse ast from tokens
+                std::vector<std::shared_ptr<stmt::Stmt>> statements;
+                {
+                        stats::Phase t(stats::PARSE);
+                        parser::Parser pr(std::move(tokens));
+                        statements = pr.parse();
+                }
+
+                // load imported modules
+                loader.link(statements, std::filesystem::current_path());
+                loader.wait();
+                auto parsed = stats::wall_now();
+
+                // stop on syntax error
+                if (!errors::hadError) {
+                        interpret(*session, statements, nullptr);
+                }
+
+                if (timing) {
+                        auto ms = [](int64_t ns) { return ns / 1e6; };
+                        out.flush();
+                        out.write(std::format(
+                                "[scan {:.3f} ms, parse {:.3f} ms, run {:.3f} ms]",
+                                ms(scanned - start), ms(parsed - scanned),
+                                ms(stats::wall_now() - parsed)
+                        ));
+                        out.newline();
+                }
+                return true;
         }
 
-        fn run_file(std::wstring& path) -> int {
-                auto code = utils::get_file(path);
-                run(code);
+        fn run_file(const std::string& path) -> int {
+                // the script and its imports are parsed ahead of execution
+                auto root = loader.load(path);
+                execute(*root);
                 if (errors::hadError) {
                         return 1;
                 }
@@ -40,33 +177,237 @@ class Lox {
                 return 0;
         }
 
+        // --batch: the script over every record of the input, results
+        // written as a column, records per second on stderr
+        fn run_batch(const std::string& path) -> int {
+                auto root = loader.load(path);
+                if (errors::hadError) {
+                        return 1;
+                }
+                batch::Table input;
+                try {
+                        input = batch::load(batch_input);
+                } catch (std::runtime_error& err) {
+                        std::cerr << "cpplox: " << err.what() << "\n";
+                        return 1;
+                }
+
+                interpreter::Interpreter it(out);
+                it.set_root(root);
+                it.set_quickening(quicken);
+                it.set_limits(quota);
+                if (debug != nullptr) {
+                        it.set_debugger(debug.get());
+                }
+                it.set_tracer(tracer.get());
+
+                auto start = stats::wall_now();
+                // a debugger stops at statements, which a plan has not
+                auto plan = columnar && debug == nullptr
+                        ? batch::compile(root->statements, input, batch_result)
+                        : nullptr;
+                batch::Table result;
+                result.rows = input.rows;
+                try {
+                        stats::Phase t(stats::INTERPRET);
+                        result.columns.push_back(plan != nullptr
+                                ? plan->run(input)
+                                : batch::run_rows(it, root->statements, input, batch_result));
+                } catch (errors::runtime_panic& err) {
+                        out.flush();
+                        it.trace_error(err);
+                        errors::runtime_err(err);
+                        return 2;
+                }
+                auto ns = std::max<int64_t>(stats::wall_now() - start, 1);
+
+                bool binary = batch_output.ends_with(".loxc");
+                if (batch_output.empty()) {
+                        batch::write_csv(out, result);
+                } else {
+                        output::FileSink sink(batch_output);
+                        output::Writer w(sink);
+                        binary ? batch::write_binary(w, result) : batch::write_csv(w, result);
+                }
+                out.flush();
+                std::cerr << std::format(
+                        "batch: {} records in {:.3f} ms, {:.0f} records/s, {}\n",
+                        input.rows, ns / 1e6, input.rows * 1e9 / ns,
+                        plan != nullptr ? "columnar" : "record by record"
+                );
+                return 0;
+        }
+
+        // reads inputs until end of file, an input goes on over the
+        // next lines while it leaves brackets open
         fn run_prompt() {
-                std::wstring line;
+                session = std::make_unique<interpreter::Interpreter>(out);
+                session->set_quickening(quicken);
+                session->set_limits(quota);
+                if (debug != nullptr) {
+                        session->set_debugger(debug.get());
+                }
+                session->set_tracer(tracer.get());
+
+                std::string source;
+                std::string line;
                 while (true) {
-                        std::wcout << ">>> ";
-                        std::getline(std::wcin, line);
-                        if (line == L"") {
+                        out.write(std::string_view(source.empty() ? ">>> " : "... "));
+                        out.flush();
+                        if (!std::getline(std::cin, line)) {
                                 break;
                         }
-                        run(line);
+                        if (source.empty()) {
+                                if (line.empty()) {
+                                        continue;
+                                }
+                                if (line == ":time") {
+                                        timing = !timing;
+                                        out.write(std::string_view(timing ? "timing on" : "timing off"));
+                                        out.newline();
+                                        continue;
+                                }
+                        }
+
+                        source.append(line).push_back('\n');
+                        if (!run(source)) {
+                                continue;
+                        }
+                        source.clear();
                         errors::hadError = false;
                         errors::had_runtime_error = false;
-                        std::wcout << std::endl;
                 }
-                return;
+                out.newline();
+        }
+
+        // the number after the '=' of arg, digits only: no sign, no
+        // trailing characters and in range of v
+        template<class T>
+        static fn option_value(const std::string& arg, T& v) -> bool {
+                auto s = std::string_view(arg).substr(arg.find('=') + 1);
+                if (s.empty() || !std::isdigit(static_cast<unsigned char>(s[0]))) {
+                        return false;
+                }
+                auto end = s.data() + s.size();
+                auto [p, ec] = std::from_chars(s.data(), end, v);
+                return ec == std::errc() && p == end;
+        }
+
+        // as option_value, a count of KiB in bytes
+        static fn option_kib(const std::string& arg, uint64_t& v) -> bool {
+                if (!option_value(arg, v) || v > limits::none >> 10) {
+                        return false;
+                }
+                v <<= 10;
+                return true;
+        }
+
+        static fn bad_value(const std::string& arg) -> bool {
+                std::cerr << "cpplox: bad value for '" << arg << "'\n";
+                return false;
+        }
+
+        // removes --options from args
+        fn parse_options(std::vector<std::string>& args) -> bool {
+                std::vector<std::string> rest;
+                for (auto& arg : args) {
+                        if (arg == "--stats") {
+                                show_stats = true;
+                        } else if (arg == "--alloc-report") {
+                                show_allocs = true;
+                        } else if (arg == "--no-quicken") {
+                                quicken = false;
+                        } else if (arg == "--eager-parse") {
+                                parser::defer = false;
+                        } else if (arg == "--gc-stats") {
+                                show_gc = true;
+                        } else if (arg.starts_with("--gc-nursery=")) {
+                                // KiB allocated between collections
+                                uint64_t bytes = 0;
+                                if (!option_kib(arg, bytes) || bytes == 0) {
+                                        return bad_value(arg);
+                                }
+                                gc::heap().policy.nursery = bytes;
+                        } else if (arg.starts_with("--gc-growth=")) {
+                                // 1 or less collects on every allocation
+                                double growth = 0;
+                                if (!option_value(arg, growth) || growth <= 1) {
+                                        return bad_value(arg);
+                                }
+                                gc::heap().policy.growth = growth;
+                        } else if (arg.starts_with("--max-heap=")) {
+                                // KiB of live objects and their payloads
+                                if (!option_kib(arg, quota.heap_bytes)) {
+                                        return bad_value(arg);
+                                }
+                                gc::heap().set_quota(quota.heap_bytes);
+                        } else if (arg.starts_with("--max-depth=")) {
+                                if (!option_value(arg, quota.depth)) {
+                                        return bad_value(arg);
+                                }
+                        } else if (arg.starts_with("--max-string=")) {
+                                if (!option_value(arg, quota.string_length)) {
+                                        return bad_value(arg);
+                                }
+                        } else if (arg.starts_with("--max-steps=")) {
+                                if (!option_value(arg, quota.steps)) {
+                                        return bad_value(arg);
+                                }
+                        } else if (arg.starts_with("--max-stack=")) {
+                                // KiB of stack segments, 256 MiB by default
+                                if (!option_kib(arg, quota.stack_bytes)) {
+                                        return bad_value(arg);
+                                }
+                        } else if (arg.starts_with("--max-time=")) {
+                                // milliseconds of wall clock
+                                if (!option_value(arg, quota.time_ms)) {
+                                        return bad_value(arg);
+                                }
+                        } else if (arg.starts_with("--batch=")) {
+                                batch_input = arg.substr(8);
+                        } else if (arg.starts_with("--batch-out=")) {
+                                batch_output = arg.substr(12);
+                        } else if (arg.starts_with("--batch-result=")) {
+                                batch_result = arg.substr(15);
+                        } else if (arg == "--no-columnar") {
+                                columnar = false;
+                        } else if (arg == "--debug" || arg.starts_with("--debug=")) {
+                                debugging = true;
+                                if (arg.size() > 8) {
+                                        debug_socket = arg.substr(8);
+                                }
+                        } else if (arg == "--profile" || arg.starts_with("--profile=")) {
+                                prof = std::make_unique<profiler::Profiler>();
+                                if (arg.size() > 10) {
+                                        profile_path = arg.substr(10);
+                                }
+                        } else if (arg == "--trace" || arg.starts_with("--trace=")) {
+                                tracing = true;
+                                if (arg.size() > 8) {
+                                        trace_path = arg.substr(8);
+                                }
+                        } else if (arg.starts_with("--")) {
+                                std::cerr << "cpplox: unknown option '" << arg << "'\n";
+                                return false;
+                        } else {
+                                rest.push_back(arg);
+                        }
+                }
+                args = rest;
+                return true;
         }
 
 public:
-        fn main(std::vector<std::wstring>& args) -> int {
+        fn main(std::vector<std::string>& args) -> int {
                 //using expr_ptr = std::shared_ptr<ast::Expr>;
 
                 //std::shared_ptr<ast::Expr> expr(
                 //        new ast::Binary(
                 //                expr_ptr(new ast::Unary(
-                //                        token::Token(token::MINUS, L"-", std::any(), 1),
+                //                        token::Token(token::MINUS, "-", std::any(), 1),
                 //                        expr_ptr(new ast::Literal(1234))
                 //                )),
-                //                token::Token(token::STAR, L"*", std::any(), 1),
+                //                token::Token(token::STAR, "*", std::any(), 1),
                 //                expr_ptr(new ast::Grouping(
                 //                        expr_ptr(new ast::Literal(45.67))
                 //                ))
@@ -74,27 +415,77 @@ public:
                 //);
 
                 //std::shared_ptr<ast_printer::AstPrinter> p(new ast_printer::AstPrinter);
-                //std::wcout << p->print(expr) << std::endl;
+                //std::cout << p->print(expr) << std::endl;
 
-                if (args.size() > 2) {
-                        std::cerr << "Usage: cpplox [script]\n";
+                if (!parse_options(args) || args.size() > 2) {
+                        std::cerr << "Usage: cpplox [--stats] [--alloc-report] [--gc-stats] [--gc-nursery=KiB]\n"
+                                "              [--gc-growth=factor] [--no-quicken] [--eager-parse]\n"
+                                "              [--profile[=file]] [--max-heap=KiB] [--max-depth=n]\n"
+                                "              [--max-string=bytes] [--max-steps=n] [--max-time=ms]\n"
+                                "              [--max-stack=KiB] [--debug[=socket]] [--trace[=file]]\n"
+                                "              [--batch=table [--batch-out=file] [--batch-result=name]\n"
+                                "              [--no-columnar]] [script]\n";
                         return 1;
+                }
+
+                if (debugging) {
+                        if (!debug_socket.empty()) {
+                                int conn = debugger::listen(debug_socket);
+                                debug = std::make_unique<debugger::Debugger>(conn, conn);
+                        } else if (args.size() == 2) {
+                                debug = std::make_unique<debugger::Debugger>(STDIN_FILENO, STDERR_FILENO);
+                        } else {
+                                // the prompt reads stdin itself
+                                std::cerr << "cpplox: --debug without a socket needs a script\n";
+                                return 1;
+                        }
+                }
+
+                if (tracing) {
+                        tracer = std::make_unique<trace::Tracer>(trace_path);
+                        tracer->start();
+                }
+
+                if (!batch_input.empty() && args.size() != 2) {
+                        std::cerr << "cpplox: --batch needs a script\n";
+                        return 1;
+                }
+
+                int status = 0;
+                if (!batch_input.empty()) {
+                        status = run_batch(args[1]);
                 } else if (args.size() == 2) {
-                        return run_file(args[1]);
+                        status = run_file(args[1]);
                 } else {
                         run_prompt();
                 }
 
-                return 0;
+                if (show_stats) {
+                        out.flush();
+                        stats::report(std::cerr);
+                }
+                if (show_allocs) {
+                        out.flush();
+                        alloc::report(std::cerr);
+                }
+                if (show_gc) {
+                        out.flush();
+                        gc::heap().report(std::cerr);
+                }
+                if (prof != nullptr) {
+                        out.flush();
+                        prof->report_lines(std::cerr);
+                        std::ofstream folded(profile_path);
+                        prof->report_folded(folded);
+                }
+                return status;
         }
 };
 
 fn main(int argc, char* argv[]) -> int {
-        std::setlocale(LC_ALL, "");
-        std::locale::global(std::locale(""));
-        std::vector<std::wstring> args(argc);
+        std::vector<std::string> args(argc);
         for (int i = 0; i < argc; ++i) {
-                args[i] = utils::to_wstring(argv[i]);
+                args[i] = argv[i];
         }
 
         Lox lox;
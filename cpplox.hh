@@ -8,22 +8,50 @@
 #include <format>
 #include <string>
 #include <cstring>
-#include <cwchar>
 #include <cstdlib>
 #include <cstdarg>
 #include <cctype>
-#include <cwctype>
-#include <clocale>
-#include <locale>
 #include <functional>
-#include <codecvt>
+#include <numeric>
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <any>
 #include <initializer_list>
 #include <variant>
+#include <optional>
 #include <exception>
 #include <stdexcept>
+#include <filesystem>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <chrono>
+#include <limits>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctime>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <csignal>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <map>
+#include <algorithm>
+#include <bit>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <utility>
 
 #define fn auto
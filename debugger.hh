@@ -0,0 +1,315 @@
+#pragma once
+#include "cpplox.hh"
+#include "environment.hh"
+#include "function.hh"
+#include "native.hh"
+
+// Line debugger of --debug. The interpreter looks at its step budget
+// before every statement, see limits.hh; while a debugger is attached the
+// budget is due on every step and asks at() whether to stop there. A run
+// without one executes the very same instructions as before.
+//
+// Commands come one per line from stdin or a connection on a Unix
+// socket, replies go to stderr or back on the connection:
+//
+//   break [file:]line    b   stops before the statements of a line
+//   delete [file:]line   d   removes a breakpoint
+//   continue             c   runs to the next breakpoint
+//   step                 s   stops before the next statement
+//   next                 n   the next one outside of calls made here
+//   finish               f   the next one of the caller
+//   where                w   file, line and call depth
+//   env                  e   the environment chain, innermost first
+//   print name           p   a variable as the statement sees it
+//   quit                 q   ends the program
+namespace debugger {
+        // the statement about to run
+        class Stop {
+        public:
+                // module path, nullptr for interactive input
+                const std::string* file;
+                int line;
+                uint64_t depth;
+                environment::Environment* env;
+                // running closure, nullptr in top-level code
+                function::closure_ptr closure;
+        };
+
+        class Breakpoint {
+        public:
+                // empty for every file, otherwise a suffix of the path
+                std::string file;
+                int line;
+        };
+
+        // accepts the one connection of a debugging session on path
+        fn listen(const std::string& path) -> int {
+                sockaddr_un addr = {};
+                addr.sun_family = AF_UNIX;
+                if (path.size() >= sizeof(addr.sun_path)) {
+                        throw std::runtime_error(std::format("debugger: socket path '{}' is too long", path));
+                }
+                std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+                int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                ::unlink(path.c_str());
+                if (server < 0
+                        || ::bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+                        || ::listen(server, 1) < 0) {
+                        throw std::runtime_error(std::format("debugger: cannot listen on '{}'", path));
+                }
+                std::cerr << std::format("debugger: waiting on {}\n", path);
+                int conn = ::accept(server, nullptr, nullptr);
+                ::close(server);
+                ::unlink(path.c_str());
+                if (conn < 0) {
+                        throw std::runtime_error(std::format("debugger: accept on '{}' failed", path));
+                }
+                return conn;
+        }
+
+        class Debugger {
+                enum mode {
+                        RUN,
+                        STEP,
+                        NEXT,
+                        FINISH,
+                };
+
+                int in;
+                int out;
+                std::string pending;
+                bool closed = false;
+
+                mode m;
+                // call depth next and finish were given at
+                uint64_t from = 0;
+                std::vector<Breakpoint> breakpoints;
+                // lines with a breakpoint in any file
+                std::vector<bool> lines;
+
+                fn reply(std::string_view s) {
+                        while (!s.empty()) {
+                                auto n = ::write(out, s.data(), s.size());
+                                if (n <= 0) {
+                                        return;
+                                }
+                                s.remove_prefix(n);
+                        }
+                }
+
+                // false once the input is closed
+                fn read_line(std::string& line) -> bool {
+                        while (true) {
+                                if (auto nl = pending.find('\n'); nl != std::string::npos) {
+                                        line = pending.substr(0, nl);
+                                        pending.erase(0, nl + 1);
+                                        return true;
+                                }
+                                char buf[256];
+                                auto n = ::read(in, buf, sizeof(buf));
+                                if (n <= 0) {
+                                        closed = true;
+                                        return false;
+                                }
+                                pending.append(buf, n);
+                        }
+                }
+
+                static fn name_of(const std::string* file) -> std::string_view {
+                        return file != nullptr ? std::string_view(*file) : "<stdin>";
+                }
+
+                fn breaks(const Stop& at) -> bool {
+                        if (size_t(at.line) >= lines.size() || !lines[at.line]) {
+                                return false;
+                        }
+                        for (auto& b : breakpoints) {
+                                if (b.line == at.line
+                                        && (b.file.empty() || name_of(at.file).ends_with(b.file))) {
+                                        return true;
+                                }
+                        }
+                        return false;
+                }
+
+                fn should_stop(const Stop& at) -> bool {
+                        switch (m) {
+                        case STEP:   return true;
+                        case NEXT:   return at.depth <= from || breaks(at);
+                        case FINISH: return at.depth < from || breaks(at);
+                        default:     return breaks(at);
+                        }
+                }
+
+                static fn parse_location(std::string_view arg, Breakpoint& b) -> bool {
+                        auto colon = arg.rfind(':');
+                        auto number = colon == std::string_view::npos ? arg : arg.substr(colon + 1);
+                        auto [p, ec] = std::from_chars(number.data(), number.data() + number.size(), b.line);
+                        if (ec != std::errc() || p != number.data() + number.size() || b.line <= 0) {
+                                return false;
+                        }
+                        b.file = colon == std::string_view::npos ? "" : std::string(arg.substr(0, colon));
+                        return true;
+                }
+
+                fn add_breakpoint(std::string_view arg) {
+                        Breakpoint b;
+                        if (!parse_location(arg, b)) {
+                                reply("usage: break [file:]line\n");
+                                return;
+                        }
+                        if (size_t(b.line) >= lines.size()) {
+                                lines.resize(b.line + 1);
+                        }
+                        lines[b.line] = true;
+                        breakpoints.push_back(b);
+                        reply(std::format("breakpoint {}{}{}\n", b.file, b.file.empty() ? "" : ":", b.line));
+                }
+
+                fn delete_breakpoint(std::string_view arg) {
+                        Breakpoint b;
+                        if (!parse_location(arg, b)) {
+                                reply("usage: delete [file:]line\n");
+                                return;
+                        }
+                        auto removed = std::erase_if(breakpoints, [&](const Breakpoint& o) {
+                                return o.line == b.line && o.file == b.file;
+                        });
+                        if (removed == 0) {
+                                reply("no such breakpoint\n");
+                                return;
+                        }
+                        lines[b.line] = std::any_of(breakpoints.begin(), breakpoints.end(), [&](const Breakpoint& o) {
+                                return o.line == b.line;
+                        });
+                }
+
+                static fn unboxed(std::any& value) -> std::any& {
+                        if (auto cell = std::any_cast<function::cell_ptr>(&value)) {
+                                return (*cell)->value;
+                        }
+                        return value;
+                }
+
+                // names of a scope sorted, natives of the globals left out
+                fn show_scope(environment::Environment* e) {
+                        std::vector<std::pair<std::string, std::string>> names;
+                        e->each([&](const std::string& name, std::any& value) {
+                                auto& v = unboxed(value);
+                                if (!native::is_function(v)) {
+                                        names.emplace_back(name, show(v));
+                                }
+                        });
+                        std::sort(names.begin(), names.end());
+                        for (auto& [name, value] : names) {
+                                reply(std::format("  {} = {}\n", name, value));
+                        }
+                }
+
+                fn show_captures(function::closure_ptr c) {
+                        auto& captures = c->declaration->captures;
+                        for (size_t i = 0; i < c->upvalues.size(); ++i) {
+                                reply(std::format("  {} = {}\n", captures[i].name.lexeme, show(unboxed(c->upvalues[i]))));
+                        }
+                }
+
+                // a closure body reaches what it captured before the globals
+                fn show_env(const Stop& at) {
+                        int n = 0;
+                        for (auto e = at.env; e != nullptr; e = e->parent()) {
+                                if (e->parent() != nullptr) {
+                                        reply(std::format("scope {}\n", n++));
+                                } else {
+                                        if (at.closure != nullptr && !at.closure->upvalues.empty()) {
+                                                reply("captured\n");
+                                                show_captures(at.closure);
+                                        }
+                                        reply("globals\n");
+                                }
+                                show_scope(e);
+                        }
+                }
+
+                fn print(const Stop& at, const std::string& name) {
+                        if (at.closure != nullptr) {
+                                auto& captures = at.closure->declaration->captures;
+                                for (size_t i = 0; i < at.closure->upvalues.size(); ++i) {
+                                        if (captures[i].name.lexeme == name) {
+                                                reply(show(unboxed(at.closure->upvalues[i])) + "\n");
+                                                return;
+                                        }
+                                }
+                        }
+                        try {
+                                auto value = at.env->get(token::Token(token::IDENTIFIER, name, std::any(), at.line));
+                                reply(show(unboxed(value)) + "\n");
+                        } catch (errors::runtime_panic&) {
+                                reply(std::format("'{}' is not defined here\n", name));
+                        }
+                }
+
+                // reads commands until one of them resumes the run
+                fn prompt(const Stop& at) {
+                        reply(std::format("stopped at {}:{}\n", name_of(at.file), at.line));
+                        std::string line;
+                        while (read_line(line)) {
+                                std::istringstream words(line);
+                                std::string cmd, arg;
+                                words >> cmd >> arg;
+                                if (cmd.empty()) {
+                                        continue;
+                                } else if (cmd == "c" || cmd == "continue") {
+                                        m = RUN;
+                                        return;
+                                } else if (cmd == "s" || cmd == "step") {
+                                        m = STEP;
+                                        return;
+                                } else if (cmd == "n" || cmd == "next") {
+                                        m = NEXT;
+                                        from = at.depth;
+                                        return;
+                                } else if (cmd == "f" || cmd == "finish") {
+                                        m = FINISH;
+                                        from = at.depth;
+                                        return;
+                                } else if (cmd == "b" || cmd == "break") {
+                                        add_breakpoint(arg);
+                                } else if (cmd == "d" || cmd == "delete") {
+                                        delete_breakpoint(arg);
+                                } else if (cmd == "w" || cmd == "where") {
+                                        reply(std::format("{}:{} depth {}\n", name_of(at.file), at.line, at.depth));
+                                } else if (cmd == "e" || cmd == "env") {
+                                        show_env(at);
+                                } else if (cmd == "p" || cmd == "print") {
+                                        print(at, arg);
+                                } else if (cmd == "q" || cmd == "quit") {
+                                        std::exit(0);
+                                } else {
+                                        reply(std::format("unknown command '{}'\n", cmd));
+                                }
+                        }
+                        // nobody is left to ask, the run goes on to its end
+                        m = RUN;
+                        breakpoints.clear();
+                        lines.clear();
+                }
+
+        public:
+                // values as print writes them, set by the interpreter
+                std::function<std::string(std::any&)> show;
+
+                Debugger(
+                        int i,
+                        int o,
+                        bool stop_first = true
+                ) : in(i), out(o), m(stop_first ? STEP : RUN)
+                {}
+
+                fn at(const Stop& stop) {
+                        if (!closed && should_stop(stop)) {
+                                prompt(stop);
+                        }
+                }
+        };
+}
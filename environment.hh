@@ -2,71 +2,152 @@
 #include "cpplox.hh"
 #include "errors.hh"
 #include "token.hh"
+#include "stats.hh"
+#include "alloc.hh"
+#include "gc.hh"
 
+// build with -DLOX_TRACE_ENV to trace every variable access on stderr
 namespace environment {
-        class Environment {
-                std::shared_ptr<Environment> enclosing;
-                std::unordered_map<std::wstring, std::any> values;
+        class Environment : public gc::Object {
+                Environment* enclosing = nullptr;
+                std::unordered_map<
+                        std::string, std::any,
+                        std::hash<std::string>, std::equal_to<std::string>,
+                        alloc::Allocator<std::pair<const std::string, std::any>, alloc::ENVIRONMENT>
+                > values;
+
+                // values stored while remembered, see hashmap::Map
+                std::vector<std::any*> stores;
+                bool stored_all = false;
+
+                fn stored(std::any& v) {
+                        if (!(flags & REMEMBERED) || stored_all) {
+                                return;
+                        }
+                        if (stores.size() >= values.size()) {
+                                stored_all = true;
+                                stores.clear();
+                                return;
+                        }
+                        stores.push_back(&v);
+                }
 
         public:
                 Environment() {
-                        enclosing.reset();
+                        STATS_ADD(env_frames, 1);
                 }
 
                 Environment(
-                        std::shared_ptr<Environment> e
+                        Environment* e
                 ) : enclosing(e)
-                {}
+                {
+                        STATS_ADD(env_frames, 1);
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.object(enclosing);
+                        for (auto& [name, value] : values) {
+                                t.value(value);
+                        }
+                }
+
+                fn trace_stores(gc::Tracer& t) -> void override {
+                        if (stored_all) {
+                                trace(t);
+                                return;
+                        }
+                        for (auto v : stores) {
+                                t.value(*v);
+                        }
+                }
+
+                fn forget() -> void override {
+                        stores.clear();
+                        stored_all = false;
+                }
+
+                fn parent() const -> Environment* {
+                        return enclosing;
+                }
+
+                // every name and value of this scope alone
+                template<class F>
+                fn each(F f) {
+                        for (auto& [name, value] : values) {
+                                f(name, value);
+                        }
+                }
+
+                // drops every name, keeps the table for reuse
+                fn clear() {
+                        values.clear();
+                        stores.clear();
+                }
 
-                fn define(std::wstring name, std::any value) {
-                        std::wcout << L"--- define()" << std::endl;
-                        std::wcout << L"| " << name << std::endl;
-                        std::wcout << L"| " << enclosing << std::endl;
-                        std::wcout << L"---" << std::endl;
+                fn define(std::string name, std::any value) {
+                        alloc::Scope scope(alloc::ENVIRONMENT);
+#ifdef LOX_TRACE_ENV
+                        std::cerr << "--- define()" << std::endl;
+                        std::cerr << "| " << name << std::endl;
+                        std::cerr << "| " << enclosing << std::endl;
+                        std::cerr << "---" << std::endl;
+#endif
 
-                        values[name] = value;
+                        gc::barrier(this);
+                        auto& v = values[name];
+                        v = value;
+                        stored(v);
                 }
 
-                fn assign(token::Token name, std::any value) {
-                        std::wcout << L"--- assign()" << std::endl;
-                        std::wcout << L"| " << name.lexeme << std::endl;
-                        std::wcout << L"| " << enclosing << std::endl;
-                        std::wcout << L"---" << std::endl;
+                fn assign(const token::Token& name, std::any value) {
+                        alloc::Scope scope(alloc::ENVIRONMENT);
+#ifdef LOX_TRACE_ENV
+                        std::cerr << "--- assign()" << std::endl;
+                        std::cerr << "| " << name.lexeme << std::endl;
+                        std::cerr << "| " << enclosing << std::endl;
+                        std::cerr << "---" << std::endl;
+#endif
 
-                        if (values.contains(name.lexeme)) {
-                                values[name.lexeme] = value;
+                        if (auto it = values.find(name.lexeme); it != values.end()) {
+                                gc::barrier(this);
+                                it->second = value;
+                                stored(it->second);
                                 return;
                         }
                         if (enclosing != NULL) {
+                                STATS_ADD(lookup_depth, 1);
                                 enclosing->assign(name, value);
                                 return;
                         }
 
                         throw errors::runtime_panic(name,
-                                utils::to_string(std::format(
-                                        L"Undefined variable for assignment '{}'.", name.lexeme
-                                ))
+                                std::format(
+                                        "Undefined variable for assignment '{}'.", name.lexeme
+                                )
                         );
                 }
 
-                fn get(token::Token name) -> std::any {
-                        std::wcout << L"--- get()" << std::endl;
-                        std::wcout << L"| " << name.lexeme << std::endl;
-                        std::wcout << L"| " << enclosing << std::endl;
-                        std::wcout << L"---" << std::endl;
+                fn get(const token::Token& name) -> std::any {
+#ifdef LOX_TRACE_ENV
+                        std::cerr << "--- get()" << std::endl;
+                        std::cerr << "| " << name.lexeme << std::endl;
+                        std::cerr << "| " << enclosing << std::endl;
+                        std::cerr << "---" << std::endl;
+#endif
 
-                        if (values.contains(name.lexeme)) {
-                                return values.at(name.lexeme);
+                        if (auto it = values.find(name.lexeme); it != values.end()) {
+                                return it->second;
                         }
  
                         if (enclosing != NULL) {
-                                enclosing->get(name);
+                                STATS_ADD(lookup_depth, 1);
+                                return enclosing->get(name);
                         }
 
                         throw errors::runtime_panic(name,
-                                utils::to_string(std::format(
-                                        L"Undefined variable '{}'.", name.lexeme
-                                ))
+                                std::format(
+                                        "Undefined variable '{}'.", name.lexeme
+                                )
                         );
                 }
         };
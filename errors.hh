@@ -13,28 +13,43 @@ namespace errors {
                 {}
         };
 
-        bool hadError = false;
-        bool had_runtime_error = false;
-        fn report(int line, std::wstring where, std::wstring msg) {
-                std::wcerr << std::format(
-                        L"[ line {} ] Error{}: {}",
-                        line, where, msg
-                ) << std::endl;
+        // modules are scanned and parsed on worker threads
+        std::atomic<bool> hadError = false;
+        std::atomic<bool> had_runtime_error = false;
+        std::mutex report_mtx;
+
+        // file being compiled on this thread, empty for the main script
+        thread_local std::string source;
+
+        // messages of a compile for an embedding host, kept here instead
+        // of printed while set; guarded by report_mtx
+        std::vector<std::string>* collected = nullptr;
+
+        fn report(int line, std::string where, std::string msg) {
+                std::lock_guard lock(report_mtx);
+                auto message = source.empty()
+                        ? std::format("[ line {} ] Error{}: {}", line, where, msg)
+                        : std::format("[ {} line {} ] Error{}: {}", source, line, where, msg);
+                if (collected != nullptr) {
+                        collected->push_back(message);
+                } else {
+                        std::cerr << message << std::endl;
+                }
                 hadError = true;
         }
 
-        fn error(token::Token t, std::wstring msg) {
+        fn error(token::Token t, std::string msg) {
                 if (t.type == token::FILE_EOF) {
-                        report(t.line, L" at end", msg);
+                        report(t.line, " at end", msg);
                 } else {
                         report(t.line, std::format(
-                                L" at '{}'", t.lexeme
+                                " at '{}'", t.lexeme
                         ), msg);
                 }
         }
 
-        fn error(int line, std::wstring msg) {
-                report(line, L"", msg);
+        fn error(int line, std::string msg) {
+                report(line, "", msg);
         }
 
         fn runtime_err(runtime_panic err) {
@@ -0,0 +1,84 @@
+#pragma once
+#include "cpplox.hh"
+#include "stmt.hh"
+#include "alloc.hh"
+#include "gc.hh"
+
+// Lox functions. A closure is its declaration and a flat array of the
+// variables it captured, laid out by the resolver. It holds nothing of the
+// scope it was made in, so what a long-lived closure keeps alive is what
+// its body mentions.
+namespace function {
+        // a captured variable that is also assigned
+        class Cell : public gc::Object {
+        public:
+                std::any value;
+
+                Cell(
+                        std::any v
+                ) : value(std::move(v))
+                {}
+
+                fn set(std::any v) {
+                        gc::barrier(this);
+                        value = std::move(v);
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.value(value);
+                }
+        };
+
+        using cell_ptr = Cell*;
+
+        fn make_cell(std::any value) -> cell_ptr {
+                return gc::make<Cell>(std::move(value));
+        }
+
+        class Closure : public gc::Object {
+        public:
+                // keeps the body alive after its script is gone
+                std::shared_ptr<stmt::Function> declaration;
+                // module it was made in, nullptr for interactive input
+                const std::string* file;
+                // a cell_ptr for boxed captures, otherwise the value
+                std::vector<std::any, alloc::Allocator<std::any, alloc::INTERPRETER>> upvalues;
+
+                Closure(
+                        std::shared_ptr<stmt::Function> d,
+                        const std::string* f
+                ) : declaration(d), file(f)
+                {
+                        upvalues.reserve(d->captures.size());
+                }
+
+                fn name() const -> const std::string& {
+                        return declaration->name.lexeme;
+                }
+
+                fn arity() const -> size_t {
+                        return declaration->params.size();
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        for (auto& v : upvalues) {
+                                t.value(v);
+                        }
+                }
+        };
+
+        using closure_ptr = Closure*;
+
+        namespace {
+                gc::Traced<Cell> traced_cell;
+                gc::Traced<Closure> traced_closure;
+        }
+
+        fn make(std::shared_ptr<stmt::Function> declaration, const std::string* file) -> closure_ptr {
+                return gc::make<Closure>(declaration, file);
+        }
+
+        fn is_closure(const std::any& v) -> bool {
+                return v.type() == typeid(closure_ptr);
+        }
+}
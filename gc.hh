@@ -0,0 +1,679 @@
+#pragma once
+#include "cpplox.hh"
+#include "alloc.hh"
+#include "limits.hh"
+#include "stack.hh"
+
+// Managed heap of the runtime objects: environments, closures, cells,
+// classes, instances, bound methods, arrays and maps. Values hold plain
+// pointers to them and a mark-sweep collector frees what is unreachable,
+// cycles included.
+//
+// Objects are bump allocated in chunks and never move. The young
+// generation is every object allocated since the last collection; a
+// minor collection marks from the roots and the remembered old objects
+// only, frees the dead young objects and makes the rest old in place. A
+// store into an old object goes through barrier(), which remembers it. A
+// major collection marks and sweeps every chunk, and a chunk left
+// without objects is reused for allocation.
+//
+// Objects and interpreter roots are traced precisely. The C++ stacks of
+// the thread, every segment of stack.hh in use, are scanned
+// conservatively, the evaluator keeps values in native locals: any word
+// pointing into an object keeps it alive.
+//
+// A thread allocates in its own heap, or in the one a Use scope puts in
+// place: an embedding host gives every state a heap of its own, freed
+// in one pass without tracing when the state is reset.
+//
+// build with -DLOX_GC_STRESS to collect on every allocation
+namespace gc {
+        class Object;
+        class Heap;
+
+        // how the heap grows, set before the first allocation
+        class Policy {
+        public:
+                // bytes allocated between two collections
+                size_t nursery = 2 << 20;
+                // a major collection runs once the heap outgrows
+                // max(min_heap, growth * live bytes after the last one)
+                double growth = 2.0;
+                size_t min_heap = 16 << 20;
+                // quota of the heap, a major collection that leaves more
+                // live bytes throws limits::exceeded
+                size_t max_heap = std::numeric_limits<size_t>::max();
+        };
+
+        class Stats {
+        public:
+                uint64_t minor = 0;
+                uint64_t major = 0;
+                // a minor collection may go on into a major one
+                uint64_t pauses = 0;
+                // nanoseconds
+                int64_t pause_total = 0;
+                int64_t pause_max = 0;
+                uint64_t freed_objects = 0;
+                // objects and the memory they hold outside the heap
+                uint64_t freed_bytes = 0;
+                uint64_t promoted_bytes = 0;
+                size_t peak_chunks = 0;
+        };
+
+        // marks what objects refer to
+        class Tracer {
+                std::vector<Object*>& gray;
+                // a minor collection stops at old objects
+                bool minor;
+
+        public:
+                Tracer(
+                        std::vector<Object*>& g,
+                        bool m
+                ) : gray(g), minor(m)
+                {}
+
+                fn object(Object* o);
+                fn value(const std::any& v);
+        };
+
+        class Object {
+        public:
+                static constexpr uint8_t MARKED = 1;
+                static constexpr uint8_t OLD = 2;
+                static constexpr uint8_t REMEMBERED = 4;
+
+                // bytes taken in the chunk
+                uint32_t size = 0;
+                uint8_t flags = 0;
+
+                virtual ~Object() = default;
+
+                virtual fn trace(Tracer&) -> void {}
+
+                // traces what a remembered object got since the last
+                // collection, large objects keep track of their stores
+                virtual fn trace_stores(Tracer& t) -> void {
+                        trace(t);
+                }
+
+                // no longer remembered
+                virtual fn forget() -> void {}
+
+                // bytes held outside the heap, counted when freed
+                virtual fn external() const -> size_t {
+                        return 0;
+                }
+        };
+
+        // values an object holds outside the heap, traced every collection
+        class Roots {
+        public:
+                Roots();
+                virtual ~Roots();
+
+                virtual fn trace(Tracer&) -> void = 0;
+        };
+
+        namespace {
+                // the value types holding an object, see value()
+                std::vector<std::pair<const std::type_info*, Object* (*)(const std::any&)>> types;
+        }
+
+        // registers T* as a value type, once per type
+        template<class T>
+        class Traced {
+        public:
+                Traced() {
+                        types.push_back({&typeid(T*), [](const std::any& v) -> Object* {
+                                return *std::any_cast<T*>(&v);
+                        }});
+                }
+        };
+
+        fn Tracer::object(Object* o) {
+                if (o == nullptr || (o->flags & Object::MARKED)) {
+                        return;
+                }
+                if (minor && (o->flags & Object::OLD)) {
+                        return;
+                }
+                o->flags |= Object::MARKED;
+                gray.push_back(o);
+        }
+
+        fn Tracer::value(const std::any& v) {
+                if (!v.has_value()) {
+                        return;
+                }
+                auto& t = v.type();
+                if (t == typeid(double) || t == typeid(std::string) || t == typeid(bool)) {
+                        return;
+                }
+                for (auto& [type, get] : types) {
+                        if (t == *type) {
+                                object(get(v));
+                                return;
+                        }
+                }
+        }
+
+        // Objects start at a granule, a bitmap of the granules that start
+        // one finds the object around an address from the stack. After a
+        // sweep the chunk marks the lines its objects cover, the runs of
+        // free lines between them are the holes allocation bumps through.
+        class Chunk {
+        public:
+                static constexpr size_t bytes = 64 << 10;
+                static constexpr size_t granule = 16;
+                static constexpr size_t line = 256;
+                static constexpr size_t lines = bytes / line;
+
+                char* base;
+                size_t objects = 0;
+                std::array<uint64_t, bytes / granule / 64> starts{};
+                std::bitset<lines> used;
+                // allocated into since the last collection
+                bool touched = false;
+
+                Chunk() : base(static_cast<char*>(alloc::allocate(bytes, alloc::HEAP)))
+                {}
+
+                ~Chunk() {
+                        alloc::deallocate(base);
+                }
+
+                Chunk(const Chunk&) = delete;
+                fn operator=(const Chunk&) -> Chunk& = delete;
+
+                fn set_start(size_t offset, bool on) {
+                        auto g = offset / granule;
+                        if (on) {
+                                starts[g / 64] |= uint64_t(1) << (g % 64);
+                        } else {
+                                starts[g / 64] &= ~(uint64_t(1) << (g % 64));
+                        }
+                }
+
+                // the object covering offset, if any
+                fn object_at(size_t offset) -> Object* {
+                        auto g = offset / granule;
+                        auto w = g / 64;
+                        // bits up to and including g
+                        auto bits = starts[w] & ((uint64_t(2) << (g % 64)) - 1);
+                        while (bits == 0) {
+                                if (w == 0) {
+                                        return nullptr;
+                                }
+                                bits = starts[--w];
+                        }
+                        auto start = (w * 64 + 63 - std::countl_zero(bits)) * granule;
+                        auto o = reinterpret_cast<Object*>(base + start);
+                        return offset < start + o->size ? o : nullptr;
+                }
+
+                // calls f(object) for every object, in address order
+                template<class F>
+                fn each(F f) {
+                        for (size_t w = 0; w < starts.size(); ++w) {
+                                for (auto bits = starts[w]; bits != 0; bits &= bits - 1) {
+                                        auto g = w * 64 + std::countr_zero(bits);
+                                        f(reinterpret_cast<Object*>(base + g * granule));
+                                }
+                        }
+                }
+
+                fn mark_lines() {
+                        used.reset();
+                        each([&](Object* o) {
+                                auto start = reinterpret_cast<char*>(o) - base;
+                                for (auto l = start / line; l <= (start + o->size - 1) / line; ++l) {
+                                        used.set(l);
+                                }
+                        });
+                }
+
+                // first run of free lines at or after line from, as byte
+                // offsets, empty if there is none
+                fn hole(size_t from) const -> std::pair<size_t, size_t> {
+                        while (from < lines && used[from]) {
+                                from++;
+                        }
+                        auto to = from;
+                        while (to < lines && !used[to]) {
+                                to++;
+                        }
+                        return {from * line, to * line};
+                }
+
+                fn reset() {
+                        objects = 0;
+                        starts.fill(0);
+                        used.reset();
+                }
+        };
+
+        class Heap {
+                // by base address, for the stack scan
+                std::map<uintptr_t, std::unique_ptr<Chunk>> chunks;
+                // chunks with holes, then chunks without objects, are
+                // used before new ones
+                std::vector<Chunk*> recyclable;
+                std::vector<Chunk*> empty;
+                // the hole being bumped through
+                Chunk* current = nullptr;
+                size_t cursor = 0;
+                size_t end = 0;
+
+                std::vector<Object*> young;
+                std::vector<Object*> remembered;
+                std::vector<Object*> gray;
+                std::vector<Roots*> roots;
+
+                // young bytes and outside memory since the last collection
+                size_t allocated = 0;
+                size_t object_bytes = 0;
+                size_t external_bytes = 0;
+                size_t limit = 0;
+
+                fn next_chunk() -> Chunk* {
+                        std::vector<Chunk*>& from = recyclable.empty() ? empty : recyclable;
+                        if (!from.empty()) {
+                                auto c = from.back();
+                                from.pop_back();
+                                return c;
+                        }
+                        auto c = std::make_unique<Chunk>();
+                        auto p = c.get();
+                        chunks.emplace(reinterpret_cast<uintptr_t>(p->base), std::move(c));
+                        stats.peak_chunks = std::max(stats.peak_chunks, chunks.size());
+                        return p;
+                }
+
+                // skips holes too small for size, objects never cross
+                // a used line
+                fn bump(size_t size) -> char* {
+                        while (current == nullptr || cursor + size > end) {
+                                if (current != nullptr && end < Chunk::bytes) {
+                                        std::tie(cursor, end) = current->hole(end / Chunk::line);
+                                        continue;
+                                }
+                                current = next_chunk();
+                                current->touched = true;
+                                std::tie(cursor, end) = current->hole(0);
+                        }
+                        auto p = current->base + cursor;
+                        cursor += size;
+                        return p;
+                }
+
+                fn chunk_of(uintptr_t address) -> Chunk* {
+                        auto it = chunks.upper_bound(address);
+                        if (it == chunks.begin()) {
+                                return nullptr;
+                        }
+                        --it;
+                        return address < it->first + Chunk::bytes ? it->second.get() : nullptr;
+                }
+
+                [[gnu::no_sanitize_address]]
+                fn scan_range(Tracer& t, stack::Range r) {
+                        r.low &= ~(sizeof(uintptr_t) - 1);
+                        for (auto p = r.low; p + sizeof(uintptr_t) <= r.high; p += sizeof(uintptr_t)) {
+                                auto word = *reinterpret_cast<const uintptr_t*>(p);
+                                if (auto c = chunk_of(word)) {
+                                        if (auto o = c->object_at(word - reinterpret_cast<uintptr_t>(c->base))) {
+                                                t.object(o);
+                                        }
+                                }
+                        }
+                }
+
+                // A suspended range scanned before holds old objects only,
+                // everything it points to was marked then and nothing has
+                // written to it since; a minor collection skips it.
+                [[gnu::noinline]]
+                fn scan_stack(Tracer& t, bool minor) {
+                        auto low = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+                        stack::each(low, [&](stack::Range& r) {
+                                if (minor && r.scanned_by == this) {
+                                        return;
+                                }
+                                scan_range(t, r);
+                                r.scanned_by = this;
+                        });
+                }
+
+                // spills the callee saved registers into this frame
+                // before the scan starts below it
+                [[gnu::noinline]]
+                fn mark_stack(Tracer& t, bool minor) {
+                        __builtin_unwind_init();
+                        scan_stack(t, minor);
+                }
+
+                fn mark(bool minor) {
+                        Tracer t(gray, minor);
+                        mark_stack(t, minor);
+                        for (auto r : roots) {
+                                r->trace(t);
+                        }
+                        if (minor) {
+                                for (auto o : remembered) {
+                                        o->trace_stores(t);
+                                }
+                        }
+                        while (!gray.empty()) {
+                                auto o = gray.back();
+                                gray.pop_back();
+                                o->trace(t);
+                        }
+                }
+
+                fn free(Chunk* c, Object* o) {
+                        stats.freed_objects++;
+                        stats.freed_bytes += o->size + o->external();
+                        object_bytes -= o->size;
+                        external_bytes -= o->external();
+                        c->set_start(reinterpret_cast<char*>(o) - c->base, false);
+                        c->objects--;
+                        o->~Object();
+                }
+
+                // Sorts a swept chunk: an empty one is kept while there
+                // is less than a nursery worth of them, and freed
+                // otherwise; one with holes is recycled.
+                fn settle(Chunk* c) {
+                        c->touched = false;
+                        if (c->objects == 0) {
+                                c->reset();
+                                if (empty.size() * Chunk::bytes < policy.nursery) {
+                                        empty.push_back(c);
+                                } else {
+                                        chunks.erase(reinterpret_cast<uintptr_t>(c->base));
+                                }
+                                return;
+                        }
+                        c->mark_lines();
+                        if (!c->used.all()) {
+                                recyclable.push_back(c);
+                        }
+                }
+
+                // only chunks allocated into can hold young objects
+                fn sweep_young() {
+                        std::vector<Chunk*> swept;
+                        for (auto& [base, c] : chunks) {
+                                if (c->touched) {
+                                        swept.push_back(c.get());
+                                }
+                        }
+                        for (auto o : young) {
+                                if (o->flags & Object::MARKED) {
+                                        o->flags = Object::OLD;
+                                        stats.promoted_bytes += o->size;
+                                } else {
+                                        free(chunk_of(reinterpret_cast<uintptr_t>(o)), o);
+                                }
+                        }
+                        for (auto c : swept) {
+                                settle(c);
+                        }
+                }
+
+                fn sweep_all() {
+                        std::vector<Chunk*> swept;
+                        for (auto& [base, c] : chunks) {
+                                if (c->objects == 0 && !c->touched) {
+                                        continue;
+                                }
+                                c->each([&](Object* o) {
+                                        if (o->flags & Object::MARKED) {
+                                                o->flags = Object::OLD;
+                                        } else {
+                                                free(c.get(), o);
+                                        }
+                                });
+                                swept.push_back(c.get());
+                        }
+                        recyclable.clear();
+                        for (auto c : swept) {
+                                settle(c);
+                        }
+                }
+
+                // after a collection no old object points at a young one
+                fn forget() {
+                        for (auto o : remembered) {
+                                o->flags &= ~Object::REMEMBERED;
+                                o->forget();
+                        }
+                        remembered.clear();
+                }
+
+                fn heap_bytes() const -> size_t {
+                        return object_bytes + external_bytes;
+                }
+
+        public:
+                Policy policy;
+                Stats stats;
+
+                Heap() = default;
+
+                ~Heap() {
+                        for (auto& [base, c] : chunks) {
+                                c->each([](Object* o) { o->~Object(); });
+                        }
+                }
+
+                Heap(const Heap&) = delete;
+                fn operator=(const Heap&) -> Heap& = delete;
+
+                template<class T, class... Args>
+                fn make(Args&&... args) -> T* {
+                        static_assert(alignof(T) <= Chunk::granule);
+                        constexpr size_t size = (sizeof(T) + Chunk::granule - 1) & ~(Chunk::granule - 1);
+                        static_assert(size <= Chunk::bytes);
+
+#ifdef LOX_GC_STRESS
+                        collect(stats.pauses % 8 == 7);
+#else
+                        if (allocated >= policy.nursery) {
+                                collect(false);
+                        }
+#endif
+                        auto p = bump(size);
+                        auto c = current;
+                        auto t = new (p) T(std::forward<Args>(args)...);
+                        Object* o = t;
+                        o->size = size;
+                        c->set_start(p - c->base, true);
+                        c->objects++;
+                        young.push_back(o);
+                        allocated += size;
+                        object_bytes += size;
+                        return t;
+                }
+
+                // Frees every object without marking, for a heap nothing
+                // refers into any more. Destructors run in one pass over
+                // the chunks, which are kept empty for the next run.
+                fn clear() {
+                        empty.clear();
+                        for (auto& [base, c] : chunks) {
+                                c->each([](Object* o) { o->~Object(); });
+                                c->reset();
+                                c->touched = false;
+                                empty.push_back(c.get());
+                        }
+                        recyclable.clear();
+                        young.clear();
+                        remembered.clear();
+                        current = nullptr;
+                        cursor = end = 0;
+                        allocated = object_bytes = external_bytes = 0;
+                        limit = 0;
+                }
+
+                fn remember(Object* o) {
+                        o->flags |= Object::REMEMBERED;
+                        remembered.push_back(o);
+                }
+
+                // memory an object took outside the heap, given back
+                // when it is freed
+                fn external(size_t bytes) {
+                        external_bytes += bytes;
+                        allocated += bytes;
+                }
+
+                // a quota is looked at once a nursery is allocated, the
+                // nursery shrinks to keep the overshoot small against it
+                fn set_quota(size_t bytes) {
+                        policy.max_heap = bytes;
+                        policy.nursery = std::min(policy.nursery, std::max<size_t>(bytes / 4, 1));
+                }
+
+                // outside memory an object is about to take, refused once
+                // a major collection cannot make room for it in the quota
+                fn reserve(size_t bytes) {
+                        auto fits = [&] {
+                                return bytes <= policy.max_heap && heap_bytes() <= policy.max_heap - bytes;
+                        };
+                        if (fits()) {
+                                return;
+                        }
+                        collect(true);
+                        if (!fits()) {
+                                throw limits::exceeded(std::format(
+                                        "Heap limit of {} KiB exceeded.", policy.max_heap >> 10
+                                ));
+                        }
+                }
+
+                // a minor collection turns into a major one once the
+                // heap outgrows its limit
+                fn collect(bool major) -> void {
+                        auto start = std::chrono::steady_clock::now();
+                        current = nullptr;
+                        cursor = end = 0;
+                        if (!major) {
+                                mark(true);
+                                forget();
+                                sweep_young();
+                                stats.minor++;
+                                major = heap_bytes() >= std::max(limit, policy.min_heap)
+                                        || heap_bytes() > policy.max_heap;
+                        }
+                        if (major) {
+                                forget();
+                                mark(false);
+                                sweep_all();
+                                stats.major++;
+                                limit = heap_bytes() * policy.growth;
+                        }
+                        young.clear();
+                        allocated = 0;
+
+                        auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - start
+                        ).count();
+                        stats.pauses++;
+                        stats.pause_total += pause;
+                        stats.pause_max = std::max(stats.pause_max, pause);
+
+                        if (heap_bytes() > policy.max_heap) {
+                                throw limits::exceeded(std::format(
+                                        "Heap limit of {} KiB exceeded.", policy.max_heap >> 10
+                                ));
+                        }
+                }
+
+                fn add_roots(Roots* r) {
+                        roots.push_back(r);
+                }
+
+                fn remove_roots(Roots* r) {
+                        std::erase(roots, r);
+                }
+
+                fn report(std::ostream& out) {
+                        auto ms = [](int64_t ns) { return ns / 1e6; };
+                        out << "---- gc ----\n";
+                        out << std::format("{:<22}{:>12}   major {}\n", "minor collections", stats.minor, stats.major);
+                        out << std::format(
+                                "{:<22}{:>12.3f}   max {:.3f} avg {:.3f}\n",
+                                "pause ms", ms(stats.pause_total), ms(stats.pause_max),
+                                stats.pauses ? ms(stats.pause_total) / stats.pauses : 0.0
+                        );
+                        out << std::format("{:<22}{:>12}\n", "objects freed", stats.freed_objects);
+                        out << std::format("{:<22}{:>12} KiB\n", "collected", stats.freed_bytes >> 10);
+                        out << std::format("{:<22}{:>12} KiB\n", "promoted", stats.promoted_bytes >> 10);
+                        out << std::format("{:<22}{:>12} KiB\n", "live", heap_bytes() >> 10);
+                        out << std::format(
+                                "{:<22}{:>12} KiB\n",
+                                "peak heap", stats.peak_chunks * Chunk::bytes >> 10
+                        );
+                }
+        };
+
+        namespace {
+                // put in place by Use, nullptr for the thread's own heap
+                thread_local Heap* active = nullptr;
+        }
+
+        fn heap() -> Heap& {
+                thread_local Heap h;
+                return active != nullptr ? *active : h;
+        }
+
+        // Allocates in h on this thread while it lives. Roots made in the
+        // scope of a heap are to be destroyed in the scope of the same one.
+        class Use {
+                Heap* previous;
+
+        public:
+                Use(
+                        Heap& h
+                ) : previous(active)
+                {
+                        active = &h;
+                }
+
+                ~Use() {
+                        active = previous;
+                }
+
+                Use(const Use&) = delete;
+                fn operator=(const Use&) -> Use& = delete;
+        };
+
+        template<class T, class... Args>
+        fn make(Args&&... args) -> T* {
+                return heap().make<T>(std::forward<Args>(args)...);
+        }
+
+        // call before an object may point at a younger one
+        fn barrier(Object* o) {
+                if ((o->flags & (Object::OLD | Object::REMEMBERED)) == Object::OLD) {
+                        heap().remember(o);
+                }
+        }
+
+        Roots::Roots() {
+                heap().add_roots(this);
+        }
+
+        Roots::~Roots() {
+                heap().remove_roots(this);
+        }
+}
+
+#ifdef __SANITIZE_ADDRESS__
+// locals moved to fake frames off the stack would escape the scan
+extern "C" fn __asan_default_options() -> const char* {
+        return "detect_stack_use_after_return=0";
+}
+#endif
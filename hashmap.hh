@@ -0,0 +1,376 @@
+#pragma once
+#include "cpplox.hh"
+#include "alloc.hh"
+#include "gc.hh"
+
+// Open addressing hash table in the style of Swiss tables. A byte of
+// control per slot holds either EMPTY, DELETED or the low 7 bits of the
+// key hash, and a probe checks 8 control bytes at once with word-wide
+// bit tricks before touching any key. Keys carry their full hash, so
+// probing compares strings only on a real hash match and growing never
+// hashes a key twice.
+namespace hashmap {
+        class Key {
+        public:
+                enum kind {
+                        NUMBER, STRING, BOOL,
+                };
+
+                kind type = NUMBER;
+                // numbers, and booleans as 0 / 1
+                double number = 0;
+                std::string string;
+                uint64_t hash = 0;
+
+                // finalizer of murmur3, spreads every input bit
+                static fn mix(uint64_t x) -> uint64_t {
+                        x ^= x >> 33;
+                        x *= 0xff51afd7ed558ccdULL;
+                        x ^= x >> 33;
+                        x *= 0xc4ceb9fe1a85ec53ULL;
+                        x ^= x >> 33;
+                        return x;
+                }
+
+                // False if v can not be a key: nil, NaN or a reference
+                // value. A type miss costs a type_info comparison while a
+                // hit is a pointer compare, so strings are tried first.
+                static fn hash_of(const std::any& v, uint64_t& hash) -> bool {
+                        if (auto s = std::any_cast<std::string>(&v)) {
+                                hash = mix(std::hash<std::string_view>()(*s));
+                                return true;
+                        }
+                        if (auto d = std::any_cast<double>(&v)) {
+                                if (*d != *d) {
+                                        return false;
+                                }
+                                // -0 and 0 are the same key
+                                hash = mix(std::bit_cast<uint64_t>(*d + 0.0));
+                                return true;
+                        }
+                        if (auto b = std::any_cast<bool>(&v)) {
+                                hash = mix(0x100 | *b);
+                                return true;
+                        }
+                        return false;
+                }
+
+                static fn from(const std::any& v, Key& key) -> bool {
+                        if (!hash_of(v, key.hash)) {
+                                return false;
+                        }
+                        if (auto s = std::any_cast<std::string>(&v)) {
+                                key.type = STRING;
+                                key.string = *s;
+                        } else if (auto d = std::any_cast<double>(&v)) {
+                                key.type = NUMBER;
+                                key.number = *d + 0.0;
+                        } else {
+                                key.type = BOOL;
+                                key.number = std::any_cast<bool>(v);
+                        }
+                        return true;
+                }
+
+                // compares with a value of equal hash without making a Key
+                fn matches(const std::any& v) const -> bool {
+                        switch (type) {
+                        case NUMBER: {
+                                auto d = std::any_cast<double>(&v);
+                                return d != nullptr && *d == number;
+                        }
+                        case STRING: {
+                                auto s = std::any_cast<std::string>(&v);
+                                return s != nullptr && *s == string;
+                        }
+                        case BOOL: {
+                                auto b = std::any_cast<bool>(&v);
+                                return b != nullptr && *b == (number != 0);
+                        }
+                        }
+                        return false;
+                }
+
+                fn to_any() const -> std::any {
+                        switch (type) {
+                        case NUMBER: return number;
+                        case STRING: return string;
+                        case BOOL:   return number != 0;
+                        }
+                        return {};
+                }
+
+                fn operator==(const Key& o) const -> bool {
+                        if (hash != o.hash || type != o.type) {
+                                return false;
+                        }
+                        return type == STRING ? string == o.string : number == o.number;
+                }
+        };
+
+        class Map : public gc::Object {
+                using ctrl_t = int8_t;
+                static constexpr ctrl_t EMPTY = -128;
+                static constexpr ctrl_t DELETED = -2;
+                static constexpr size_t group_width = 8;
+                static constexpr size_t min_capacity = 8;
+
+                class Slot {
+                public:
+                        Key key;
+                        std::any value;
+                };
+
+                // 8 control bytes, byte i in bits 8i..8i+7
+                class Group {
+                        static constexpr uint64_t lsbs = 0x0101010101010101ULL;
+                        static constexpr uint64_t msbs = 0x8080808080808080ULL;
+                        uint64_t ctrl;
+
+                public:
+                        Group(
+                                const ctrl_t* p
+                        ) {
+                                std::memcpy(&ctrl, p, sizeof(ctrl));
+                                if constexpr (std::endian::native == std::endian::big) {
+                                        ctrl = __builtin_bswap64(ctrl);
+                                }
+                        }
+
+                        // may report false positives, keys are compared anyway
+                        fn match(uint8_t h2) const -> uint64_t {
+                                auto x = ctrl ^ (lsbs * h2);
+                                return (x - lsbs) & ~x & msbs;
+                        }
+
+                        fn match_empty() const -> uint64_t {
+                                return ctrl & (~ctrl << 6) & msbs;
+                        }
+
+                        fn match_empty_or_deleted() const -> uint64_t {
+                                return ctrl & (~ctrl << 7) & msbs;
+                        }
+
+                        // index of the lowest set byte in a match
+                        static fn first(uint64_t mask) -> size_t {
+                                return std::countr_zero(mask) / 8;
+                        }
+                };
+
+                // capacity + group_width bytes, the tail mirrors the first
+                // bytes so a group can be loaded at any slot
+                std::vector<ctrl_t, alloc::Allocator<ctrl_t, alloc::INTERPRETER>> ctrl;
+                std::vector<Slot, alloc::Allocator<Slot, alloc::INTERPRETER>> slots;
+                size_t count = 0;
+                // inserts left before a rehash, DELETED slots use it up too
+                size_t growth_left = 0;
+
+                // slots stored while remembered, all of them after a
+                // rehash or once there are more stores than slots
+                std::vector<uint32_t, alloc::Allocator<uint32_t, alloc::INTERPRETER>> stores;
+                bool stored_all = false;
+
+                fn stored(size_t i) {
+                        if (!(flags & REMEMBERED) || stored_all) {
+                                return;
+                        }
+                        if (stores.size() >= capacity()) {
+                                stored_all = true;
+                                stores.clear();
+                                return;
+                        }
+                        stores.push_back(i);
+                }
+
+                static fn h1(uint64_t hash) -> size_t {
+                        return hash >> 7;
+                }
+
+                static fn h2(uint64_t hash) -> uint8_t {
+                        return hash & 0x7f;
+                }
+
+                fn capacity() const -> size_t {
+                        return slots.size();
+                }
+
+                fn set_ctrl(size_t i, ctrl_t c) {
+                        ctrl[i] = c;
+                        if (i < group_width) {
+                                ctrl[capacity() + i] = c;
+                        }
+                }
+
+                // triangular probing over groups visits every group once
+                // when the capacity is a power of two
+                template<class Eq>
+                fn find_index(uint64_t hash, Eq eq) const -> size_t {
+                        auto mask = capacity() - 1;
+                        auto pos = h1(hash) & mask;
+                        for (size_t step = group_width;; step += group_width) {
+                                Group g(&ctrl[pos]);
+                                for (auto m = g.match(h2(hash)); m != 0; m &= m - 1) {
+                                        auto i = (pos + Group::first(m)) & mask;
+                                        if (slots[i].key.hash == hash && eq(slots[i].key)) {
+                                                return i;
+                                        }
+                                }
+                                if (g.match_empty() != 0) {
+                                        return capacity();
+                                }
+                                pos = (pos + step) & mask;
+                        }
+                }
+
+                fn find_free(uint64_t hash) const -> size_t {
+                        auto mask = capacity() - 1;
+                        auto pos = h1(hash) & mask;
+                        for (size_t step = group_width;; step += group_width) {
+                                auto m = Group(&ctrl[pos]).match_empty_or_deleted();
+                                if (m != 0) {
+                                        return (pos + Group::first(m)) & mask;
+                                }
+                                pos = (pos + step) & mask;
+                        }
+                }
+
+                // grows when more than half full, otherwise only drops
+                // the DELETED slots
+                fn rehash() {
+                        auto cap = std::max(capacity(), min_capacity);
+                        if (count * 2 >= cap * 7 / 8) {
+                                cap *= 2;
+                        }
+
+                        auto before = external();
+                        auto after = cap + group_width + cap * sizeof(Slot);
+                        if (after > before) {
+                                gc::heap().reserve(after - before);
+                        }
+                        auto old = std::move(slots);
+                        auto old_ctrl = std::move(ctrl);
+                        slots = decltype(slots)(cap);
+                        ctrl = decltype(ctrl)(cap + group_width, EMPTY);
+                        growth_left = cap * 7 / 8 - count;
+                        gc::heap().external(external() - before);
+                        stored_all = true;
+                        stores.clear();
+
+                        for (size_t i = 0; i < old.size(); ++i) {
+                                if (old_ctrl[i] >= 0) {
+                                        auto j = find_free(old[i].key.hash);
+                                        set_ctrl(j, h2(old[i].key.hash));
+                                        slots[j] = std::move(old[i]);
+                                }
+                        }
+                }
+
+        public:
+                fn size() const -> size_t {
+                        return count;
+                }
+
+                fn find(const Key& key) -> std::any* {
+                        if (count == 0) {
+                                return nullptr;
+                        }
+                        auto i = find_index(key.hash, [&](const Key& k) { return k == key; });
+                        return i == capacity() ? nullptr : &slots[i].value;
+                }
+
+                // lookup by value, hash from Key::hash_of()
+                fn find(const std::any& v, uint64_t hash) -> std::any* {
+                        if (count == 0) {
+                                return nullptr;
+                        }
+                        auto i = find_index(hash, [&](const Key& k) { return k.matches(v); });
+                        return i == capacity() ? nullptr : &slots[i].value;
+                }
+
+                fn set(Key key, std::any value) {
+                        gc::barrier(this);
+                        if (count > 0) {
+                                auto i = find_index(key.hash, [&](const Key& k) { return k == key; });
+                                if (i < capacity()) {
+                                        slots[i].value = std::move(value);
+                                        stored(i);
+                                        return;
+                                }
+                        }
+                        if (growth_left == 0) {
+                                rehash();
+                        }
+                        auto i = find_free(key.hash);
+                        if (ctrl[i] == EMPTY) {
+                                growth_left--;
+                        }
+                        set_ctrl(i, h2(key.hash));
+                        slots[i] = Slot{std::move(key), std::move(value)};
+                        stored(i);
+                        count++;
+                }
+
+                fn erase(const Key& key) -> bool {
+                        if (count == 0) {
+                                return false;
+                        }
+                        auto i = find_index(key.hash, [&](const Key& k) { return k == key; });
+                        if (i == capacity()) {
+                                return false;
+                        }
+                        set_ctrl(i, DELETED);
+                        slots[i] = Slot();
+                        count--;
+                        return true;
+                }
+
+                // calls f(key, value) for every entry, in slot order
+                template<class F>
+                fn each(F f) {
+                        for (size_t i = 0; i < capacity(); ++i) {
+                                if (ctrl[i] >= 0) {
+                                        f(slots[i].key, slots[i].value);
+                                }
+                        }
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        each([&](const Key&, std::any& value) {
+                                t.value(value);
+                        });
+                }
+
+                fn trace_stores(gc::Tracer& t) -> void override {
+                        if (stored_all) {
+                                trace(t);
+                                return;
+                        }
+                        for (auto i : stores) {
+                                t.value(slots[i].value);
+                        }
+                }
+
+                fn forget() -> void override {
+                        stores.clear();
+                        stored_all = false;
+                }
+
+                fn external() const -> size_t override {
+                        return ctrl.size() + slots.size() * sizeof(Slot);
+                }
+        };
+
+        using map_ptr = Map*;
+
+        namespace {
+                gc::Traced<Map> traced;
+        }
+
+        fn make() -> map_ptr {
+                return gc::make<Map>();
+        }
+
+        fn is_map(const std::any& v) -> bool {
+                return v.type() == typeid(map_ptr);
+        }
+}
@@ -5,36 +5,279 @@
 #include "stmt.hh"
 #include "environment.hh"
 #include "errors.hh"
+#include "module.hh"
+#include "output.hh"
+#include "stats.hh"
+#include "profiler.hh"
+#include "parser.hh"
+#include "array.hh"
+#include "hashmap.hh"
+#include "native.hh"
+#include "builtins.hh"
+#include "function.hh"
+#include "object.hh"
+#include "gc.hh"
+#include "limits.hh"
+#include "debugger.hh"
+#include "trace.hh"
+#include "stack.hh"
 
 namespace interpreter {
+        // what the parent of a binary site swaps it for, see evaluate()
+        enum rewrite {
+                KEEP,
+                QUICKEN_NUMBERS,
+                QUICKEN_STRINGS,
+                DEOPTIMISE,
+        };
+
+        // the operator of a site quickened to numbers, nullptr if it has none
+        fn number_op(token::token_type type) -> std::any (*)(double, double) {
+                switch (type) {
+                case token::PLUS:          return [](double l, double r) -> std::any { return l + r; };
+                case token::MINUS:         return [](double l, double r) -> std::any { return l - r; };
+                case token::STAR:          return [](double l, double r) -> std::any { return l * r; };
+                case token::SLASH:         return [](double l, double r) -> std::any { return l / r; };
+                case token::GREATER:       return [](double l, double r) -> std::any { return l > r; };
+                case token::GREATER_EQUAL: return [](double l, double r) -> std::any { return l >= r; };
+                case token::LESS:          return [](double l, double r) -> std::any { return l < r; };
+                case token::LESS_EQUAL:    return [](double l, double r) -> std::any { return l <= r; };
+                case token::EQUAL_EQUAL:   return [](double l, double r) -> std::any { return l == r; };
+                case token::BANG_EQUAL:    return [](double l, double r) -> std::any { return l != r; };
+                default:                   return nullptr;
+                }
+        }
+
+        // Values the interpreter holds in members are roots of the heap,
+        // those in its native frames are found by the stack scan.
         class Interpreter : public ast::Visitor<std::any>,
-                            public stmt::Visitor<std::any>
+                            public stmt::Visitor<std::any>,
+                            public gc::Roots
         {
-                std::shared_ptr<environment::Environment> env =
-                        std::shared_ptr<environment::Environment>(
-                                new environment::Environment()
-                        );
+                // made in the constructor, once the roots are complete
+                environment::Environment* globals = nullptr;
+                environment::Environment* env = nullptr;
+
+                // modules already executed by this interpreter
+                std::unordered_set<module::Module*> imported;
+
+                output::Writer& out;
+
+                // maps being printed, a map inside itself prints as {...}
+                std::vector<const hashmap::Map*> printing;
+
+                // module being executed, nullptr for interactive input
+                const std::string* file = nullptr;
+                profiler::Profiler* profiler = nullptr;
+
+                // running closure, nullptr in top-level code
+                function::closure_ptr closure = nullptr;
+                // arguments of calls too wide for the stack
+                std::vector<const std::vector<std::any>*> spilled;
+                // a return stmt unwinds the statements of its call with
+                // this flag set and leaves its value in result
+                bool returning = false;
+                std::any result;
+
+                // binary sites are quickened, off to compare against them
+                bool quickening = true;
+                // set by a binary site as it returns, its node is swapped
+                // by the evaluate() below it, the one holding its slot
+                rewrite swap = KEEP;
+                // the node asking, the slot holds another one by then if
+                // the site ran again deeper in a recursion and was swapped
+                ast::Expr* swapping = nullptr;
+
+                // limits of every run; a step is a statement or a loop
+                // iteration, the budget is looked at once steps reaches
+                // next_check, the clock every clock_interval steps
+                limits::Limits quota;
+                uint64_t depth = 0;
+                uint64_t steps = 0;
+                uint64_t next_check = limits::none;
+                std::chrono::steady_clock::time_point deadline;
+                static constexpr uint64_t clock_interval = 4096;
+                // --debug, the budget is due on every step while attached
+                debugger::Debugger* debugger = nullptr;
+                // --trace, records what ran for a dump on failure
+                trace::Tracer* tracer = nullptr;
 
-                fn evaluate(std::shared_ptr<ast::Expr> expr) -> std::any {
+                // nested expressions and statements recurse through here
+                // and execute(), on a new stack segment when it runs low
+                fn evaluate(std::shared_ptr<ast::Expr>& expr) -> std::any {
+                        // one named result, a second return would cost
+                        // every call a move of it
+                        auto value = stack::low()
+                                ? stack::grow([&] { return expr->accept(*this); })
+                                : expr->accept(*this);
+                        if (swap != KEEP) {
+                                swap_node(expr);
+                        }
+                        return value;
+                }
+
+                // names are never swapped
+                fn evaluate(const std::shared_ptr<ast::Variable>& expr) -> std::any {
                         return expr->accept(*this);
                 }
 
-                fn execute(std::shared_ptr<stmt::Stmt> statement) {
-                        statement->accept(*this);
+                fn swap_node(std::shared_ptr<ast::Expr>& slot) -> void {
+                        auto to = std::exchange(swap, KEEP);
+                        if (slot.get() != swapping) {
+                                return;
+                        }
+
+                        if (to == DEOPTIMISE) {
+                                auto generic = static_cast<ast::Quickened*>(slot.get())->generic;
+                                generic->deopts++;
+                                slot = std::shared_ptr<ast::Expr>(slot, generic);
+                                return;
+                        }
+
+                        STATS_ADD(quickened, 1);
+                        auto generic = static_cast<ast::Binary*>(slot.get());
+                        ast::Quickened* quick;
+                        if (to == QUICKEN_NUMBERS) {
+                                if (generic->number == nullptr) {
+                                        generic->number = std::make_unique<ast::NumberBinary>(
+                                                generic, number_op(generic->op.type)
+                                        );
+                                }
+                                quick = generic->number.get();
+                        } else {
+                                if (generic->string == nullptr) {
+                                        generic->string = std::make_unique<ast::StringAdd>(generic);
+                                }
+                                quick = generic->string.get();
+                        }
+                        slot = std::shared_ptr<ast::Expr>(slot, quick);
+                }
+
+                // asks for a node quickened to the operands a generic site
+                // just saw, if there is one for them
+                fn quicken(ast::Binary& expr, std::any& left, std::any& right) {
+                        if (!quickening || expr.deopts >= ast::Binary::max_deopts) {
+                                return;
+                        }
+                        if (left.type() == typeid(double) && right.type() == typeid(double)) {
+                                if (number_op(expr.op.type) != nullptr) {
+                                        swap = QUICKEN_NUMBERS;
+                                        swapping = &expr;
+                                }
+                        } else if (expr.op.type == token::PLUS
+                                && left.type() == typeid(std::string)
+                                && right.type() == typeid(std::string)) {
+                                swap = QUICKEN_STRINGS;
+                                swapping = &expr;
+                        }
+                }
+
+                fn execute(const std::shared_ptr<stmt::Stmt>& statement) {
+                        STATS_ADD(statements, 1);
+                        if (profiler != nullptr) {
+                                profiler->at(file, statement->line);
+                        }
+                        if (tracer != nullptr) {
+                                tracer->statement(file, statement->line, depth);
+                        }
+                        try {
+                                step(statement.get());
+                                stack::guard([&] {
+                                        statement->accept(*this);
+                                });
+                        } catch (limits::exceeded& err) {
+                                throw errors::runtime_panic(
+                                        token::Token(token::FILE_EOF, "", std::any(), statement->line),
+                                        err.what()
+                                );
+                        }
+                }
+
+                // a statement about to run or a loop iteration, nullptr
+                fn step(const stmt::Stmt* at = nullptr) -> void {
+                        if (++steps >= next_check) {
+                                check_budget(at);
+                        }
+                }
+
+                fn check_budget(const stmt::Stmt* at) -> void {
+                        if (steps > quota.steps) {
+                                throw limits::exceeded(std::format("Step limit of {} exceeded.", quota.steps));
+                        }
+                        if (quota.time_ms != limits::none && std::chrono::steady_clock::now() >= deadline) {
+                                throw limits::exceeded(std::format("Time limit of {} ms exceeded.", quota.time_ms));
+                        }
+                        if (debugger != nullptr && at != nullptr) {
+                                debugger->at(debugger::Stop{file, at->line, depth, env, closure});
+                        }
+                        schedule();
+                }
+
+                fn schedule() -> void {
+                        next_check = quota.steps == limits::none ? limits::none : quota.steps + 1;
+                        if (quota.time_ms != limits::none) {
+                                next_check = std::min(next_check, steps + clock_interval);
+                        }
+                        if (debugger != nullptr) {
+                                next_check = 0;
+                        }
+                }
+
+                // strings made by concatenation, checked before they are
+                fn check_length(const token::Token& op, size_t size) {
+                        if (size > quota.string_length) {
+                                throw errors::runtime_panic(op,
+                                        std::format("String length limit of {} exceeded.", quota.string_length)
+                                );
+                        }
                 }
 
                 fn execute_block(
-                        std::vector<std::shared_ptr<stmt::Stmt>> statements,
-                        std::shared_ptr<environment::Environment> envi
+                        const std::vector<std::shared_ptr<stmt::Stmt>>& statements,
+                        environment::Environment* envi
                 ) {
                         auto previous = env;
-                                env = envi;
+                        env = envi;
+                        try {
                                 for (auto& statement : statements) {
                                         execute(statement);
+                                        if (returning) {
+                                                break;
+                                        }
                                 }
+                        } catch (...) {
+                                env = previous;
+                                throw;
+                        }
                         env = previous;
                 }
 
+                fn test(stmt::Condition& condition) -> bool {
+                        auto c = condition.comparison;
+                        if (c == nullptr) {
+                                auto value = evaluate(condition.expr);
+                                return is_truthy(value);
+                        }
+
+                        auto left = evaluate(c->left);
+                        auto right = evaluate(c->right);
+                        auto l = std::any_cast<double>(&left);
+                        auto r = std::any_cast<double>(&right);
+                        if (l == nullptr || r == nullptr) {
+                                auto value = binary(c->op, left, right);
+                                return is_truthy(value);
+                        }
+                        switch (c->op.type) {
+                        case token::GREATER:       return *l > *r;
+                        case token::GREATER_EQUAL: return *l >= *r;
+                        case token::LESS:          return *l < *r;
+                        case token::LESS_EQUAL:    return *l <= *r;
+                        case token::EQUAL_EQUAL:   return *l == *r;
+                        case token::BANG_EQUAL:    return *l != *r;
+                        default:                   return false;
+                        }
+                }
+
                 fn is_truthy(std::any& obj) -> bool {
                         if (!obj.has_value()) {
                                 return false;
@@ -67,9 +310,9 @@ namespace interpreter {
                                 return false;
                         }
 
-                        if (a.type() == typeid(std::wstring)
-                                && b.type() == typeid(std::wstring)) {
-                                return std::any_cast<std::wstring>(a) == std::any_cast<std::wstring>(b);
+                        if (a.type() == typeid(std::string)
+                                && b.type() == typeid(std::string)) {
+                                return std::any_cast<std::string>(a) == std::any_cast<std::string>(b);
                         }
 
                         if (a.type() == typeid(double)
@@ -77,106 +320,409 @@ namespace interpreter {
                                 return std::any_cast<double>(a) == std::any_cast<double>(b);
                         }
 
+                        if (array::is_array(a) && array::is_array(b)) {
+                                return array::equal(
+                                        *std::any_cast<array::array_ptr&>(a),
+                                        *std::any_cast<array::array_ptr&>(b)
+                                );
+                        }
+
+                        if (a.type() != b.type()) {
+                                return false;
+                        }
+
+                        if (a.type() == typeid(bool)) {
+                                return std::any_cast<bool>(a) == std::any_cast<bool>(b);
+                        }
+
+                        // functions, classes and instances are equal only
+                        // to themselves
+                        if (function::is_closure(a)) {
+                                return std::any_cast<function::closure_ptr&>(a)
+                                        == std::any_cast<function::closure_ptr&>(b);
+                        }
+
+                        if (object::is_instance(a)) {
+                                return std::any_cast<object::instance_ptr&>(a)
+                                        == std::any_cast<object::instance_ptr&>(b);
+                        }
+
+                        if (object::is_class(a)) {
+                                return std::any_cast<object::class_ptr&>(a)
+                                        == std::any_cast<object::class_ptr&>(b);
+                        }
+
+                        if (object::is_bound(a)) {
+                                auto& x = *std::any_cast<object::bound_ptr&>(a);
+                                auto& y = *std::any_cast<object::bound_ptr&>(b);
+                                return x.method == y.method && is_equal(x.receiver, y.receiver);
+                        }
+
+                        if (native::is_function(a)) {
+                                return std::any_cast<native::function_ptr>(a)
+                                        == std::any_cast<native::function_ptr>(b);
+                        }
+
+                        // maps are equal only to themselves
+                        if (hashmap::is_map(a)) {
+                                return std::any_cast<hashmap::map_ptr&>(a)
+                                        == std::any_cast<hashmap::map_ptr&>(b);
+                        }
+
                         // unreachable
-                        utils::panic(L"interpreter.hh: is_equal() method. objects is incomparable");
+                        utils::panic("interpreter.hh: is_equal() method. objects is incomparable");
                         return false;
                 }
 
 
-                fn stringify(std::any obj) -> std::wstring {
+                fn write_value(output::Writer& w, std::any& obj) {
                         if (!obj.has_value()) {
-                                return L"nil";
+                                w.write(std::string_view("nil"));
+                        } else if (obj.type() == typeid(double)) {
+                                w.write(std::any_cast<double>(obj));
+                        } else if (obj.type() == typeid(std::string)) {
+                                w.write(std::string_view(
+                                        *std::any_cast<std::string>(&obj)
+                                ));
+                        } else if (obj.type() == typeid(bool)) {
+                                w.write(std::string_view(
+                                        std::any_cast<bool>(obj) ? "true" : "false"
+                                ));
+                        } else if (array::is_array(obj)) {
+                                auto& arr = *std::any_cast<array::array_ptr&>(obj);
+                                w.write(std::string_view("["));
+                                for (size_t i = 0; i < arr.size(); ++i) {
+                                        if (i > 0) {
+                                                w.write(std::string_view(", "));
+                                        }
+                                        w.write(arr.data[i]);
+                                }
+                                w.write(std::string_view("]"));
+                        } else if (function::is_closure(obj)) {
+                                w.write(std::string_view("<fn "));
+                                w.write(std::string_view(std::any_cast<function::closure_ptr&>(obj)->name()));
+                                w.write(std::string_view(">"));
+                        } else if (object::is_instance(obj)) {
+                                w.write(std::string_view(std::any_cast<object::instance_ptr&>(obj)->klass->name));
+                                w.write(std::string_view(" instance"));
+                        } else if (object::is_class(obj)) {
+                                w.write(std::string_view(std::any_cast<object::class_ptr&>(obj)->name));
+                        } else if (object::is_bound(obj)) {
+                                w.write(std::string_view("<fn "));
+                                w.write(std::string_view(std::any_cast<object::bound_ptr&>(obj)->method->name()));
+                                w.write(std::string_view(">"));
+                        } else if (native::is_function(obj)) {
+                                w.write(std::string_view("<native fn "));
+                                w.write(std::string_view(std::any_cast<native::function_ptr>(obj)->name));
+                                w.write(std::string_view(">"));
+                        } else if (hashmap::is_map(obj)) {
+                                auto& map = *std::any_cast<hashmap::map_ptr&>(obj);
+                                if (std::find(printing.begin(), printing.end(), &map) != printing.end()) {
+                                        w.write(std::string_view("{...}"));
+                                        return;
+                                }
+                                printing.push_back(&map);
+                                w.write(std::string_view("{"));
+                                bool first = true;
+                                map.each([&](const hashmap::Key& key, std::any& value) {
+                                        if (!first) {
+                                                w.write(std::string_view(", "));
+                                        }
+                                        first = false;
+                                        auto k = key.to_any();
+                                        write_value(w, k);
+                                        w.write(std::string_view(": "));
+                                        write_value(w, value);
+                                });
+                                w.write(std::string_view("}"));
+                                printing.pop_back();
+                        } else {
+                                w.write(std::string_view("NO_STRING_FOR_OBJECT"));
                         }
+                }
 
-                        if (obj.type() == typeid(double)) {
-                                auto text = std::to_wstring(std::any_cast<double>(obj));
-                                if (text.ends_with(L".000000")) {
-                                        text = text.substr(0, text.length() - 7);
-                                }
-                                return text;
-                        } else if (obj.type() == typeid(std::wstring)) {
-                                return std::any_cast<std::wstring>(obj);
-                        } else if (obj.type() == typeid(bool)) {
-                                return std::any_cast<bool>(obj)
-                                        ? L"true"
-                                        : L"false";
+                // element-wise operators with at least one array operand
+                fn array_binary(token::Token& op, std::any& left, std::any& right) -> std::any {
+                        simd::op o;
+                        switch (op.type) {
+                        case token::PLUS:          o = simd::ADD; break;
+                        case token::MINUS:         o = simd::SUB; break;
+                        case token::STAR:          o = simd::MUL; break;
+                        case token::SLASH:         o = simd::DIV; break;
+                        case token::LESS:          o = simd::LT; break;
+                        case token::LESS_EQUAL:    o = simd::LE; break;
+                        case token::GREATER:       o = simd::GT; break;
+                        case token::GREATER_EQUAL: o = simd::GE; break;
+                        default:
+                                throw errors::runtime_panic(op, "Operator is not defined for arrays.");
                         }
 
-                        return L"NO_STRING_FOR_OBJECT";
+                        bool la = array::is_array(left);
+                        bool ra = array::is_array(right);
+                        if ((!la && left.type() != typeid(double))
+                                || (!ra && right.type() != typeid(double))) {
+                                throw errors::runtime_panic(op, "Operands must be arrays or numbers.");
+                        }
+                        if (la && ra
+                                && std::any_cast<array::array_ptr&>(left)->size()
+                                != std::any_cast<array::array_ptr&>(right)->size()) {
+                                throw errors::runtime_panic(op, "Array lengths differ.");
+                        }
+
+                        return array::map(o, left, right);
                 }
 
-        public:
-                fn interpret(std::vector<std::shared_ptr<stmt::Stmt>> statements) {
-                        try {
-                                for (auto& statement : statements) {
-                                        execute(statement);
-                                }
-                        } catch (errors::runtime_panic& err) {
-                                errors::runtime_err(err);
+                fn check_map(token::Token& where, std::any& obj) -> hashmap::Map& {
+                        if (!hashmap::is_map(obj)) {
+                                throw errors::runtime_panic(where, "Operand must be a map.");
                         }
+                        return *std::any_cast<hashmap::map_ptr&>(obj);
                 }
 
-                fn visitLiteralExpr(ast::Literal& expr) -> std::any {
-                        return expr.value;
+                fn check_key(token::Token& where, std::any& obj) -> hashmap::Key {
+                        hashmap::Key key;
+                        if (!hashmap::Key::from(obj, key)) {
+                                throw errors::runtime_panic(where, "Map keys must be numbers, strings or booleans.");
+                        }
+                        return key;
                 }
 
-                fn visitGroupingExpr(ast::Grouping& expr) -> std::any {
-                        return evaluate(expr.expression);
+                // finds a key without copying it
+                fn lookup(token::Token& where, hashmap::Map& map, std::any& key) -> std::any* {
+                        uint64_t hash = 0;
+                        if (!hashmap::Key::hash_of(key, hash)) {
+                                throw errors::runtime_panic(where, "Map keys must be numbers, strings or booleans.");
+                        }
+                        return map.find(key, hash);
                 }
 
-                fn visitUnaryExpr(ast::Unary& expr) -> std::any {
-                        auto right = evaluate(expr.right);
+                fn check_array(token::Token& where, std::any& obj) -> array::Array& {
+                        if (!array::is_array(obj)) {
+                                throw errors::runtime_panic(where, "Operand must be an array.");
+                        }
+                        return *std::any_cast<array::array_ptr&>(obj);
+                }
 
-                        switch (expr.op.type) {
-                        case token::BANG:
-                                return !is_truthy(right);
-                        case token::MINUS:
-                                check_number_operand(expr.op, right);
-                                return -(std::any_cast<double>(right));
-                        default:
-                                break;
+                fn check_index(token::Token& where, array::Array& arr, std::any& index) -> size_t {
+                        if (index.type() != typeid(double)) {
+                                throw errors::runtime_panic(where, "Index must be a number.");
+                        }
+                        auto i = std::any_cast<double>(index);
+                        if (i < 0 || i >= arr.size() || i != static_cast<size_t>(i)) {
+                                throw errors::runtime_panic(where, "Index out of range.");
                         }
+                        return static_cast<size_t>(i);
+                }
 
-                        // unreachable
-                        utils::panic(L"interpreter.hh: unary expr, unreachable code");
-                        return std::any();
+                fn check_arity(token::Token& paren, size_t min, size_t max, size_t n) {
+                        if (n >= min && n <= max) {
+                                return;
+                        }
+                        throw errors::runtime_panic(paren,
+                                min == max
+                                ? std::format(
+                                        "Expected {} arguments but got {}.",
+                                        min, n
+                                )
+                                : std::format(
+                                        "Expected {} to {} arguments but got {}.",
+                                        min, max, n
+                                )
+                        );
                 }
 
-                fn visitBinaryExpr(ast::Binary& expr) -> std::any {
-                        auto left = evaluate(expr.left);
-                        auto right = evaluate(expr.right);
+                fn check_instance(token::Token& where, std::any& obj, const char* msg) -> object::Instance& {
+                        auto i = std::any_cast<object::instance_ptr>(&obj);
+                        if (i == nullptr) {
+                                throw errors::runtime_panic(where, msg);
+                        }
+                        return **i;
+                }
 
-                        switch (expr.op.type) {
+                // where a property read finds its name, through the cache
+                // of the site
+                fn property(ast::Get& expr, object::Instance& instance) -> cache::Entry& {
+                        if (auto e = expr.cache.find(instance.shape->id)) {
+                                STATS_ADD(cache_hits, 1);
+                                return *e;
+                        }
+                        STATS_ADD(cache_misses, 1);
+
+                        // fields shadow methods
+                        cache::Entry e;
+                        e.shape = instance.shape->id;
+                        e.slot = instance.shape->find(expr.name.lexeme);
+                        if (e.slot < 0) {
+                                auto method = instance.klass->find_method(expr.name.lexeme);
+                                if (method == nullptr) {
+                                        throw errors::runtime_panic(expr.name,
+                                                std::format(
+                                                        "Undefined property '{}'.", expr.name.lexeme
+                                                )
+                                        );
+                                }
+                                e.method = *method;
+                        }
+                        return expr.cache.add(std::move(e));
+                }
+
+                // receiver is this for a method called off an instance
+                fn call(
+                        ast::Call& expr, std::any& callee,
+                        std::any* args, size_t n,
+                        const std::any* receiver = nullptr
+                ) -> std::any {
+                        if (auto c = std::any_cast<function::closure_ptr>(&callee)) {
+                                check_arity(expr.paren, (*c)->arity(), (*c)->arity(), n);
+                                return call_closure(*c, args, receiver);
+                        }
+
+                        if (auto k = std::any_cast<object::class_ptr>(&callee)) {
+                                auto& klass = *k;
+                                check_arity(expr.paren, klass->arity(), klass->arity(), n);
+                                std::any instance = object::make_instance(klass);
+                                if (klass->initializer != nullptr) {
+                                        call_closure(klass->initializer, args, &instance);
+                                }
+                                return instance;
+                        }
+
+                        if (auto b = std::any_cast<object::bound_ptr>(&callee)) {
+                                auto& bound = **b;
+                                check_arity(expr.paren, bound.method->arity(), bound.method->arity(), n);
+                                return call_closure(bound.method, args, &bound.receiver);
+                        }
+
+                        auto f = std::any_cast<native::function_ptr>(&callee);
+                        if (f == nullptr) {
+                                throw errors::runtime_panic(expr.paren, "Can only call functions.");
+                        }
+                        auto& function = **f;
+                        check_arity(expr.paren, function.min_arity, function.max_arity, n);
+                        STATS_ADD(native_calls, 1);
+                        native::Call call{expr.paren, args, n};
+                        return function.invoke(function, call);
+                }
+
+                // The body runs in a fresh environment on top of globals,
+                // enclosing scopes are reached through the upvalues only.
+                fn call_closure(
+                        const function::closure_ptr& f,
+                        std::any* args,
+                        const std::any* receiver = nullptr
+                ) -> std::any {
+                        STATS_ADD(calls, 1);
+                        if (++depth > quota.depth) {
+                                depth--;
+                                throw limits::exceeded(std::format("Call depth limit of {} exceeded.", quota.depth));
+                        }
+                        auto& declaration = *f->declaration;
+                        if (declaration.deferred.tokens != nullptr) [[unlikely]] {
+                                parser::expand(declaration);
+                        }
+                        auto frame = gc::make<environment::Environment>(globals);
+                        if (receiver != nullptr) {
+                                frame->define("this", *receiver);
+                        }
+                        for (size_t i = 0; i < declaration.params.size(); ++i) {
+                                auto& param = declaration.params[i];
+                                if (param.boxed) {
+                                        frame->define(param.name.lexeme, function::make_cell(std::move(args[i])));
+                                } else {
+                                        frame->define(param.name.lexeme, std::move(args[i]));
+                                }
+                        }
+
+                        auto caller = closure;
+                        auto caller_file = file;
+                        closure = f;
+                        file = f->file;
+                        try {
+                                profiler::Scope profiled(profiler, file, declaration.line);
+                                execute_block(declaration.body, frame);
+                        } catch (...) {
+                                closure = caller;
+                                file = caller_file;
+                                depth--;
+                                throw;
+                        }
+                        closure = caller;
+                        file = caller_file;
+                        depth--;
+
+                        if (!returning) {
+                                return declaration.initializer ? *receiver : std::any();
+                        }
+                        returning = false;
+                        if (declaration.initializer) {
+                                result.reset();
+                                return *receiver;
+                        }
+                        return std::exchange(result, {});
+                }
+
+                fn binary(token::Token& op, std::any& left, std::any& right) -> std::any {
+                        // two numbers, checked with one type test each
+                        auto l = std::any_cast<double>(&left);
+                        auto r = std::any_cast<double>(&right);
+                        if (l != nullptr && r != nullptr) {
+                                switch (op.type) {
+                                case token::PLUS:          return *l + *r;
+                                case token::MINUS:         return *l - *r;
+                                case token::STAR:          return *l * *r;
+                                case token::SLASH:         return *l / *r;
+                                case token::GREATER:       return *l > *r;
+                                case token::GREATER_EQUAL: return *l >= *r;
+                                case token::LESS:          return *l < *r;
+                                case token::LESS_EQUAL:    return *l <= *r;
+                                case token::EQUAL_EQUAL:   return *l == *r;
+                                case token::BANG_EQUAL:    return *l != *r;
+                                default:                   break;
+                                }
+                        }
+
+                        if (array::is_array(left) || array::is_array(right)) {
+                                if (op.type != token::EQUAL_EQUAL
+                                        && op.type != token::BANG_EQUAL) {
+                                        return array_binary(op, left, right);
+                                }
+                        }
+
+                        switch (op.type) {
                         case token::GREATER:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) > std::any_cast<double>(right);
                         case token::GREATER_EQUAL:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) >= std::any_cast<double>(right);
                         case token::LESS:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) < std::any_cast<double>(right);
                         case token::LESS_EQUAL:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) <= std::any_cast<double>(right);
                         case token::MINUS:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) - std::any_cast<double>(right);
                         case token::PLUS:
                                 if (left.type() == typeid(double) && right.type() == typeid(double)) {
                                         return std::any_cast<double>(left) + std::any_cast<double>(right);
                                 }
 
-                                if (left.type() == typeid(std::wstring) && right.type() == typeid(std::wstring)) {
-                                        return std::any_cast<std::wstring>(left) + std::any_cast<std::wstring>(right);
+                                if (left.type() == typeid(std::string) && right.type() == typeid(std::string)) {
+                                        STATS_ADD(concatenations, 1);
+                                        auto& l = std::any_cast<std::string&>(left);
+                                        auto& r = std::any_cast<std::string&>(right);
+                                        check_length(op, l.size() + r.size());
+                                        return l + r;
                                 }
 
-                                throw errors::runtime_panic(expr.op, "Operands must be two numbers or two strings.");
+                                throw errors::runtime_panic(op, "Operands must be two numbers or two strings.");
                         case token::SLASH:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left) / std::any_cast<double>(right);
                         case token::STAR:
-                                check_number_operands(expr.op, left, right);
+                                check_number_operands(op, left, right);
                                 return std::any_cast<double>(left)  * std::any_cast<double>(right);
                         case token::BANG_EQUAL:
                                 return !is_equal(left, right);
@@ -187,20 +733,405 @@ namespace interpreter {
                         }
 
                         // unreachable
-                        utils::panic(L"interpreter.hh: binary expr, unreachable code");
+                        utils::panic("interpreter.hh: binary expr, unreachable code");
+                        return std::any();
+                }
+
+        public:
+                Interpreter(
+                        output::Writer& o = output::stdout_writer(),
+                        const native::Registry& natives = builtins::registry()
+                ) : out(o)
+                {
+                        globals = gc::make<environment::Environment>();
+                        env = globals;
+                        for (auto& f : natives) {
+                                globals->define(f.name, native::function_ptr(&f));
+                        }
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.object(globals);
+                        t.object(env);
+                        t.object(closure);
+                        t.value(result);
+                        for (auto args : spilled) {
+                                for (auto& v : *args) {
+                                        t.value(v);
+                                }
+                        }
+                }
+
+                fn set_file(const std::string* f) {
+                        file = f;
+                }
+
+                // the script being run, which an import cycle back to it
+                // finds executed already
+                fn set_root(module::Module* m) {
+                        file = &m->path;
+                        imported.insert(m);
+                }
+
+                fn set_profiler(profiler::Profiler* p) {
+                        profiler = p;
+                }
+
+                fn set_quickening(bool on) {
+                        quickening = on;
+                }
+
+                // the stack's for the thread calling
+                fn set_limits(const limits::Limits& l) {
+                        quota = l;
+                        stack::set_limit(l.stack_bytes);
+                }
+
+                fn set_tracer(trace::Tracer* t) {
+                        tracer = t;
+                }
+
+                // the last record of a traced run, dumped with the others
+                fn trace_error(const errors::runtime_panic& err) {
+                        if (tracer != nullptr) {
+                                tracer->error(err.token.line, err.what());
+                        }
+                }
+
+                fn set_debugger(debugger::Debugger* d) {
+                        debugger = d;
+                        d->show = [this](std::any& value) {
+                                return show(value);
+                        };
+                        schedule();
+                }
+
+                // a value as print writes it
+                fn show(std::any& value) -> std::string {
+                        output::MemorySink sink;
+                        {
+                                output::Writer w(sink);
+                                write_value(w, value);
+                        }
+                        return sink.data;
+                }
+
+                // a global of the host, defined ahead of a run
+                fn define(const std::string& name, std::any value) {
+                        globals->define(name, std::move(value));
+                }
+
+                // a global after a run, throws if it is not defined
+                fn global(const std::string& name) -> std::any {
+                        return globals->get(token::Token(token::IDENTIFIER, name, std::any(), 0));
+                }
+
+                // top-level statements, a runtime error is left to the caller
+                fn run(const std::vector<std::shared_ptr<stmt::Stmt>>& statements) {
+                        alloc::Scope scope(alloc::INTERPRETER);
+                        // every run gets the whole budget
+                        steps = 0;
+                        if (quota.time_ms != limits::none) {
+                                deadline = std::chrono::steady_clock::now()
+                                        + std::chrono::milliseconds(quota.time_ms);
+                        }
+                        schedule();
+                        for (auto& statement : statements) {
+                                execute(statement);
+                        }
+                }
+
+                fn interpret(std::vector<std::shared_ptr<stmt::Stmt>> statements) {
+                        try {
+                                run(statements);
+                        } catch (errors::runtime_panic& err) {
+                                // keep printed output ahead of the error
+                                out.flush();
+                                trace_error(err);
+                                errors::runtime_err(err);
+                        }
+                }
+
+                fn visitLiteralExpr(ast::Literal& expr) -> std::any {
+                        return expr.value;
+                }
+
+                fn visitGroupingExpr(ast::Grouping& expr) -> std::any {
+                        return evaluate(expr.expression);
+                }
+
+                fn visitUnaryExpr(ast::Unary& expr) -> std::any {
+                        auto right = evaluate(expr.right);
+
+                        switch (expr.op.type) {
+                        case token::BANG:
+                                return !is_truthy(right);
+                        case token::MINUS:
+                                check_number_operand(expr.op, right);
+                                return -(std::any_cast<double>(right));
+                        default:
+                                break;
+                        }
+
+                        // unreachable
+                        utils::panic("interpreter.hh: unary expr, unreachable code");
                         return std::any();
                 }
 
+                fn visitBinaryExpr(ast::Binary& expr) -> std::any {
+                        STATS_ADD(generic_binaries, 1);
+                        auto left = evaluate(expr.left);
+                        auto right = evaluate(expr.right);
+                        auto value = binary(expr.op, left, right);
+                        quicken(expr, left, right);
+                        return value;
+                }
+
+                fn visitNumberBinaryExpr(ast::NumberBinary& expr) -> std::any {
+                        auto left = evaluate(expr.generic->left);
+                        auto right = evaluate(expr.generic->right);
+                        auto l = std::any_cast<double>(&left);
+                        auto r = std::any_cast<double>(&right);
+                        if (l == nullptr || r == nullptr) {
+                                return deoptimise(expr, left, right);
+                        }
+                        STATS_ADD(quick_hits, 1);
+                        return expr.apply(*l, *r);
+                }
+
+                fn visitStringAddExpr(ast::StringAdd& expr) -> std::any {
+                        auto left = evaluate(expr.generic->left);
+                        auto right = evaluate(expr.generic->right);
+                        auto l = std::any_cast<std::string>(&left);
+                        auto r = std::any_cast<std::string>(&right);
+                        if (l == nullptr || r == nullptr) {
+                                return deoptimise(expr, left, right);
+                        }
+                        STATS_ADD(quick_hits, 1);
+                        STATS_ADD(concatenations, 1);
+                        check_length(expr.generic->op, l->size() + r->size());
+                        // left is a copy already, append in place
+                        l->append(*r);
+                        return left;
+                }
+
+                // a quickened site missed: the generic path, then its node
+                // goes back in
+                fn deoptimise(ast::Quickened& expr, std::any& left, std::any& right) -> std::any {
+                        STATS_ADD(quick_misses, 1);
+                        auto value = binary(expr.generic->op, left, right);
+                        swap = DEOPTIMISE;
+                        swapping = &expr;
+                        return value;
+                }
+
                 fn visitVariableExpr(ast::Variable& expr) -> std::any {
+                        switch (expr.where) {
+                        case ast::UPVALUE: {
+                                auto& v = closure->upvalues[expr.upvalue];
+                                if (expr.boxed) {
+                                        return std::any_cast<function::cell_ptr&>(v)->value;
+                                }
+                                return v;
+                        }
+                        case ast::SELF:
+                                return closure;
+                        case ast::ENVIRONMENT:
+                                break;
+                        }
+
+                        STATS_ADD(lookups, 1);
+                        if (expr.boxed) {
+                                return std::any_cast<function::cell_ptr>(env->get(expr.name))->value;
+                        }
                         return env->get(expr.name);
                 }
 
                 fn visitAssignExpr(ast::Assign& expr) -> std::any {
                         auto value = evaluate(expr.value);
-                        env->assign(expr.name, value);
+                        if (tracer != nullptr) {
+                                tracer->assign(trace::ASSIGN, expr.trace_name, expr.name.lexeme, value);
+                        }
+                        // an assigned upvalue is always boxed
+                        if (expr.where == ast::UPVALUE) {
+                                std::any_cast<function::cell_ptr&>(closure->upvalues[expr.upvalue])->set(value);
+                                return value;
+                        }
+
+                        STATS_ADD(lookups, 1);
+                        if (expr.boxed) {
+                                std::any_cast<function::cell_ptr>(env->get(expr.name))->set(value);
+                        } else {
+                                env->assign(expr.name, value);
+                        }
                         return value;
                 }
 
+                fn visitCallExpr(ast::Call& expr) -> std::any {
+                        // obj.name() calls a method without binding it
+                        std::any callee;
+                        std::any receiver;
+                        if (expr.method != nullptr) {
+                                receiver = evaluate(expr.method->object);
+                                auto& instance = check_instance(
+                                        expr.method->name, receiver, "Only instances have properties."
+                                );
+                                auto& e = property(*expr.method, instance);
+                                if (e.slot >= 0) {
+                                        callee = instance.fields[e.slot];
+                                        receiver.reset();
+                                } else {
+                                        callee = e.method;
+                                }
+                        } else {
+                                callee = evaluate(expr.callee);
+                        }
+                        auto self = receiver.has_value() ? &receiver : nullptr;
+                        auto n = expr.arguments.size();
+
+                        // small calls keep their arguments on the stack
+                        if (n <= native::small_arity) {
+                                std::array<std::any, native::small_arity> args;
+                                for (size_t i = 0; i < n; ++i) {
+                                        args[i] = evaluate(expr.arguments[i]);
+                                }
+                                return call(expr, callee, args.data(), n, self);
+                        }
+
+                        std::vector<std::any> args;
+                        args.reserve(n);
+                        spilled.push_back(&args);
+                        try {
+                                for (auto& arg : expr.arguments) {
+                                        args.push_back(evaluate(arg));
+                                }
+                                auto value = call(expr, callee, args.data(), n, self);
+                                spilled.pop_back();
+                                return value;
+                        } catch (...) {
+                                spilled.pop_back();
+                                throw;
+                        }
+                }
+
+                fn visitIndexExpr(ast::Index& expr) -> std::any {
+                        auto object = evaluate(expr.object);
+                        auto index = evaluate(expr.index);
+                        if (hashmap::is_map(object)) {
+                                auto v = lookup(expr.bracket, check_map(expr.bracket, object), index);
+                                if (v == nullptr) {
+                                        throw errors::runtime_panic(expr.bracket, "Undefined key.");
+                                }
+                                return *v;
+                        }
+                        auto& arr = check_array(expr.bracket, object);
+                        return arr.data[check_index(expr.bracket, arr, index)];
+                }
+
+                fn visitIndexSetExpr(ast::IndexSet& expr) -> std::any {
+                        auto object = evaluate(expr.object);
+                        auto index = evaluate(expr.index);
+                        auto value = evaluate(expr.value);
+                        if (hashmap::is_map(object)) {
+                                check_map(expr.bracket, object).set(check_key(expr.bracket, index), value);
+                                return value;
+                        }
+                        auto& arr = check_array(expr.bracket, object);
+                        auto i = check_index(expr.bracket, arr, index);
+                        check_number_operand(expr.bracket, value);
+                        arr.data[i] = std::any_cast<double>(value);
+                        return value;
+                }
+
+                fn visitArrayLiteralExpr(ast::ArrayLiteral& expr) -> std::any {
+                        auto arr = array::make(expr.elements.size());
+                        for (size_t i = 0; i < expr.elements.size(); ++i) {
+                                auto value = evaluate(expr.elements[i]);
+                                if (value.type() != typeid(double)) {
+                                        throw errors::runtime_panic(expr.bracket, "Array elements must be numbers.");
+                                }
+                                arr->data[i] = std::any_cast<double>(value);
+                        }
+                        return arr;
+                }
+
+                fn visitLogicalExpr(ast::Logical& expr) -> std::any {
+                        auto left = evaluate(expr.left);
+                        if (expr.op.type == token::OR) {
+                                if (is_truthy(left)) {
+                                        return left;
+                                }
+                        } else if (!is_truthy(left)) {
+                                return left;
+                        }
+                        return evaluate(expr.right);
+                }
+
+                fn visitGetExpr(ast::Get& expr) -> std::any {
+                        auto object = evaluate(expr.object);
+                        auto& instance = check_instance(expr.name, object, "Only instances have properties.");
+                        auto& e = property(expr, instance);
+                        if (e.slot >= 0) {
+                                return instance.fields[e.slot];
+                        }
+                        return object::bind(object, e.method);
+                }
+
+                // a new field moves the instance to the next shape
+                fn visitSetExpr(ast::Set& expr) -> std::any {
+                        auto object = evaluate(expr.object);
+                        auto& instance = check_instance(expr.name, object, "Only instances have fields.");
+                        auto value = evaluate(expr.value);
+
+                        auto e = expr.cache.find(instance.shape->id);
+                        if (e != nullptr) {
+                                STATS_ADD(cache_hits, 1);
+                        } else {
+                                STATS_ADD(cache_misses, 1);
+                                cache::Entry entry;
+                                entry.shape = instance.shape->id;
+                                entry.slot = instance.shape->find(expr.name.lexeme);
+                                if (entry.slot < 0) {
+                                        entry.slot = instance.fields.size();
+                                        entry.to = instance.shape->add(expr.name.lexeme);
+                                }
+                                e = &expr.cache.add(std::move(entry));
+                        }
+
+                        gc::barrier(&instance);
+                        if (e->to != nullptr) {
+                                instance.shape = e->to;
+                                instance.fields.push_back(value);
+                        } else {
+                                instance.fields[e->slot] = value;
+                        }
+                        return value;
+                }
+
+                fn visitSuperExpr(ast::Super& expr) -> std::any {
+                        auto superclass = evaluate(expr.superclass);
+                        auto self = evaluate(expr.self);
+                        auto method = std::any_cast<object::class_ptr&>(superclass)->find_method(expr.method.lexeme);
+                        if (method == nullptr) {
+                                throw errors::runtime_panic(expr.method,
+                                        std::format(
+                                                "Undefined property '{}'.", expr.method.lexeme
+                                        )
+                                );
+                        }
+                        return object::bind(self, *method);
+                }
+
+                fn visitMapLiteralExpr(ast::MapLiteral& expr) -> std::any {
+                        auto map = hashmap::make();
+                        for (size_t i = 0; i < expr.keys.size(); ++i) {
+                                auto key = evaluate(expr.keys[i]);
+                                auto value = evaluate(expr.values[i]);
+                                map->set(check_key(expr.brace, key), value);
+                        }
+                        return map;
+                }
+
                 // ---------------STATEMENTS---------------
 
                 fn visitExpressionStmt(stmt::Expression& stmt) -> std::any {
@@ -210,7 +1141,8 @@ namespace interpreter {
 
                 fn visitPrintStmt(stmt::Print& stmt) -> std::any {
                         auto value = evaluate(stmt.expression);
-                        std::wcout << stringify(value) << std::endl;
+                        write_value(out, value);
+                        out.newline();
                         return std::any();
                 }
 
@@ -220,18 +1152,204 @@ namespace interpreter {
                         if (stmt.initializer != nullptr) {
                                 value = evaluate(stmt.initializer);
                         }
+                        if (tracer != nullptr) {
+                                tracer->assign(trace::DEFINE, stmt.trace_name, stmt.name.lexeme, value);
+                        }
 
-                        env->define(stmt.name.lexeme, value);
+                        if (stmt.boxed) {
+                                env->define(stmt.name.lexeme, function::make_cell(std::move(value)));
+                        } else {
+                                env->define(stmt.name.lexeme, value);
+                        }
                         return std::any();
                 }
 
                 fn visitBlockStmt(stmt::Block& stmt) -> std::any {
-                        execute_block(
-                                stmt.statements,
-                                std::shared_ptr<environment::Environment>(
-                                        new environment::Environment(env)
-                                )
-                        );
+                        profiler::Scope profiled(profiler, file, stmt.line);
+                        if (stmt.deferred.tokens != nullptr) [[unlikely]] {
+                                parser::expand(stmt);
+                        }
+                        if (stmt.declares) {
+                                execute_block(
+                                        stmt.statements,
+                                        gc::make<environment::Environment>(env)
+                                );
+                        } else {
+                                for (auto& statement : stmt.statements) {
+                                        execute(statement);
+                                        if (returning) {
+                                                break;
+                                        }
+                                }
+                        }
+                        return {};
+                }
+
+                fn visitIfStmt(stmt::If& stmt) -> std::any {
+                        if (test(stmt.condition)) {
+                                execute(stmt.then_branch);
+                        } else if (stmt.else_branch != nullptr) {
+                                execute(stmt.else_branch);
+                        }
+                        return {};
+                }
+
+                // A block body gets one environment for the whole loop,
+                // emptied after each iteration, or none if it declares
+                // nothing. The loop is a single profiler frame.
+                fn visitWhileStmt(stmt::While& stmt) -> std::any {
+                        profiler::Scope profiled(profiler, file, stmt.line);
+
+                        uint64_t iterations = 0;
+                        auto block = stmt.block;
+                        if (block != nullptr && block->deferred.tokens != nullptr) [[unlikely]] {
+                                parser::expand(*block);
+                        }
+                        if (block != nullptr && block->declares) {
+                                auto body = gc::make<environment::Environment>(env);
+                                while (test(stmt.condition)) {
+                                        iterations++;
+                                        step();
+                                        execute_block(block->statements, body);
+                                        body->clear();
+                                        if (returning) {
+                                                break;
+                                        }
+                                        if (stmt.increment != nullptr) {
+                                                evaluate(stmt.increment);
+                                        }
+                                }
+                        } else {
+                                while (test(stmt.condition)) {
+                                        iterations++;
+                                        step();
+                                        if (block != nullptr) {
+                                                for (auto& statement : block->statements) {
+                                                        execute(statement);
+                                                        if (returning) {
+                                                                break;
+                                                        }
+                                                }
+                                        } else {
+                                                execute(stmt.body);
+                                        }
+                                        if (returning) {
+                                                break;
+                                        }
+                                        if (stmt.increment != nullptr) {
+                                                evaluate(stmt.increment);
+                                        }
+                                }
+                        }
+
+                        STATS_LOOP(file, stmt.line, iterations);
+                        return {};
+                }
+
+                fn make_closure(stmt::Function& stmt) -> function::closure_ptr {
+                        auto f = function::make(stmt.shared_from_this(), file);
+                        STATS_ADD(closures, 1);
+                        STATS_ADD(captures, stmt.captures.size());
+                        for (auto& c : stmt.captures) {
+                                if (c.upvalue == -1) {
+                                        f->upvalues.push_back(env->get(c.name));
+                                } else {
+                                        f->upvalues.push_back(closure->upvalues[c.upvalue]);
+                                }
+                        }
+                        return f;
+                }
+
+                // A boxed name gets its cell before the closure is made,
+                // for a body that captures its own function. The same
+                // goes for classes and their methods.
+                fn define_boxed(const token::Token& name, bool boxed) -> function::cell_ptr {
+                        if (!boxed) {
+                                return nullptr;
+                        }
+                        auto cell = function::make_cell({});
+                        env->define(name.lexeme, cell);
+                        return cell;
+                }
+
+                fn visitFunctionStmt(stmt::Function& stmt) -> std::any {
+                        auto cell = define_boxed(stmt.name, stmt.boxed);
+                        auto f = make_closure(stmt);
+                        if (cell != nullptr) {
+                                cell->set(f);
+                        } else {
+                                env->define(stmt.name.lexeme, f);
+                        }
+                        return {};
+                }
+
+                fn visitClassStmt(stmt::Class& stmt) -> std::any {
+                        std::any superclass;
+                        object::class_ptr super = nullptr;
+                        if (stmt.superclass != nullptr) {
+                                superclass = evaluate(stmt.superclass);
+                                auto k = std::any_cast<object::class_ptr>(&superclass);
+                                if (k == nullptr) {
+                                        throw errors::runtime_panic(stmt.superclass->name, "Superclass must be a class.");
+                                }
+                                super = *k;
+                        }
+
+                        auto cell = define_boxed(stmt.name, stmt.boxed);
+                        auto klass = object::make_class(stmt.name.lexeme, super);
+
+                        // methods capture super from an environment of its own
+                        auto previous = env;
+                        if (super != nullptr) {
+                                env = gc::make<environment::Environment>(env);
+                                env->define("super", superclass);
+                        }
+                        // making a closure may promote the class
+                        for (auto& method : stmt.methods) {
+                                klass->methods[method->name.lexeme] = make_closure(*method);
+                                gc::barrier(klass);
+                        }
+                        env = previous;
+                        if (auto init = klass->find_method("init")) {
+                                klass->initializer = *init;
+                        }
+
+                        if (cell != nullptr) {
+                                cell->set(klass);
+                        } else {
+                                env->define(stmt.name.lexeme, klass);
+                        }
+                        return {};
+                }
+
+                fn visitReturnStmt(stmt::Return& stmt) -> std::any {
+                        result = stmt.value != nullptr ? evaluate(stmt.value) : std::any();
+                        returning = true;
+                        return {};
+                }
+
+                fn visitImportStmt(stmt::Import& stmt) -> std::any {
+                        if (stmt.module == nullptr) {
+                                throw errors::runtime_panic(stmt.keyword,
+                                        std::format(
+                                                "Module '{}' is not loaded.", stmt.path
+                                        )
+                                );
+                        }
+
+                        // module body runs once, into globals
+                        if (imported.insert(stmt.module).second) {
+                                auto importer = file;
+                                file = &stmt.module->path;
+                                try {
+                                        profiler::Scope profiled(profiler, file, 0);
+                                        execute_block(stmt.module->statements, globals);
+                                } catch (...) {
+                                        file = importer;
+                                        throw;
+                                }
+                                file = importer;
+                        }
                         return {};
                 }
         };
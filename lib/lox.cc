@@ -0,0 +1,224 @@
+// libcpplox, the embedding API of lox.hh over the interpreter headers.
+// This is the only translation unit of the library.
+
+#include "lox.hh"
+#include "../cpplox.hh"
+#include "../errors.hh"
+#include "../scanner.hh"
+#include "../parser.hh"
+#include "../module.hh"
+#include "../interpreter.hh"
+#include "../output.hh"
+#include "../gc.hh"
+#include "../limits.hh"
+
+namespace lox {
+        namespace {
+                // compiles share the error flag and the collected messages
+                std::mutex compiling;
+
+                // hands the buffered output of a state to the host
+                class HostSink : public output::Sink {
+                        Output& host;
+
+                public:
+                        HostSink(
+                                Output& h
+                        ) : host(h)
+                        {}
+
+                        fn write(const char* data, size_t size) -> void {
+                                host.write(data, size);
+                        }
+                };
+
+                fn to_any(const Value& v) -> std::any {
+                        return std::visit([](auto& x) -> std::any {
+                                using T = std::decay_t<decltype(x)>;
+                                if constexpr (std::is_same_v<T, std::monostate>) {
+                                        return std::any();
+                                } else {
+                                        return x;
+                                }
+                        }, v);
+                }
+
+                fn to_value(const std::string& name, const std::any& a) -> Value {
+                        if (!a.has_value()) {
+                                return std::monostate();
+                        }
+                        if (auto d = std::any_cast<double>(&a)) {
+                                return *d;
+                        }
+                        if (auto b = std::any_cast<bool>(&a)) {
+                                return *b;
+                        }
+                        if (auto s = std::any_cast<std::string>(&a)) {
+                                return *s;
+                        }
+                        throw Error(std::format("'{}' is not nil, a boolean, a number or a string.", name), 0);
+                }
+
+                fn to_limits(const Limits& l) -> limits::Limits {
+                        auto limit = [](size_t n) -> uint64_t { return n == 0 ? limits::none : n; };
+                        limits::Limits q;
+                        q.heap_bytes = limit(l.heap_bytes);
+                        q.depth = limit(l.depth);
+                        q.string_length = limit(l.string_length);
+                        q.steps = limit(l.steps);
+                        q.time_ms = limit(l.time_ms);
+                        return q;
+                }
+        }
+
+        // The interpreter is made and destroyed with the state's heap in
+        // place, it registers as roots of it.
+        class State::Impl {
+        public:
+                gc::Heap heap;
+                std::unique_ptr<output::Sink> sink;
+                output::Writer out;
+                std::unique_ptr<interpreter::Interpreter> it;
+                limits::Limits quota;
+
+                Impl(
+                        Output* host
+                ) : sink(host != nullptr
+                                ? std::unique_ptr<output::Sink>(new HostSink(*host))
+                                : std::unique_ptr<output::Sink>(new output::FdSink(STDOUT_FILENO))),
+                        out(*sink)
+                {
+                        start();
+                }
+
+                ~Impl() {
+                        gc::Use use(heap);
+                        it.reset();
+                }
+
+                fn start() -> void {
+                        gc::Use use(heap);
+                        it = std::make_unique<interpreter::Interpreter>(out);
+                        it->set_limits(quota);
+                }
+
+                fn reset() {
+                        {
+                                gc::Use use(heap);
+                                it.reset();
+                                heap.clear();
+                        }
+                        start();
+                }
+        };
+
+        State::State(Output* out) : impl(std::make_unique<Impl>(out))
+        {}
+
+        State::~State() = default;
+        State::State(State&&) noexcept = default;
+        fn State::operator=(State&&) noexcept -> State& = default;
+
+        fn State::set(const std::string& name, Value value) -> void {
+                gc::Use use(impl->heap);
+                impl->it->define(name, to_any(value));
+        }
+
+        fn State::get(const std::string& name) const -> Value {
+                try {
+                        return to_value(name, impl->it->global(name));
+                } catch (errors::runtime_panic& err) {
+                        throw Error(err.what(), 0);
+                }
+        }
+
+        fn State::set_limits(const Limits& limits) -> void {
+                impl->quota = to_limits(limits);
+                impl->heap.set_quota(impl->quota.heap_bytes);
+                impl->it->set_limits(impl->quota);
+        }
+
+        fn State::reset() -> void {
+                impl->reset();
+        }
+
+        // The tree of the script and the loader owning its imports. Runs
+        // write to the tree: quickened sites, property caches and the
+        // bodies the parser deferred.
+        class Program::Impl {
+        public:
+                module::Loader loader;
+                std::vector<std::shared_ptr<stmt::Stmt>> statements;
+                std::mutex running;
+        };
+
+        Program::Program(std::shared_ptr<Impl> i) : impl(std::move(i))
+        {}
+
+        fn Program::compile(std::string_view source, const std::string& dir) -> Program {
+                std::lock_guard lock(compiling);
+                std::vector<std::string> messages;
+                {
+                        std::lock_guard report(errors::report_mtx);
+                        errors::collected = &messages;
+                        errors::hadError = false;
+                }
+                // messages go back to stderr however the compile ends
+                auto restore = [] {
+                        std::lock_guard report(errors::report_mtx);
+                        errors::collected = nullptr;
+                };
+
+                auto impl = std::make_shared<Impl>();
+                try {
+                        scanner::Scanner sc{std::string(source)};
+                        auto tokens = sc.scan_tokens();
+                        parser::Parser pr(std::move(tokens));
+                        impl->statements = pr.parse();
+                        impl->loader.link(impl->statements, dir);
+                        impl->loader.wait();
+                } catch (...) {
+                        restore();
+                        throw;
+                }
+                restore();
+
+                if (errors::hadError) {
+                        errors::hadError = false;
+                        std::string all;
+                        for (auto& m : messages) {
+                                all.append(m).push_back('\n');
+                        }
+                        throw Error(all, 0);
+                }
+                return Program(std::move(impl));
+        }
+
+        fn Program::run(Output* out, const Globals& globals) const -> void {
+                State state(out);
+                for (auto& [name, value] : globals) {
+                        state.set(name, value);
+                }
+                run(state);
+        }
+
+        fn Program::run(State& state) const -> void {
+                std::lock_guard lock(impl->running);
+                auto& s = *state.impl;
+                gc::Use use(s.heap);
+                try {
+                        s.it->run(impl->statements);
+                } catch (errors::runtime_panic& err) {
+                        s.out.flush();
+                        throw Error(
+                                std::format("[ line {} ] {}", err.token.line, err.what()),
+                                err.token.line
+                        );
+                } catch (limits::exceeded& err) {
+                        // a breach outside any statement
+                        s.out.flush();
+                        throw Error(err.what(), 0);
+                }
+                s.out.flush();
+        }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+// Embedding API of cpplox, the only header a host includes; link with
+// libcpplox.a or libcpplox.so. A Program is source compiled once:
+// scanned, parsed and resolved, with its imports. It runs any number of
+// times, each run on a State that holds the globals and the heap of the
+// values the run makes.
+//
+//   auto program = lox::Program::compile("print greeting + name;");
+//   lox::State state;
+//   state.set("greeting", "hello ");
+//   state.set("name", "world");
+//   program.run(state);
+//
+// Runs of one program are serialised, they warm caches kept in its tree.
+// A state is used by one thread at a time, any thread.
+#define LOX_API __attribute__((visibility("default")))
+
+namespace lox {
+        // nil, booleans, numbers and strings cross the boundary
+        using Value = std::variant<std::monostate, bool, double, std::string>;
+
+        using Globals = std::vector<std::pair<std::string, Value>>;
+
+        // syntax errors of a compile, one per line, or the error a run
+        // stopped at
+        class LOX_API Error : public std::runtime_error {
+        public:
+                // line of a runtime error, 0 for syntax errors
+                int line;
+
+                Error(
+                        const std::string& msg,
+                        int l
+                ) : std::runtime_error(msg), line(l)
+                {}
+        };
+
+        // hard limits of the runs on a state, 0 for none; a run that
+        // breaches one stops with an Error
+        class LOX_API Limits {
+        public:
+                // live objects of the state and their payloads
+                size_t heap_bytes = 0;
+                // nested calls
+                size_t depth = 0;
+                // bytes of a string made by concatenation
+                size_t string_length = 0;
+                // statements executed and loop iterations, per run
+                size_t steps = 0;
+                // wall clock per run
+                size_t time_ms = 0;
+        };
+
+        // where print goes, written once a run ends or its buffer fills
+        class LOX_API Output {
+        public:
+                virtual ~Output() = default;
+                virtual auto write(const char* data, size_t size) -> void = 0;
+        };
+
+        // Globals and heap of runs. A run sees the globals the ones before
+        // it left, reset() drops them and frees the whole heap at once.
+        class LOX_API State {
+                friend class Program;
+                class Impl;
+                std::unique_ptr<Impl> impl;
+
+        public:
+                // nullptr prints to stdout
+                explicit State(Output* out = nullptr);
+                ~State();
+
+                State(State&&) noexcept;
+                auto operator=(State&&) noexcept -> State&;
+
+                auto set(const std::string& name, Value value) -> void;
+                // throws Error if name is not defined or holds a function,
+                // class, instance, array or map
+                auto get(const std::string& name) const -> Value;
+                // kept over reset()
+                auto set_limits(const Limits& limits) -> void;
+                auto reset() -> void;
+        };
+
+        class LOX_API Program {
+                class Impl;
+                std::shared_ptr<Impl> impl;
+
+                explicit Program(std::shared_ptr<Impl> i);
+
+        public:
+                // imports are found relative to dir; throws Error on
+                // syntax errors
+                static auto compile(std::string_view source, const std::string& dir = ".") -> Program;
+
+                // on a fresh state, globals defined first
+                auto run(Output* out = nullptr, const Globals& globals = {}) const -> void;
+                auto run(State& state) const -> void;
+        };
+}
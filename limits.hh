@@ -0,0 +1,41 @@
+#pragma once
+#include "cpplox.hh"
+
+// Hard limits of a run, for scripts that are not trusted. The runtime
+// enforces them from its own counters: the heap from the bytes it
+// accounts, the interpreter from its call depth, the strings it makes
+// and the steps it takes. A breach is a runtime error of the script. An
+// off limit is the largest value, so every check stays one compare.
+//
+// Only the stack is limited by default: recursion moves to segments
+// from the heap (see stack.hh), a runaway one would take all memory.
+namespace limits {
+        constexpr uint64_t none = std::numeric_limits<uint64_t>::max();
+
+        class Limits {
+        public:
+                // managed objects and the memory they hold outside the heap,
+                // checked at every collection and before large payloads
+                uint64_t heap_bytes = none;
+                // nested calls, each running in an environment of its own
+                uint64_t depth = none;
+                // bytes of a string made by concatenation
+                uint64_t string_length = none;
+                // statements executed and loop iterations
+                uint64_t steps = none;
+                // wall clock of a run, checked every few thousand steps
+                uint64_t time_ms = none;
+                // stack segments of the thread, past its own stack
+                uint64_t stack_bytes = uint64_t(256) << 20;
+        };
+
+        // thrown where no token is at hand, the statement running turns
+        // it into a runtime error at its line
+        class exceeded : public std::runtime_error {
+        public:
+                exceeded(
+                        const std::string& msg
+                ) : std::runtime_error(msg)
+                {}
+        };
+}
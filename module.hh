@@ -0,0 +1,227 @@
+#pragma once
+#include "cpplox.hh"
+#include "errors.hh"
+#include "utils.hh"
+#include "scanner.hh"
+#include "parser.hh"
+#include "stmt.hh"
+#include "thread_pool.hh"
+#include "stats.hh"
+#include "stack.hh"
+
+namespace module {
+        class Module {
+        public:
+                std::string path;
+                std::vector<std::shared_ptr<stmt::Stmt>> statements;
+
+                Module(
+                        std::string p
+                ) : path(p)
+                {}
+        };
+
+        // finds every import stmt in a statement list
+        class ImportCollector : public stmt::Visitor<std::any> {
+        public:
+                std::vector<stmt::Import*> imports;
+
+                fn collect(std::vector<std::shared_ptr<stmt::Stmt>>& statements) {
+                        for (auto& statement : statements) {
+                                visit(statement);
+                        }
+                }
+
+                fn visit(const std::shared_ptr<stmt::Stmt>& statement) -> void {
+                        // nullptr after a syntax error
+                        if (statement != nullptr) {
+                                stack::guard([&] {
+                                        statement->accept(*this);
+                                });
+                        }
+                }
+
+                fn visitExpressionStmt(stmt::Expression&) -> std::any {
+                        return {};
+                }
+
+                fn visitPrintStmt(stmt::Print&) -> std::any {
+                        return {};
+                }
+
+                fn visitVarStmt(stmt::Var&) -> std::any {
+                        return {};
+                }
+
+                fn visitBlockStmt(stmt::Block& stmt) -> std::any {
+                        collect(stmt.statements);
+                        return {};
+                }
+
+                fn visitImportStmt(stmt::Import& stmt) -> std::any {
+                        imports.push_back(&stmt);
+                        return {};
+                }
+
+                fn visitIfStmt(stmt::If& stmt) -> std::any {
+                        visit(stmt.then_branch);
+                        visit(stmt.else_branch);
+                        return {};
+                }
+
+                fn visitWhileStmt(stmt::While& stmt) -> std::any {
+                        visit(stmt.body);
+                        return {};
+                }
+
+                fn visitFunctionStmt(stmt::Function& stmt) -> std::any {
+                        collect(stmt.body);
+                        return {};
+                }
+
+                fn visitReturnStmt(stmt::Return&) -> std::any {
+                        return {};
+                }
+
+                fn visitClassStmt(stmt::Class& stmt) -> std::any {
+                        for (auto& method : stmt.methods) {
+                                collect(method->body);
+                        }
+                        return {};
+                }
+        };
+
+        // Discovers the import graph before execution. Every module is
+        // read, scanned and parsed once on the thread pool, independent
+        // modules concurrently, and the result is shared by all importers.
+        class Loader {
+                std::unordered_map<std::string, std::unique_ptr<Module>> modules;
+                std::mutex mtx;
+                std::unique_ptr<thread_pool::ThreadPool> workers;
+                Module* root = nullptr;
+
+                fn pool() -> thread_pool::ThreadPool& {
+                        if (workers == nullptr) {
+                                workers = std::make_unique<thread_pool::ThreadPool>();
+                        }
+                        return *workers;
+                }
+
+                fn compile(Module* m) {
+                        errors::source = (m == root) ? "" : m->path;
+                        try {
+                                std::string code;
+                                {
+                                        stats::Phase t(stats::READ);
+                                        code = utils::get_file(m->path);
+                                }
+                                std::vector<token::Token> tokens;
+                                {
+                                        stats::Phase t(stats::SCAN);
+                                        scanner::Scanner sc(code);
+                                        tokens = sc.scan_tokens();
+                                }
+                                stats::Phase t(stats::PARSE);
+                                parser::Parser pr(std::move(tokens));
+                                m->statements = pr.parse();
+                        } catch (std::runtime_error& err) {
+                                errors::error(0, err.what());
+                        }
+
+                        auto path = std::filesystem::path(m->path);
+                        link(m->statements, path.parent_path());
+                        errors::source.clear();
+                        stats::flush();
+                }
+
+                fn request(std::string path, bool is_root = false) -> Module* {
+                        std::lock_guard lock(mtx);
+                        auto it = modules.find(path);
+                        if (it != modules.end()) {
+                                return it->second.get();
+                        }
+
+                        auto m = modules.emplace(
+                                path, std::make_unique<Module>(path)
+                        ).first->second.get();
+                        if (is_root) {
+                                root = m;
+                        }
+                        pool().submit([this, m] { compile(m); });
+                        return m;
+                }
+
+                // an empty path for one the filesystem rejects, such as
+                // a name too long
+                static fn resolve(
+                        std::filesystem::path dir,
+                        std::string path
+                ) -> std::filesystem::path {
+                        std::filesystem::path p(path);
+                        if (p.is_relative()) {
+                                p = dir / p;
+                        }
+                        std::error_code ec;
+                        auto canonical = std::filesystem::weakly_canonical(p, ec);
+                        if (ec) {
+                                return {};
+                        }
+                        return canonical;
+                }
+
+                static fn is_file(const std::filesystem::path& p) -> bool {
+                        std::error_code ec;
+                        return !p.empty() && std::filesystem::is_regular_file(p, ec);
+                }
+
+        public:
+                Loader() = default;
+                Loader(const Loader&) = delete;
+                fn operator=(const Loader&) -> Loader& = delete;
+
+                // resolves imports of already parsed statements, paths
+                // are relative to dir. call wait() before executing them
+                fn link(
+                        std::vector<std::shared_ptr<stmt::Stmt>>& statements,
+                        std::filesystem::path dir
+                ) -> void {
+                        ImportCollector collector;
+                        collector.collect(statements);
+
+                        for (auto import : collector.imports) {
+                                auto path = resolve(dir, import->path);
+                                if (!is_file(path)) {
+                                        errors::error(import->keyword, std::format(
+                                                "Cannot find module '{}'.", import->path
+                                        ));
+                                        continue;
+                                }
+                                import->module = request(path.string());
+                        }
+                }
+
+                fn wait() {
+                        if (workers != nullptr) {
+                                workers->wait();
+                        }
+                }
+
+                // compiles the script at path together with everything it
+                // imports, transitively
+                fn load(const std::string& path) -> Module* {
+                        auto p = resolve(std::filesystem::current_path(), path);
+                        if (!is_file(p)) {
+                                throw std::runtime_error(
+                                        std::format(
+                                                "utils: file '{}' is inaccessable",
+                                                path
+                                        )
+                                );
+                        }
+
+                        auto m = request(p.string(), true);
+                        wait();
+                        return m;
+                }
+        };
+}
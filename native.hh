@@ -0,0 +1,174 @@
+#pragma once
+#include "cpplox.hh"
+#include "token.hh"
+#include "errors.hh"
+#include "array.hh"
+#include "hashmap.hh"
+
+// Host functions callable from Lox. A function is declared with a plain
+// C++ signature; the registry derives arity and argument types from it
+// and generates a thunk that checks and unwraps the arguments in place.
+// Arguments live in interpreter storage, nothing is copied or allocated
+// on the way in, and a number result stays in the std::any buffer.
+namespace native {
+        // arities up to this are evaluated into a stack array
+        constexpr size_t small_arity = 4;
+
+        // one call, its arguments in interpreter owned storage
+        class Call {
+        public:
+                token::Token& paren;
+                std::any* args;
+                size_t count;
+
+                fn error(const std::string& msg) -> errors::runtime_panic {
+                        return errors::runtime_panic(paren, msg);
+                }
+        };
+
+        class Function {
+        public:
+                std::string name;
+                size_t min_arity;
+                size_t max_arity;
+                fn (*invoke)(const Function& self, Call& call) -> std::any;
+                // the declared implementation, cast back by invoke
+                void (*target)();
+        };
+
+        namespace {
+                template<class T>
+                struct arg;
+
+                template<>
+                struct arg<double> {
+                        static constexpr const char* name = "a number";
+                        static fn get(std::any& a) -> const double* {
+                                return std::any_cast<double>(&a);
+                        }
+                };
+
+                template<>
+                struct arg<bool> {
+                        static constexpr const char* name = "a boolean";
+                        static fn get(std::any& a) -> const bool* {
+                                return std::any_cast<bool>(&a);
+                        }
+                };
+
+                template<>
+                struct arg<const std::string&> {
+                        static constexpr const char* name = "a string";
+                        static fn get(std::any& a) -> const std::string* {
+                                return std::any_cast<std::string>(&a);
+                        }
+                };
+
+                template<>
+                struct arg<array::Array&> {
+                        static constexpr const char* name = "an array";
+                        static fn get(std::any& a) -> array::Array* {
+                                auto p = std::any_cast<array::array_ptr>(&a);
+                                return p ? *p : nullptr;
+                        }
+                };
+
+                template<>
+                struct arg<hashmap::Map&> {
+                        static constexpr const char* name = "a map";
+                        static fn get(std::any& a) -> hashmap::Map* {
+                                auto p = std::any_cast<hashmap::map_ptr>(&a);
+                                return p ? *p : nullptr;
+                        }
+                };
+
+                template<>
+                struct arg<std::any&> {
+                        static constexpr const char* name = "a value";
+                        static fn get(std::any& a) -> std::any* {
+                                return &a;
+                        }
+                };
+
+        }
+
+        // argument i of a call, checked to be a T
+        template<class T>
+        fn argument(const Function& self, Call& call, size_t i) -> T {
+                auto p = arg<T>::get(call.args[i]);
+                if (p == nullptr) {
+                        throw call.error(std::format(
+                                "Argument {} of '{}' must be {}.",
+                                i + 1, self.name, arg<T>::name
+                        ));
+                }
+                return *p;
+        }
+
+        namespace {
+                template<class R, class... A>
+                fn thunk(const Function& self, Call& call) -> std::any {
+                        auto f = reinterpret_cast<R (*)(A...)>(self.target);
+                        return [&]<size_t... I>(std::index_sequence<I...>) -> std::any {
+                                if constexpr (std::is_void_v<R>) {
+                                        f(argument<A>(self, call, I)...);
+                                        return {};
+                                } else {
+                                        return f(argument<A>(self, call, I)...);
+                                }
+                        }(std::index_sequence_for<A...>());
+                }
+
+                fn variadic_thunk(const Function& self, Call& call) -> std::any {
+                        auto f = reinterpret_cast<std::any (*)(const Function&, Call&)>(self.target);
+                        return f(self, call);
+                }
+        }
+
+        // Functions are immutable once defined and shared by every
+        // interpreter, which binds them as globals when it starts.
+        class Registry {
+                std::deque<Function> functions;
+
+        public:
+                template<class R, class... A>
+                fn define(std::string name, R (*f)(A...)) -> void {
+                        functions.push_back(Function{
+                                name, sizeof...(A), sizeof...(A),
+                                &thunk<R, A...>, reinterpret_cast<void (*)()>(f)
+                        });
+                }
+
+                // captureless lambdas
+                template<class F>
+                fn define(std::string name, F f) -> void {
+                        define(name, +f);
+                }
+
+                // optional or trailing arguments, checked by f itself
+                fn define_variadic(
+                        std::string name,
+                        size_t min_arity, size_t max_arity,
+                        std::any (*f)(const Function&, Call&)
+                ) -> void {
+                        functions.push_back(Function{
+                                name, min_arity, max_arity,
+                                &variadic_thunk, reinterpret_cast<void (*)()>(f)
+                        });
+                }
+
+                fn begin() const {
+                        return functions.begin();
+                }
+
+                fn end() const {
+                        return functions.end();
+                }
+        };
+
+        using function_ptr = const Function*;
+
+        fn is_function(const std::any& v) -> bool {
+                return v.type() == typeid(function_ptr);
+        }
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "cpplox.hh"
+#include "alloc.hh"
+#include "function.hh"
+#include "gc.hh"
+
+// Classes and instances. An instance stores its fields in a slot array
+// laid out by its shape, a hidden class shared by every instance that got
+// the same fields in the same order. Adding a field moves an instance to a
+// child shape; the children of a shape are kept, so instances built alike
+// end up on the very same shapes, which the caches in cache.hh key on.
+// Each class has its own root shape, so a shape also tells the class.
+namespace object {
+        namespace {
+                std::atomic<uint64_t> next_shape_id = 1;
+        }
+
+        class Shape {
+        public:
+                const uint64_t id = next_shape_id.fetch_add(1, std::memory_order_relaxed);
+                // slot of every field
+                std::unordered_map<std::string, uint32_t> slots;
+                // shapes with one more field, by its name
+                std::unordered_map<std::string, std::unique_ptr<Shape>> transitions;
+
+                // -1 if there is no such field
+                fn find(const std::string& name) const -> int32_t {
+                        auto it = slots.find(name);
+                        return it == slots.end() ? -1 : it->second;
+                }
+
+                fn add(const std::string& name) -> Shape* {
+                        auto& child = transitions[name];
+                        if (child == nullptr) {
+                                child = std::make_unique<Shape>();
+                                child->slots = slots;
+                                child->slots.emplace(name, slots.size());
+                        }
+                        return child.get();
+                }
+        };
+
+        class Class : public gc::Object {
+        public:
+                std::string name;
+                Class* superclass;
+                // own and inherited methods
+                std::unordered_map<std::string, function::closure_ptr> methods;
+                Shape root;
+                // init, once methods are complete
+                function::closure_ptr initializer = nullptr;
+
+                Class(
+                        std::string n,
+                        Class* s
+                ) : name(n), superclass(s)
+                {
+                        if (superclass != nullptr) {
+                                methods = superclass->methods;
+                        }
+                }
+
+                fn find_method(const std::string& name) -> function::closure_ptr* {
+                        auto it = methods.find(name);
+                        return it == methods.end() ? nullptr : &it->second;
+                }
+
+                fn arity() const -> size_t {
+                        return initializer != nullptr ? initializer->arity() : 0;
+                }
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.object(superclass);
+                        for (auto& [name, method] : methods) {
+                                t.object(method);
+                        }
+                }
+        };
+
+        using class_ptr = Class*;
+
+        class Instance : public gc::Object {
+        public:
+                // keeps the shapes alive
+                class_ptr klass;
+                Shape* shape;
+                std::vector<std::any, alloc::Allocator<std::any, alloc::INTERPRETER>> fields;
+
+                Instance(
+                        class_ptr k
+                ) : klass(k), shape(&k->root)
+                {}
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.object(klass);
+                        for (auto& v : fields) {
+                                t.value(v);
+                        }
+                }
+        };
+
+        using instance_ptr = Instance*;
+
+        // a method read off an instance, not called at once
+        class BoundMethod : public gc::Object {
+        public:
+                // the instance_ptr
+                std::any receiver;
+                function::closure_ptr method;
+
+                BoundMethod(
+                        std::any r,
+                        function::closure_ptr m
+                ) : receiver(std::move(r)), method(m)
+                {}
+
+                fn trace(gc::Tracer& t) -> void override {
+                        t.value(receiver);
+                        t.object(method);
+                }
+        };
+
+        using bound_ptr = BoundMethod*;
+
+        namespace {
+                gc::Traced<Class> traced_class;
+                gc::Traced<Instance> traced_instance;
+                gc::Traced<BoundMethod> traced_bound;
+        }
+
+        fn make_class(std::string name, class_ptr superclass) -> class_ptr {
+                return gc::make<Class>(name, superclass);
+        }
+
+        fn make_instance(class_ptr klass) -> instance_ptr {
+                return gc::make<Instance>(klass);
+        }
+
+        fn bind(std::any receiver, function::closure_ptr method) -> bound_ptr {
+                return gc::make<BoundMethod>(std::move(receiver), method);
+        }
+
+        fn is_class(const std::any& v) -> bool {
+                return v.type() == typeid(class_ptr);
+        }
+
+        fn is_instance(const std::any& v) -> bool {
+                return v.type() == typeid(instance_ptr);
+        }
+
+        fn is_bound(const std::any& v) -> bool {
+                return v.type() == typeid(bound_ptr);
+        }
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "cpplox.hh"
+
+namespace output {
+        constexpr size_t number_size = 32;
+
+        // Shortest representation that round-trips, in plain notation
+        // unless that does not fit, integral values are printed without
+        // a fraction. Writes at most number_size chars and returns the end.
+        fn format_number(char* p, double number) -> char* {
+                auto res = std::to_chars(p, p + number_size, number, std::chars_format::fixed);
+                if (res.ec != std::errc()) {
+                        res = std::to_chars(p, p + number_size, number);
+                }
+                return res.ptr;
+        }
+
+        class Sink {
+        public:
+                virtual ~Sink() = default;
+                virtual fn write(const char* data, size_t size) -> void = 0;
+
+                // interactive sinks are flushed on every newline
+                virtual fn interactive() -> bool {
+                        return false;
+                }
+        };
+
+        class FdSink : public Sink {
+        protected:
+                int fd;
+
+        public:
+                FdSink(
+                        int f
+                ) : fd(f)
+                {}
+
+                fn write(const char* data, size_t size) -> void {
+                        while (size > 0) {
+                                auto n = ::write(fd, data, size);
+                                if (n < 0) {
+                                        if (errno == EINTR) {
+                                                continue;
+                                        }
+                                        return;
+                                }
+                                data += n;
+                                size -= n;
+                        }
+                }
+
+                fn interactive() -> bool {
+                        return ::isatty(fd);
+                }
+        };
+
+        class FileSink : public FdSink {
+        public:
+                FileSink(
+                        std::string path
+                ) : FdSink(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))
+                {
+                        if (fd < 0) {
+                                throw std::runtime_error(
+                                        std::format(
+                                                "output: file '{}' is inaccessable",
+                                                path
+                                        )
+                                );
+                        }
+                }
+
+                ~FileSink() {
+                        ::close(fd);
+                }
+
+                FileSink(const FileSink&) = delete;
+                fn operator=(const FileSink&) -> FileSink& = delete;
+        };
+
+        // collects output in memory, for embedding
+        class MemorySink : public Sink {
+        public:
+                std::string data;
+
+                fn write(const char* d, size_t size) -> void {
+                        data.append(d, size);
+                }
+        };
+
+        // Buffers everything in user space. The buffer goes to the sink
+        // when it is full, on flush(), on destruction and, for interactive
+        // sinks, after every newline.
+        class Writer {
+                Sink& sink;
+                std::unique_ptr<char[]> buffer;
+                size_t used;
+                bool line_buffered;
+
+                fn reserve(size_t n) {
+                        if (used + n > buffer_size) {
+                                flush();
+                        }
+                }
+
+        public:
+                static constexpr size_t buffer_size = 64 * 1024;
+
+                Writer(
+                        Sink& s
+                ) : sink(s), buffer(new char[buffer_size]),
+                        used(0), line_buffered(s.interactive())
+                {}
+
+                ~Writer() {
+                        flush();
+                }
+
+                Writer(const Writer&) = delete;
+                fn operator=(const Writer&) -> Writer& = delete;
+
+                fn flush() -> void {
+                        if (used > 0) {
+                                sink.write(buffer.get(), used);
+                                used = 0;
+                        }
+                }
+
+                fn write(std::string_view str) {
+                        if (str.size() > buffer_size) {
+                                flush();
+                                sink.write(str.data(), str.size());
+                                return;
+                        }
+                        reserve(str.size());
+                        std::memcpy(buffer.get() + used, str.data(), str.size());
+                        used += str.size();
+                }
+
+                fn write(double number) {
+                        reserve(number_size);
+                        auto p = buffer.get() + used;
+                        used += format_number(p, number) - p;
+                }
+
+                fn newline() {
+                        reserve(1);
+                        buffer[used++] = '\n';
+                        if (line_buffered) {
+                                flush();
+                        }
+                }
+        };
+
+        // process stdout, flushed at exit
+        fn stdout_writer() -> Writer& {
+                static FdSink sink(STDOUT_FILENO);
+                static Writer writer(sink);
+                return writer;
+        }
+}
@@ -4,6 +4,9 @@
 #include "token.hh"
 #include "ast.hh"
 #include "stmt.hh"
+#include "alloc.hh"
+#include "resolver.hh"
+#include "stack.hh"
 
 namespace parser {
         class parse_error : public std::runtime_error {
@@ -13,18 +16,397 @@ namespace parser {
                 {}
         };
 
-        using expr_ptr = std::shared_ptr<ast::Expr>;
+        // bodies of top-level code are checked by Skim and parsed when
+        // they first run, off with --eager-parse
+        bool defer = true;
+
+        // Checks a body without building it, for a parser deferring
+        // it. A body passes only if parsing it would end at its closing
+        // brace without an error, resolving it would report nothing and
+        // it imports nothing. Any other is parsed in place and reported
+        // as it always was, so diagnostics do not depend on deferring.
+        //
+        // Which operator binds tighter does not decide whether an
+        // expression parses, so the skim knows no precedence; it only
+        // tracks whether an expression can be assigned to.
+        class Skim {
+                class failed {};
+
+                const std::vector<token::Token>& tokens;
+                size_t current;
+                // names declared in each scope, as the resolver does
+                std::vector<std::vector<std::string_view>> scopes;
+                // functions and classes around the current token
+                int functions = 0;
+                int classes = 0;
+                bool initializer = false;
+
+                fn type() -> token::token_type {
+                        return tokens[current].type;
+                }
+
+                fn match(token::token_type t) -> bool {
+                        if (type() != t) {
+                                return false;
+                        }
+                        current++;
+                        return true;
+                }
+
+                fn expect(token::token_type t) -> void {
+                        if (!match(t)) {
+                                throw failed();
+                        }
+                }
+
+                fn declare(const token::Token& name) -> void {
+                        auto& scope = scopes.back();
+                        if (std::find(scope.begin(), scope.end(), name.lexeme) != scope.end()) {
+                                throw failed();
+                        }
+                        scope.push_back(name.lexeme);
+                }
+
+                // expressions up to close, separated by commas
+                fn list(token::token_type close) -> void {
+                        if (type() != close) {
+                                do {
+                                        expression();
+                                } while (match(token::COMMA));
+                        }
+                        expect(close);
+                }
+
+                // super is never deferred, see resolver::Resolver
+                fn primary() -> bool {
+                        switch (type()) {
+                        case token::FALSE:
+                        case token::TRUE:
+                        case token::NIL:
+                        case token::NUMBER:
+                        case token::STRING:
+                                current++;
+                                return false;
+                        case token::IDENTIFIER:
+                                current++;
+                                return true;
+                        case token::THIS:
+                                if (classes == 0) {
+                                        throw failed();
+                                }
+                                current++;
+                                return false;
+                        case token::LEFT_PAREN:
+                                current++;
+                                expression();
+                                expect(token::RIGHT_PAREN);
+                                return false;
+                        case token::LEFT_BRACKET:
+                                current++;
+                                list(token::RIGHT_BRACKET);
+                                return false;
+                        case token::LEFT_BRACE:
+                                current++;
+                                if (type() != token::RIGHT_BRACE) {
+                                        do {
+                                                expression();
+                                                expect(token::COLON);
+                                                expression();
+                                        } while (match(token::COMMA));
+                                }
+                                expect(token::RIGHT_BRACE);
+                                return false;
+                        default:
+                                throw failed();
+                        }
+                }
+
+                fn call() -> bool {
+                        auto target = primary();
+                        while (true) {
+                                if (match(token::LEFT_PAREN)) {
+                                        list(token::RIGHT_PAREN);
+                                        target = false;
+                                } else if (match(token::DOT)) {
+                                        expect(token::IDENTIFIER);
+                                        target = true;
+                                } else if (match(token::LEFT_BRACKET)) {
+                                        expression();
+                                        expect(token::RIGHT_BRACKET);
+                                        target = true;
+                                } else {
+                                        return target;
+                                }
+                        }
+                }
+
+                fn unary() -> bool {
+                        return stack::guard([&] {
+                                if (match(token::BANG) || match(token::MINUS)) {
+                                        unary();
+                                        return false;
+                                }
+                                return call();
+                        });
+                }
+
+                fn binary() -> bool {
+                        auto target = unary();
+                        while (true) {
+                                switch (type()) {
+                                case token::OR:
+                                case token::AND:
+                                case token::BANG_EQUAL:
+                                case token::EQUAL_EQUAL:
+                                case token::GREATER:
+                                case token::GREATER_EQUAL:
+                                case token::LESS:
+                                case token::LESS_EQUAL:
+                                case token::MINUS:
+                                case token::PLUS:
+                                case token::SLASH:
+                                case token::STAR:
+                                        current++;
+                                        unary();
+                                        target = false;
+                                        break;
+                                default:
+                                        return target;
+                                }
+                        }
+                }
+
+                // true if it can be assigned to
+                fn expression() -> bool {
+                        return stack::guard([&] {
+                                auto target = binary();
+                                if (match(token::EQUAL)) {
+                                        expression();
+                                        if (!target) {
+                                                throw failed();
+                                        }
+                                        return false;
+                                }
+                                return target;
+                        });
+                }
+
+                fn var_declaration() -> void {
+                        auto& name = tokens[current];
+                        expect(token::IDENTIFIER);
+                        if (match(token::EQUAL)) {
+                                expression();
+                        }
+                        expect(token::SEMICOLON);
+                        declare(name);
+                }
+
+                // the initializer gets a scope around the loop
+                fn for_statement() -> void {
+                        expect(token::LEFT_PAREN);
+                        scopes.emplace_back();
+                        if (match(token::SEMICOLON)) {
+                        } else if (match(token::VAR)) {
+                                var_declaration();
+                        } else {
+                                expression();
+                                expect(token::SEMICOLON);
+                        }
+                        if (type() != token::SEMICOLON) {
+                                expression();
+                        }
+                        expect(token::SEMICOLON);
+                        if (type() != token::RIGHT_PAREN) {
+                                expression();
+                        }
+                        expect(token::RIGHT_PAREN);
+                        statement();
+                        scopes.pop_back();
+                }
+
+                // import is not an expression and ends the skim too
+                fn statement() -> void {
+                        stack::guard([&] {
+                                switch (type()) {
+                                case token::PRINT:
+                                        current++;
+                                        expression();
+                                        expect(token::SEMICOLON);
+                                        break;
+                                case token::IF:
+                                        current++;
+                                        expect(token::LEFT_PAREN);
+                                        expression();
+                                        expect(token::RIGHT_PAREN);
+                                        statement();
+                                        if (match(token::ELSE)) {
+                                                statement();
+                                        }
+                                        break;
+                                case token::WHILE:
+                                        current++;
+                                        expect(token::LEFT_PAREN);
+                                        expression();
+                                        expect(token::RIGHT_PAREN);
+                                        statement();
+                                        break;
+                                case token::FOR:
+                                        current++;
+                                        for_statement();
+                                        break;
+                                case token::RETURN:
+                                        current++;
+                                        if (functions == 0) {
+                                                throw failed();
+                                        }
+                                        if (type() != token::SEMICOLON) {
+                                                if (initializer) {
+                                                        throw failed();
+                                                }
+                                                expression();
+                                        }
+                                        expect(token::SEMICOLON);
+                                        break;
+                                case token::LEFT_BRACE:
+                                        current++;
+                                        scopes.emplace_back();
+                                        rest_of_block();
+                                        scopes.pop_back();
+                                        break;
+                                default:
+                                        expression();
+                                        expect(token::SEMICOLON);
+                                        break;
+                                }
+                        });
+                }
+
+                // parameters and body, after the name
+                fn function(bool init) -> void {
+                        expect(token::LEFT_PAREN);
+                        scopes.emplace_back();
+                        if (type() != token::RIGHT_PAREN) {
+                                do {
+                                        if (scopes.back().size() >= 255) {
+                                                throw failed();
+                                        }
+                                        declare(tokens[current]);
+                                        expect(token::IDENTIFIER);
+                                } while (match(token::COMMA));
+                        }
+                        expect(token::RIGHT_PAREN);
+                        expect(token::LEFT_BRACE);
+                        body(init);
+                        scopes.pop_back();
+                }
+
+                fn body(bool init) -> void {
+                        auto enclosing = initializer;
+                        initializer = init;
+                        functions++;
+                        rest_of_block();
+                        functions--;
+                        initializer = enclosing;
+                }
+
+                fn class_declaration() -> void {
+                        auto& name = tokens[current];
+                        expect(token::IDENTIFIER);
+                        if (match(token::LESS)) {
+                                if (tokens[current].lexeme == name.lexeme) {
+                                        throw failed();
+                                }
+                                expect(token::IDENTIFIER);
+                        }
+                        declare(name);
+                        expect(token::LEFT_BRACE);
+                        classes++;
+                        while (type() != token::RIGHT_BRACE && type() != token::FILE_EOF) {
+                                auto& method = tokens[current];
+                                expect(token::IDENTIFIER);
+                                function(method.lexeme == "init");
+                        }
+                        classes--;
+                        expect(token::RIGHT_BRACE);
+                }
+
+                fn declaration() -> void {
+                        if (match(token::CLASS)) {
+                                class_declaration();
+                        } else if (match(token::FUN)) {
+                                declare(tokens[current]);
+                                expect(token::IDENTIFIER);
+                                function(false);
+                        } else if (match(token::VAR)) {
+                                var_declaration();
+                        } else {
+                                statement();
+                        }
+                }
+
+                fn rest_of_block() -> void {
+                        while (type() != token::RIGHT_BRACE && type() != token::FILE_EOF) {
+                                declaration();
+                        }
+                        expect(token::RIGHT_BRACE);
+                }
+
+        public:
+                // start is the token after the opening brace
+                Skim(
+                        const std::vector<token::Token>& t,
+                        size_t start
+                ) : tokens(t), current(start)
+                {}
+
+                // past the closing brace of a function body, 0 if it
+                // has to be parsed now
+                fn function_body(const std::vector<stmt::Param>& params, bool method, bool init) -> size_t {
+                        try {
+                                scopes.emplace_back();
+                                for (auto& param : params) {
+                                        declare(param.name);
+                                }
+                                classes = method;
+                                body(init);
+                                return current;
+                        } catch (failed&) {
+                                return 0;
+                        }
+                }
+
+                fn block_body() -> size_t {
+                        try {
+                                scopes.emplace_back();
+                                rest_of_block();
+                                return current;
+                        } catch (failed&) {
+                                return 0;
+                        }
+                }
+        };
 
         class Parser {
-                std::vector<token::Token> tokens;
+                std::shared_ptr<const std::vector<token::Token>> tokens;
                 size_t current;
+                // functions and blocks around the current token, 0 in
+                // top-level code, the only code deferred
+                int depth = 0;
+
+                // ast nodes are accounted to the parser
+                template<class T, class... Args>
+                static fn make(Args&&... args) -> std::shared_ptr<T> {
+                        return alloc::make_shared<T, alloc::PARSER>(
+                                std::forward<Args>(args)...
+                        );
+                }
 
                 fn previous() -> token::Token {
-                        return tokens.at(current - 1);
+                        return tokens->at(current - 1);
                 }
 
                 fn peek() -> token::Token {
-                        return tokens.at(current);
+                        return tokens->at(current);
                 }
 
                 fn is_at_end() -> bool {
@@ -73,6 +455,7 @@ namespace parser {
                                 case token::WHILE:
                                 case token::PRINT:
                                 case token::RETURN:
+                                case token::IMPORT:
                                         return;
                                 default:
                                         break;
@@ -83,12 +466,12 @@ namespace parser {
 
                 }
 
-                fn error(token::Token t, std::wstring msg) -> parse_error {
+                fn error(token::Token t, std::string msg) -> parse_error {
                         errors::error(t, msg);
                         return parse_error("all bad man");
                 }
 
-                fn consume(token::token_type type, std::wstring msg) -> token::Token {
+                fn consume(token::token_type type, std::string msg) -> token::Token {
                         if (check(type)) {
                                 return advance();
                         }
@@ -98,37 +481,113 @@ namespace parser {
 
                 fn primary() -> std::shared_ptr<ast::Expr> {
                         if (match({token::FALSE})) {
-                                return expr_ptr(new ast::Literal(false));
+                                return make<ast::Literal>(false);
                         } else if (match({token::TRUE})) {
-                                return expr_ptr(new ast::Literal(true));
+                                return make<ast::Literal>(true);
                         } else if (match({token::NIL})) {
-                                return expr_ptr(new ast::Literal(std::any()));
+                                return make<ast::Literal>(std::any());
                         }
 
                         if (match({token::NUMBER, token::STRING})) {
-                                return expr_ptr(new ast::Literal(previous().literal));
+                                return make<ast::Literal>(previous().literal);
+                        }
+                        if (match({token::IDENTIFIER, token::THIS})) {
+                                return make<ast::Variable>(previous());
                         }
-                        if (match({token::IDENTIFIER})) {
-                                return expr_ptr(new ast::Variable(previous()));
+
+                        if (match({token::SUPER})) {
+                                auto keyword = previous();
+                                consume(token::DOT, "Expect '.' after 'super'.");
+                                auto method = consume(token::IDENTIFIER, "Expect superclass method name.");
+                                auto self = keyword;
+                                self.type = token::THIS;
+                                self.lexeme = "this";
+                                return make<ast::Super>(
+                                        keyword, method,
+                                        make<ast::Variable>(keyword), make<ast::Variable>(self)
+                                );
                         }
 
                         if (match({token::LEFT_PAREN})) {
                                 std::shared_ptr<ast::Expr> expr = expression();
-                                consume(token::RIGHT_PAREN, L"Expect ')' after expression");
-                                return expr_ptr(new ast::Grouping(expr));
+                                consume(token::RIGHT_PAREN, "Expect ')' after expression");
+                                return make<ast::Grouping>(expr);
+                        }
+
+                        if (match({token::LEFT_BRACKET})) {
+                                auto bracket = previous();
+                                std::vector<std::shared_ptr<ast::Expr>> elements;
+                                if (!check(token::RIGHT_BRACKET)) {
+                                        do {
+                                                elements.push_back(expression());
+                                        } while (match({token::COMMA}));
+                                }
+                                consume(token::RIGHT_BRACKET, "Expect ']' after array elements.");
+                                return make<ast::ArrayLiteral>(bracket, elements);
                         }
 
-                        throw error(peek(), L"Except expression.");
+                        // a brace that starts a statement is a block,
+                        // only here it starts a map
+                        if (match({token::LEFT_BRACE})) {
+                                auto brace = previous();
+                                std::vector<std::shared_ptr<ast::Expr>> keys;
+                                std::vector<std::shared_ptr<ast::Expr>> values;
+                                if (!check(token::RIGHT_BRACE)) {
+                                        do {
+                                                keys.push_back(expression());
+                                                consume(token::COLON, "Expect ':' after map key.");
+                                                values.push_back(expression());
+                                        } while (match({token::COMMA}));
+                                }
+                                consume(token::RIGHT_BRACE, "Expect '}' after map entries.");
+                                return make<ast::MapLiteral>(brace, keys, values);
+                        }
+
+                        throw error(peek(), "Except expression.");
                 }
 
-                fn unary() -> std::shared_ptr<ast::Expr> {
-                        if (match({token::BANG, token::MINUS})) {
-                                token::Token op = previous();
-                                std::shared_ptr<ast::Expr> right = unary();
-                                return expr_ptr(new ast::Unary(op, right));
+                fn finish_call(std::shared_ptr<ast::Expr> callee) -> std::shared_ptr<ast::Expr> {
+                        std::vector<std::shared_ptr<ast::Expr>> arguments;
+                        if (!check(token::RIGHT_PAREN)) {
+                                do {
+                                        arguments.push_back(expression());
+                                } while (match({token::COMMA}));
+                        }
+                        auto paren = consume(token::RIGHT_PAREN, "Expect ')' after arguments.");
+                        return make<ast::Call>(callee, paren, arguments);
+                }
+
+                fn call() -> std::shared_ptr<ast::Expr> {
+                        auto expr = primary();
+                        while (true) {
+                                if (match({token::LEFT_PAREN})) {
+                                        expr = finish_call(expr);
+                                } else if (match({token::DOT})) {
+                                        auto name = consume(token::IDENTIFIER, "Expect property name after '.'.");
+                                        expr = make<ast::Get>(expr, name);
+                                } else if (match({token::LEFT_BRACKET})) {
+                                        auto bracket = previous();
+                                        auto index = expression();
+                                        consume(token::RIGHT_BRACKET, "Expect ']' after index.");
+                                        expr = make<ast::Index>(expr, bracket, index);
+                                } else {
+                                        break;
+                                }
                         }
 
-                        return primary();
+                        return expr;
+                }
+
+                fn unary() -> std::shared_ptr<ast::Expr> {
+                        return stack::guard([&]() -> std::shared_ptr<ast::Expr> {
+                                if (match({token::BANG, token::MINUS})) {
+                                        token::Token op = previous();
+                                        std::shared_ptr<ast::Expr> right = unary();
+                                        return make<ast::Unary>(op, right);
+                                }
+
+                                return call();
+                        });
                 }
 
                 fn factor() -> std::shared_ptr<ast::Expr> {
@@ -136,7 +595,7 @@ namespace parser {
                         while (match({token::SLASH, token::STAR})) {
                                 token::Token op = previous();
                                 std::shared_ptr<ast::Expr> right = unary();
-                                expr = expr_ptr(new ast::Binary(expr, op, right));
+                                expr = make<ast::Binary>(expr, op, right);
                         }
 
                         return expr;
@@ -147,7 +606,7 @@ namespace parser {
                         while (match({token::MINUS, token::PLUS})) {
                                 token::Token op = previous();
                                 std::shared_ptr<ast::Expr> right = factor();
-                                expr = expr_ptr(new ast::Binary(expr, op, right));
+                                expr = make<ast::Binary>(expr, op, right);
                         }
 
                         return expr;
@@ -161,7 +620,7 @@ namespace parser {
                         })) {
                                 token::Token op = previous();
                                 std::shared_ptr<ast::Expr> right = term();
-                                expr = expr_ptr(new ast::Binary(expr, op, right));
+                                expr = make<ast::Binary>(expr, op, right);
                         }
 
                         return expr;
@@ -172,30 +631,62 @@ namespace parser {
                         while (match({token::BANG_EQUAL, token::EQUAL_EQUAL})) {
                                 token::Token op = previous();
                                 std::shared_ptr<ast::Expr> right = comparison();
-                                expr = expr_ptr(new ast::Binary(expr, op, right));
+                                expr = make<ast::Binary>(expr, op, right);
                         }
 
                         return expr;
                 }
 
-                fn assignment() -> std::shared_ptr<ast::Expr> {
+                fn logic_and() -> std::shared_ptr<ast::Expr> {
                         auto expr = equality();
+                        while (match({token::AND})) {
+                                auto op = previous();
+                                auto right = equality();
+                                expr = make<ast::Logical>(expr, op, right);
+                        }
 
-                        if (match({token::EQUAL})) {
-                                auto equals = previous();
-                                auto value = assignment();
-
-                                if (typeid(expr) == typeid(ast::Variable)) {
-                                        auto name = dynamic_cast<ast::Variable*>(expr.get())->name;
-                                        return std::shared_ptr<ast::Expr>(new ast::Assign(name, value));
-                                }
+                        return expr;
+                }
 
-                                errors::error(equals, L"Invalid assignment target");
+                fn logic_or() -> std::shared_ptr<ast::Expr> {
+                        auto expr = logic_and();
+                        while (match({token::OR})) {
+                                auto op = previous();
+                                auto right = logic_and();
+                                expr = make<ast::Logical>(expr, op, right);
                         }
 
                         return expr;
                 }
 
+                fn assignment() -> std::shared_ptr<ast::Expr> {
+                        return stack::guard([&]() -> std::shared_ptr<ast::Expr> {
+                                auto expr = logic_or();
+
+                                if (match({token::EQUAL})) {
+                                        auto equals = previous();
+                                        auto value = assignment();
+
+                                        auto var = dynamic_cast<ast::Variable*>(expr.get());
+                                        if (var != nullptr && var->name.type == token::IDENTIFIER) {
+                                                return make<ast::Assign>(var->name, value);
+                                        }
+                                        if (auto get = dynamic_cast<ast::Get*>(expr.get())) {
+                                                return make<ast::Set>(get->object, get->name, value);
+                                        }
+                                        if (auto index = dynamic_cast<ast::Index*>(expr.get())) {
+                                                return make<ast::IndexSet>(
+                                                        index->object, index->bracket, index->index, value
+                                                );
+                                        }
+
+                                        errors::error(equals, "Invalid assignment target");
+                                }
+
+                                return expr;
+                        });
+                }
+
                 fn expression() -> std::shared_ptr<ast::Expr> {
                         return assignment();
                 }
@@ -204,82 +695,335 @@ namespace parser {
 
                 fn expression_statement() -> std::shared_ptr<stmt::Stmt> {
                         auto expr = expression();
-                        consume(token::SEMICOLON, L"Except ';' after value.");
-                        return std::shared_ptr<stmt::Stmt>(new stmt::Expression(expr));
+                        consume(token::SEMICOLON, "Except ';' after value.");
+                        return make<stmt::Expression>(expr);
                 }
 
                 fn print_statement() -> std::shared_ptr<stmt::Stmt> {
                         auto value = expression();
-                        consume(token::SEMICOLON, L"Except ';' after value.");
-                        return std::shared_ptr<stmt::Stmt>(new stmt::Print(value));
+                        consume(token::SEMICOLON, "Except ';' after value.");
+                        return make<stmt::Print>(value);
                 }
 
-                fn statement() -> std::shared_ptr<stmt::Stmt> {
-                        if (match({token::PRINT})) {
-                                return print_statement();
+                fn import_statement() -> std::shared_ptr<stmt::Stmt> {
+                        auto keyword = previous();
+                        auto path = consume(token::STRING, "Expect module path after 'import'.");
+                        consume(token::SEMICOLON, "Expect ';' after module path.");
+                        return make<stmt::Import>(
+                                keyword, std::any_cast<std::string>(path.literal)
+                        );
+                }
+
+                fn return_statement() -> std::shared_ptr<stmt::Stmt> {
+                        auto keyword = previous();
+                        std::shared_ptr<ast::Expr> value = nullptr;
+                        if (!check(token::SEMICOLON)) {
+                                value = expression();
                         }
-                        
-                        if (match({token::LEFT_BRACE})) {
-                                return std::shared_ptr<stmt::Stmt>(
-                                        new stmt::Block(block())
-                                );
+                        consume(token::SEMICOLON, "Expect ';' after return value.");
+                        return make<stmt::Return>(keyword, value);
+                }
+
+                fn if_statement() -> std::shared_ptr<stmt::Stmt> {
+                        consume(token::LEFT_PAREN, "Expect '(' after 'if'.");
+                        auto condition = expression();
+                        consume(token::RIGHT_PAREN, "Expect ')' after if condition.");
+
+                        auto then_branch = nested_statement();
+                        std::shared_ptr<stmt::Stmt> else_branch = nullptr;
+                        if (match({token::ELSE})) {
+                                else_branch = nested_statement();
+                        }
+                        return make<stmt::If>(condition, then_branch, else_branch);
+                }
+
+                fn while_statement() -> std::shared_ptr<stmt::Stmt> {
+                        consume(token::LEFT_PAREN, "Expect '(' after 'while'.");
+                        auto condition = expression();
+                        consume(token::RIGHT_PAREN, "Expect ')' after condition.");
+                        return make<stmt::While>(condition, nested_statement());
+                }
+
+                // the initializer gets a block of its own around the loop
+                fn for_statement() -> std::shared_ptr<stmt::Stmt> {
+                        auto line = previous().line;
+                        consume(token::LEFT_PAREN, "Expect '(' after 'for'.");
+
+                        std::shared_ptr<stmt::Stmt> initializer = nullptr;
+                        if (match({token::SEMICOLON})) {
+                        } else if (match({token::VAR})) {
+                                initializer = var_declaration();
+                        } else {
+                                initializer = expression_statement();
+                        }
+                        if (initializer != nullptr) {
+                                initializer->line = line;
+                        }
+
+                        std::shared_ptr<ast::Expr> condition = nullptr;
+                        if (!check(token::SEMICOLON)) {
+                                condition = expression();
+                        } else {
+                                condition = make<ast::Literal>(true);
+                        }
+                        consume(token::SEMICOLON, "Expect ';' after loop condition.");
+
+                        std::shared_ptr<ast::Expr> increment = nullptr;
+                        if (!check(token::RIGHT_PAREN)) {
+                                increment = expression();
+                        }
+                        consume(token::RIGHT_PAREN, "Expect ')' after for clauses.");
+
+                        // the body sees the initializer, it is no
+                        // longer top-level code
+                        depth += initializer != nullptr;
+                        std::shared_ptr<stmt::Stmt> loop = make<stmt::While>(
+                                condition, nested_statement(), increment
+                        );
+                        depth -= initializer != nullptr;
+                        if (initializer == nullptr) {
+                                return loop;
                         }
+                        loop->line = line;
+                        return make_block({initializer, loop});
+                }
+
+                // a statement inside another one keeps its own line
+                fn nested_statement() -> std::shared_ptr<stmt::Stmt> {
+                        auto line = peek().line;
+                        auto s = statement();
+                        s->line = line;
+                        return s;
+                }
+
+                fn statement() -> std::shared_ptr<stmt::Stmt> {
+                        return stack::guard([&]() -> std::shared_ptr<stmt::Stmt> {
+                                if (match({token::PRINT})) {
+                                        return print_statement();
+                                }
+
+                                if (match({token::IF})) {
+                                        return if_statement();
+                                }
+
+                                if (match({token::WHILE})) {
+                                        return while_statement();
+                                }
 
-                        return expression_statement();
+                                if (match({token::FOR})) {
+                                        return for_statement();
+                                }
+
+                                if (match({token::IMPORT})) {
+                                        return import_statement();
+                                }
+
+                                if (match({token::RETURN})) {
+                                        return return_statement();
+                                }
+                        
+                                if (match({token::LEFT_BRACE})) {
+                                        if (auto deferred = deferred_block()) {
+                                                return deferred;
+                                        }
+                                        return make_block(block());
+                                }
+
+                                return expression_statement();
+                        });
                 }
 
                 fn var_declaration() -> std::shared_ptr<stmt::Stmt> {
-                        auto name = consume(token::IDENTIFIER, L"Expect var name.");
+                        auto name = consume(token::IDENTIFIER, "Expect var name.");
 
                         std::shared_ptr<ast::Expr> initializer = nullptr;
                         if (match({token::EQUAL})) {
                                 initializer = expression();
                         }
 
-                        consume(token::SEMICOLON, L"Expect ';' variable declaration.");
-                        return std::shared_ptr<stmt::Stmt>(
-                                        new stmt::Var(name, initializer)
-                        );
+                        consume(token::SEMICOLON, "Expect ';' variable declaration.");
+                        return make<stmt::Var>(name, initializer);
+                }
+
+                fn function(std::string kind) -> std::shared_ptr<stmt::Function> {
+                        auto name = consume(token::IDENTIFIER, "Expect " + kind + " name.");
+                        consume(token::LEFT_PAREN, "Expect '(' after " + kind + " name.");
+                        std::vector<stmt::Param> params;
+                        if (!check(token::RIGHT_PAREN)) {
+                                do {
+                                        if (params.size() >= 255) {
+                                                errors::error(peek(), "Can't have more than 255 parameters.");
+                                        }
+                                        params.push_back({consume(token::IDENTIFIER, "Expect parameter name.")});
+                                } while (match({token::COMMA}));
+                        }
+                        consume(token::RIGHT_PAREN, "Expect ')' after parameters.");
+                        consume(token::LEFT_BRACE, "Expect '{' before " + kind + " body.");
+
+                        if (defer && depth == 0) {
+                                auto method = kind == "method";
+                                auto end = Skim(*tokens, current).function_body(
+                                        params, method, method && name.lexeme == "init"
+                                );
+                                if (end != 0) {
+                                        auto f = make<stmt::Function>(
+                                                name, params, std::vector<std::shared_ptr<stmt::Stmt>>()
+                                        );
+                                        f->deferred = {tokens, current, method};
+                                        current = end;
+                                        STATS_ADD(deferred_bodies, 1);
+                                        return f;
+                                }
+                        }
+                        return make<stmt::Function>(name, params, block());
+                }
+
+                fn class_declaration() -> std::shared_ptr<stmt::Stmt> {
+                        auto name = consume(token::IDENTIFIER, "Expect class name.");
+                        std::shared_ptr<ast::Variable> superclass = nullptr;
+                        if (match({token::LESS})) {
+                                consume(token::IDENTIFIER, "Expect superclass name.");
+                                superclass = make<ast::Variable>(previous());
+                        }
+                        consume(token::LEFT_BRACE, "Expect '{' before class body.");
+
+                        std::vector<std::shared_ptr<stmt::Function>> methods;
+                        while (!check(token::RIGHT_BRACE) && !is_at_end()) {
+                                auto line = peek().line;
+                                auto method = function("method");
+                                method->line = line;
+                                method->initializer = method->name.lexeme == "init";
+                                methods.push_back(method);
+                        }
+                        consume(token::RIGHT_BRACE, "Expect '}' after class body.");
+                        return make<stmt::Class>(name, superclass, methods);
                 }
 
                 fn declaration() -> std::shared_ptr<stmt::Stmt> {
+                        auto enclosing = depth;
                         try {
-                                if (match({token::VAR})) {
-                                        return var_declaration();
+                                auto line = peek().line;
+                                std::shared_ptr<stmt::Stmt> s;
+                                if (match({token::CLASS})) {
+                                        s = class_declaration();
+                                } else if (match({token::FUN})) {
+                                        s = function("function");
+                                } else if (match({token::VAR})) {
+                                        s = var_declaration();
+                                } else {
+                                        s = statement();
                                 }
-
-                                return statement();
+                                s->line = line;
+                                return s;
                         } catch (parse_error& err) {
+                                depth = enclosing;
                                 synchronize();
                                 return {};
                         }
                 }
 
+                static fn declares(const std::vector<std::shared_ptr<stmt::Stmt>>& statements) -> bool {
+                        return std::any_of(
+                                statements.begin(), statements.end(),
+                                [](auto& s) {
+                                        return dynamic_cast<stmt::Var*>(s.get()) != nullptr
+                                                || dynamic_cast<stmt::Function*>(s.get()) != nullptr
+                                                || dynamic_cast<stmt::Class*>(s.get()) != nullptr;
+                                }
+                        );
+                }
+
+                fn make_block(
+                        std::vector<std::shared_ptr<stmt::Stmt>> statements
+                ) -> std::shared_ptr<stmt::Stmt> {
+                        auto b = make<stmt::Block>(statements);
+                        b->declares = declares(b->statements);
+                        return b;
+                }
+
+                // a block of top-level code, checked now and parsed
+                // when it runs; nullptr if it is parsed here
+                fn deferred_block() -> std::shared_ptr<stmt::Stmt> {
+                        if (!defer || depth != 0) {
+                                return nullptr;
+                        }
+                        auto end = Skim(*tokens, current).block_body();
+                        if (end == 0) {
+                                return nullptr;
+                        }
+                        auto b = make<stmt::Block>(std::vector<std::shared_ptr<stmt::Stmt>>());
+                        b->deferred = {tokens, current, false};
+                        current = end;
+                        STATS_ADD(deferred_bodies, 1);
+                        return b;
+                }
+
                 fn block() -> std::vector<std::shared_ptr<stmt::Stmt>> {
+                        depth++;
                         std::vector<std::shared_ptr<stmt::Stmt>> statements;
                         while (!check(token::RIGHT_BRACE) && !is_at_end()) {
                                 statements.push_back(declaration());
                         }
+                        depth--;
 
-                        consume(token::RIGHT_BRACE, L"Expect '}' after block.");
+                        consume(token::RIGHT_BRACE, "Expect '}' after block.");
                         return statements;
                 }
 
+                // the rest of a deferred body, see expand()
+                Parser(
+                        std::shared_ptr<const std::vector<token::Token>> t,
+                        size_t start
+                ) : tokens(t), current(start), depth(1)
+                {}
+
+                friend fn expand(stmt::Function& function) -> void;
+                friend fn expand(stmt::Block& block) -> void;
+
 
         public:
 
                 fn parse() -> std::vector<std::shared_ptr<stmt::Stmt>> {
+                        alloc::Scope scope(alloc::PARSER);
                         std::vector<std::shared_ptr<stmt::Stmt>> statements;
 
                         while (!is_at_end()) {
                                 statements.push_back(declaration());
                         }
 
+                        // statements leave the parser resolved
+                        resolver::Resolver().resolve(statements);
                         return statements;
                 }
 
                 Parser(
                         std::vector<token::Token>& t
-                ) : tokens(t), current(0) {}
+                ) : tokens(std::make_shared<const std::vector<token::Token>>(t)), current(0) {}
+
+                Parser(
+                        std::vector<token::Token>&& t
+                ) : tokens(std::make_shared<const std::vector<token::Token>>(std::move(t))), current(0) {}
         };
+
+        // Parses and resolves a deferred body before it first runs. It
+        // passed the skim, so neither reports anything; the tokens go
+        // once no other body of the script needs them.
+        fn expand(stmt::Function& function) -> void {
+                alloc::Scope scope(alloc::PARSER);
+                auto deferred = std::exchange(function.deferred, {});
+                Parser p(deferred.tokens, deferred.start);
+                function.body = p.block();
+                resolver::Resolver().resolve(function, deferred.method);
+                STATS_ADD(expanded_bodies, 1);
+        }
+
+        fn expand(stmt::Block& block) -> void {
+                alloc::Scope scope(alloc::PARSER);
+                auto deferred = std::exchange(block.deferred, {});
+                Parser p(deferred.tokens, deferred.start);
+                block.statements = p.block();
+                block.declares = Parser::declares(block.statements);
+                resolver::Resolver().resolve(block);
+                STATS_ADD(expanded_bodies, 1);
+        }
 }
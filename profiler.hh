@@ -0,0 +1,214 @@
+#pragma once
+#include "cpplox.hh"
+
+// Sampling profiler for Lox source. The interpreter keeps a shadow
+// stack of the blocks and modules it is executing plus the current
+// statement; a SIGPROF handler copies that state into preallocated
+// storage. Nothing is allocated or locked while sampling.
+namespace profiler {
+        class Frame {
+        public:
+                // module path, nullptr for interactive input
+                const std::string* file;
+                // 0 for the module body itself
+                int line;
+        };
+
+        class Sample {
+        public:
+                uint32_t offset;
+                uint32_t depth;
+                Frame current;
+        };
+
+        class Profiler {
+                static constexpr size_t max_depth = 256;
+                static constexpr size_t max_samples = 1 << 18;
+                static constexpr size_t max_frames = 1 << 22;
+
+                // written by the interpreter, read by the signal handler
+                // on the same thread
+                Frame stack[max_depth];
+                volatile uint32_t depth = 0;
+                Frame current = {nullptr, 0};
+
+                std::unique_ptr<Sample[]> samples;
+                std::unique_ptr<Frame[]> frames;
+                size_t sample_count = 0;
+                size_t frame_count = 0;
+                size_t dropped = 0;
+                int interval_us;
+
+                static inline Profiler* active = nullptr;
+
+                static fn on_signal(int) {
+                        auto p = active;
+                        if (p == nullptr) {
+                                return;
+                        }
+                        std::atomic_signal_fence(std::memory_order_acquire);
+
+                        uint32_t d = p->depth;
+                        d = std::min<uint32_t>(d, max_depth);
+                        if (p->sample_count == max_samples
+                                || p->frame_count + d > max_frames) {
+                                p->dropped++;
+                                return;
+                        }
+
+                        auto& s = p->samples[p->sample_count++];
+                        s.offset = p->frame_count;
+                        s.depth = d;
+                        s.current = p->current;
+                        for (uint32_t i = 0; i < d; ++i) {
+                                p->frames[p->frame_count++] = p->stack[i];
+                        }
+                }
+
+                static fn name(const std::string* file) -> std::string {
+                        if (file == nullptr) {
+                                return "<stdin>";
+                        }
+                        return std::filesystem::path(*file).filename().string();
+                }
+
+                static fn name(const Frame& f) -> std::string {
+                        if (f.line == 0) {
+                                return name(f.file);
+                        }
+                        return std::format("{}:{}", name(f.file), f.line);
+                }
+
+        public:
+                Profiler(
+                        int interval = 1000
+                ) : samples(new Sample[max_samples]),
+                        frames(new Frame[max_frames]),
+                        interval_us(interval)
+                {}
+
+                ~Profiler() {
+                        stop();
+                }
+
+                Profiler(const Profiler&) = delete;
+                fn operator=(const Profiler&) -> Profiler& = delete;
+
+                fn start() {
+                        active = this;
+                        struct sigaction sa = {};
+                        sa.sa_handler = on_signal;
+                        sa.sa_flags = SA_RESTART;
+                        sigemptyset(&sa.sa_mask);
+                        sigaction(SIGPROF, &sa, nullptr);
+
+                        itimerval timer = {};
+                        timer.it_interval.tv_usec = interval_us;
+                        timer.it_value.tv_usec = interval_us;
+                        setitimer(ITIMER_PROF, &timer, nullptr);
+                }
+
+                fn stop() -> void {
+                        itimerval timer = {};
+                        setitimer(ITIMER_PROF, &timer, nullptr);
+                        if (active == this) {
+                                active = nullptr;
+                        }
+                }
+
+                // --------- probes, called by the interpreter ---------
+
+                fn at(const std::string* file, int line) {
+                        current = {file, line};
+                        std::atomic_signal_fence(std::memory_order_release);
+                }
+
+                fn enter(const std::string* file, int line) {
+                        if (depth < max_depth) {
+                                stack[depth] = {file, line};
+                        }
+                        std::atomic_signal_fence(std::memory_order_release);
+                        depth = depth + 1;
+                }
+
+                fn leave() {
+                        depth = depth - 1;
+                }
+
+                // ----------------------- reports ----------------------
+
+                // hits per source line, hottest first
+                fn report_lines(std::ostream& out) {
+                        std::map<std::pair<std::string, int>, size_t> hits;
+                        for (size_t i = 0; i < sample_count; ++i) {
+                                auto& c = samples[i].current;
+                                hits[{name(c.file), c.line}]++;
+                        }
+
+                        std::vector<std::pair<size_t, std::pair<std::string, int>>> sorted;
+                        for (auto& [where, n] : hits) {
+                                sorted.push_back({n, where});
+                        }
+                        std::sort(sorted.begin(), sorted.end(), std::greater<>());
+
+                        out << "---- profile ----\n";
+                        out << std::format(
+                                "{} samples every {} us, {} dropped\n",
+                                sample_count, interval_us, dropped
+                        );
+                        out << std::format("{:>8} {:>7}  {}\n", "samples", "%", "line");
+                        for (auto& [n, where] : sorted) {
+                                out << std::format(
+                                        "{:>8} {:>6.2f}%  {}:{}\n",
+                                        n, 100.0 * n / sample_count,
+                                        where.first, where.second
+                                );
+                        }
+                }
+
+                // collapsed stacks, as consumed by flamegraph.pl
+                fn report_folded(std::ostream& out) {
+                        std::map<std::string, size_t> stacks;
+                        for (size_t i = 0; i < sample_count; ++i) {
+                                auto& s = samples[i];
+                                std::string key;
+                                for (uint32_t f = 0; f < s.depth; ++f) {
+                                        key += name(frames[s.offset + f]);
+                                        key += ';';
+                                }
+                                key += name(s.current);
+                                stacks[key]++;
+                        }
+                        for (auto& [stack, n] : stacks) {
+                                out << stack << ' ' << n << '\n';
+                        }
+                }
+        };
+
+        // a frame of p, if any, for as long as the scope runs; left
+        // however it ends, an error unwinding through it included
+        class Scope {
+                Profiler* p;
+
+        public:
+                Scope(
+                        Profiler* prof,
+                        const std::string* file,
+                        int line
+                ) : p(prof)
+                {
+                        if (p != nullptr) {
+                                p->enter(file, line);
+                        }
+                }
+
+                ~Scope() {
+                        if (p != nullptr) {
+                                p->leave();
+                        }
+                }
+
+                Scope(const Scope&) = delete;
+                fn operator=(const Scope&) -> Scope& = delete;
+        };
+}
@@ -0,0 +1,481 @@
+#pragma once
+#include "cpplox.hh"
+#include "errors.hh"
+#include "token.hh"
+#include "ast.hh"
+#include "stmt.hh"
+#include "stack.hh"
+
+// Capture analysis, run once over a parsed script. Decides for every name
+// where it lives at run time: in the environment chain, in the flat
+// upvalues of the running closure, or, for a local function reading its
+// own name, in nothing but the running closure. A function captures only
+// the enclosing locals it mentions, itself or through a nested function,
+// so a closure keeps exactly those values alive and no scope around it.
+//
+// A captured variable that is assigned anywhere is boxed: it lives in a
+// cell shared by the defining scope and every closure. Any other captured
+// variable can not change after the closure is made and is copied.
+// Top-level names are globals, looked up by name and never captured.
+namespace resolver {
+        class Resolver : public ast::Visitor<std::any>,
+                         public stmt::Visitor<std::any>
+        {
+                class Variable {
+                public:
+                        bool captured = false;
+                        bool assigned = false;
+                        // the function or class it names, while its body
+                        // is resolved
+                        const stmt::Stmt* declaring = nullptr;
+                        // boxed flags of the declaration, uses and captures
+                        std::vector<bool*> flags;
+                        // reads of its own name inside a local function
+                        std::vector<std::pair<ast::Variable*, stmt::Function*>> self_reads;
+                };
+
+                using Scope = std::unordered_map<std::string, Variable*>;
+
+                enum function_kind {
+                        FUNCTION, METHOD, INITIALIZER,
+                };
+
+                enum class_kind {
+                        NONE, CLASS, SUBCLASS,
+                };
+
+                class FunctionScope {
+                public:
+                        // nullptr for top-level code
+                        stmt::Function* function;
+                        function_kind kind;
+                        FunctionScope* enclosing;
+                        std::vector<Scope> scopes;
+                        // variable of each upvalue
+                        std::vector<Variable*> upvalues;
+                };
+
+                std::deque<Variable> variables;
+                FunctionScope* current = nullptr;
+                class_kind current_class = NONE;
+
+                fn resolve(const std::shared_ptr<ast::Expr>& expr) {
+                        stack::guard([&] {
+                                expr->accept(*this);
+                        });
+                }
+
+                fn resolve(const std::shared_ptr<stmt::Stmt>& statement) {
+                        // nullptr after a syntax error
+                        if (statement != nullptr) {
+                                stack::guard([&] {
+                                        statement->accept(*this);
+                                });
+                        }
+                }
+
+                fn resolve_all(const std::vector<std::shared_ptr<stmt::Stmt>>& statements) {
+                        for (auto& statement : statements) {
+                                resolve(statement);
+                        }
+                }
+
+                // index of a capture of v, a local of the function around f
+                fn capture(stmt::Function& f, Variable& v, const token::Token& name) -> int {
+                        for (size_t i = 0; i < f.captures.size(); ++i) {
+                                if (f.captures[i].upvalue == -1 && f.captures[i].name.lexeme == name.lexeme) {
+                                        return i;
+                                }
+                        }
+                        v.captured = true;
+                        auto& c = f.captures.emplace_back(stmt::Capture{name, -1, false});
+                        v.flags.push_back(&c.boxed);
+                        return f.captures.size() - 1;
+                }
+
+                // every use of v is known once its scope ends
+                fn finish(Variable& v) {
+                        // a reassigned function can not stand for itself
+                        if (v.assigned) {
+                                for (auto [expr, f] : v.self_reads) {
+                                        expr->where = ast::UPVALUE;
+                                        expr->upvalue = capture(*f, v, expr->name);
+                                        v.flags.push_back(&expr->boxed);
+                                }
+                        }
+                        bool boxed = v.captured && v.assigned;
+                        for (auto flag : v.flags) {
+                                *flag = boxed;
+                        }
+                }
+
+                fn begin_scope() {
+                        current->scopes.emplace_back();
+                }
+
+                fn end_scope() {
+                        for (auto& [name, v] : current->scopes.back()) {
+                                finish(*v);
+                        }
+                        current->scopes.pop_back();
+                }
+
+                fn find_local(FunctionScope& f, const std::string& name) -> Variable* {
+                        for (auto s = f.scopes.rbegin(); s != f.scopes.rend(); ++s) {
+                                if (auto it = s->find(name); it != s->end()) {
+                                        return it->second;
+                                }
+                        }
+                        return nullptr;
+                }
+
+                fn add_upvalue(FunctionScope& f, Variable& v, const token::Token& name, int from) -> int {
+                        for (size_t i = 0; i < f.upvalues.size(); ++i) {
+                                if (f.upvalues[i] == &v) {
+                                        return i;
+                                }
+                        }
+                        v.captured = true;
+                        // captured before the function it names exists,
+                        // only a cell sees the value assigned later
+                        if (v.declaring != nullptr) {
+                                v.assigned = true;
+                        }
+                        auto& c = f.function->captures.emplace_back(stmt::Capture{name, from, false});
+                        v.flags.push_back(&c.boxed);
+                        f.upvalues.push_back(&v);
+                        return f.upvalues.size() - 1;
+                }
+
+                // upvalue of f holding name, -1 for a global; every
+                // function in between captures it too, to pass it on
+                fn resolve_upvalue(FunctionScope& f, const token::Token& name) -> int {
+                        if (f.enclosing == nullptr) {
+                                return -1;
+                        }
+                        if (auto v = find_local(*f.enclosing, name.lexeme)) {
+                                return add_upvalue(f, *v, name, -1);
+                        }
+                        auto from = resolve_upvalue(*f.enclosing, name);
+                        if (from == -1) {
+                                return -1;
+                        }
+                        return add_upvalue(f, *f.enclosing->upvalues[from], name, from);
+                }
+
+                template<class E>
+                fn resolve_name(E& expr, bool assign) {
+                        if (auto v = find_local(*current, expr.name.lexeme)) {
+                                v->assigned |= assign;
+                                v->flags.push_back(&expr.boxed);
+                                return;
+                        }
+                        auto i = resolve_upvalue(*current, expr.name);
+                        if (i == -1) {
+                                return;
+                        }
+                        auto v = current->upvalues[i];
+                        v->assigned |= assign;
+                        v->flags.push_back(&expr.boxed);
+                        expr.where = ast::UPVALUE;
+                        expr.upvalue = i;
+                }
+
+                // boxed is nullptr for this and super, never assigned
+                fn declare(const token::Token& name, bool* boxed) -> Variable* {
+                        if (current->scopes.empty()) {
+                                return nullptr;
+                        }
+                        auto& scope = current->scopes.back();
+                        if (scope.contains(name.lexeme)) {
+                                errors::error(name, "Already a variable with this name in this scope.");
+                        }
+                        auto& v = variables.emplace_back();
+                        if (boxed != nullptr) {
+                                v.flags.push_back(boxed);
+                        }
+                        scope[name.lexeme] = &v;
+                        return &v;
+                }
+
+                fn resolve_function(stmt::Function& stmt, function_kind kind) {
+                        FunctionScope f{&stmt, kind, current, {}, {}};
+                        current = &f;
+                        // this, parameters and body share the call environment
+                        begin_scope();
+                        if (kind != FUNCTION) {
+                                auto self = stmt.name;
+                                self.type = token::THIS;
+                                self.lexeme = "this";
+                                declare(self, nullptr);
+                        }
+                        for (auto& param : stmt.params) {
+                                declare(param.name, &param.boxed);
+                        }
+                        resolve_all(stmt.body);
+                        end_scope();
+                        current = f.enclosing;
+                }
+
+        public:
+                fn resolve(const std::vector<std::shared_ptr<stmt::Stmt>>& statements) {
+                        FunctionScope top{nullptr, FUNCTION, nullptr, {}, {}};
+                        current = &top;
+                        resolve_all(statements);
+                        current = nullptr;
+                }
+
+                // A body parsed after the script, see parser::expand().
+                // Only those of top-level code are deferred, and they
+                // see no locals around them but super, which a deferred
+                // method never names; what they resolve to is the same
+                // as it would have been in place.
+                fn resolve(stmt::Function& function, bool method) {
+                        FunctionScope top{nullptr, FUNCTION, nullptr, {}, {}};
+                        current = &top;
+                        current_class = method ? CLASS : NONE;
+                        resolve_function(
+                                function,
+                                !method ? FUNCTION : function.initializer ? INITIALIZER : METHOD
+                        );
+                        current_class = NONE;
+                        current = nullptr;
+                }
+
+                fn resolve(stmt::Block& block) {
+                        FunctionScope top{nullptr, FUNCTION, nullptr, {}, {}};
+                        current = &top;
+                        visitBlockStmt(block);
+                        current = nullptr;
+                }
+
+                fn visitBinaryExpr(ast::Binary& expr) -> std::any {
+                        resolve(expr.left);
+                        resolve(expr.right);
+                        return {};
+                }
+
+                fn visitGroupingExpr(ast::Grouping& expr) -> std::any {
+                        resolve(expr.expression);
+                        return {};
+                }
+
+                fn visitLiteralExpr(ast::Literal&) -> std::any {
+                        return {};
+                }
+
+                fn visitUnaryExpr(ast::Unary& expr) -> std::any {
+                        resolve(expr.right);
+                        return {};
+                }
+
+                fn visitVariableExpr(ast::Variable& expr) -> std::any {
+                        if (expr.name.type == token::THIS && current_class == NONE) {
+                                errors::error(expr.name, "Can't use 'this' outside of a class.");
+                                return {};
+                        }
+                        // a local function reading its own name
+                        auto f = current->function;
+                        if (f != nullptr && expr.name.lexeme == f->name.lexeme
+                                && find_local(*current, expr.name.lexeme) == nullptr) {
+                                auto v = find_local(*current->enclosing, expr.name.lexeme);
+                                if (v != nullptr && v->declaring == f) {
+                                        expr.where = ast::SELF;
+                                        v->self_reads.push_back({&expr, f});
+                                        return {};
+                                }
+                        }
+                        resolve_name(expr, false);
+                        return {};
+                }
+
+                fn visitAssignExpr(ast::Assign& expr) -> std::any {
+                        resolve(expr.value);
+                        resolve_name(expr, true);
+                        return {};
+                }
+
+                fn visitCallExpr(ast::Call& expr) -> std::any {
+                        resolve(expr.callee);
+                        for (auto& arg : expr.arguments) {
+                                resolve(arg);
+                        }
+                        return {};
+                }
+
+                fn visitIndexExpr(ast::Index& expr) -> std::any {
+                        resolve(expr.object);
+                        resolve(expr.index);
+                        return {};
+                }
+
+                fn visitIndexSetExpr(ast::IndexSet& expr) -> std::any {
+                        resolve(expr.object);
+                        resolve(expr.index);
+                        resolve(expr.value);
+                        return {};
+                }
+
+                fn visitArrayLiteralExpr(ast::ArrayLiteral& expr) -> std::any {
+                        for (auto& e : expr.elements) {
+                                resolve(e);
+                        }
+                        return {};
+                }
+
+                fn visitMapLiteralExpr(ast::MapLiteral& expr) -> std::any {
+                        for (size_t i = 0; i < expr.keys.size(); ++i) {
+                                resolve(expr.keys[i]);
+                                resolve(expr.values[i]);
+                        }
+                        return {};
+                }
+
+                fn visitLogicalExpr(ast::Logical& expr) -> std::any {
+                        resolve(expr.left);
+                        resolve(expr.right);
+                        return {};
+                }
+
+                fn visitGetExpr(ast::Get& expr) -> std::any {
+                        resolve(expr.object);
+                        return {};
+                }
+
+                fn visitSetExpr(ast::Set& expr) -> std::any {
+                        resolve(expr.object);
+                        resolve(expr.value);
+                        return {};
+                }
+
+                fn visitSuperExpr(ast::Super& expr) -> std::any {
+                        if (current_class == NONE) {
+                                errors::error(expr.keyword, "Can't use 'super' outside of a class.");
+                                return {};
+                        }
+                        if (current_class != SUBCLASS) {
+                                errors::error(expr.keyword, "Can't use 'super' in a class with no superclass.");
+                                return {};
+                        }
+                        resolve_name(*expr.superclass, false);
+                        resolve_name(*expr.self, false);
+                        return {};
+                }
+
+                // quickened at run time, after resolving; as their generic node
+                fn visitNumberBinaryExpr(ast::NumberBinary& expr) -> std::any {
+                        return visitBinaryExpr(*expr.generic);
+                }
+
+                fn visitStringAddExpr(ast::StringAdd& expr) -> std::any {
+                        return visitBinaryExpr(*expr.generic);
+                }
+
+                fn visitExpressionStmt(stmt::Expression& stmt) -> std::any {
+                        resolve(stmt.expression);
+                        return {};
+                }
+
+                fn visitPrintStmt(stmt::Print& stmt) -> std::any {
+                        resolve(stmt.expression);
+                        return {};
+                }
+
+                // the initializer sees the enclosing name, not this one
+                fn visitVarStmt(stmt::Var& stmt) -> std::any {
+                        if (stmt.initializer != nullptr) {
+                                resolve(stmt.initializer);
+                        }
+                        declare(stmt.name, &stmt.boxed);
+                        return {};
+                }
+
+                fn visitBlockStmt(stmt::Block& stmt) -> std::any {
+                        begin_scope();
+                        resolve_all(stmt.statements);
+                        end_scope();
+                        return {};
+                }
+
+                fn visitImportStmt(stmt::Import&) -> std::any {
+                        return {};
+                }
+
+                fn visitIfStmt(stmt::If& stmt) -> std::any {
+                        resolve(stmt.condition.expr);
+                        resolve(stmt.then_branch);
+                        resolve(stmt.else_branch);
+                        return {};
+                }
+
+                fn visitWhileStmt(stmt::While& stmt) -> std::any {
+                        resolve(stmt.condition.expr);
+                        resolve(stmt.body);
+                        if (stmt.increment != nullptr) {
+                                resolve(stmt.increment);
+                        }
+                        return {};
+                }
+
+                // the name is declared first, so the body can call itself
+                fn visitFunctionStmt(stmt::Function& stmt) -> std::any {
+                        auto v = declare(stmt.name, &stmt.boxed);
+                        if (v != nullptr) {
+                                v->declaring = &stmt;
+                        }
+                        resolve_function(stmt, FUNCTION);
+                        if (v != nullptr) {
+                                v->declaring = nullptr;
+                        }
+                        return {};
+                }
+
+                // methods see super in a scope of its own around them
+                fn visitClassStmt(stmt::Class& stmt) -> std::any {
+                        auto enclosing_class = current_class;
+                        current_class = CLASS;
+                        auto v = declare(stmt.name, &stmt.boxed);
+                        if (v != nullptr) {
+                                v->declaring = &stmt;
+                        }
+
+                        if (stmt.superclass != nullptr) {
+                                if (stmt.superclass->name.lexeme == stmt.name.lexeme) {
+                                        errors::error(stmt.superclass->name, "A class can't inherit from itself.");
+                                }
+                                current_class = SUBCLASS;
+                                resolve(stmt.superclass);
+                                begin_scope();
+                                auto super = stmt.name;
+                                super.type = token::SUPER;
+                                super.lexeme = "super";
+                                declare(super, nullptr);
+                        }
+                        for (auto& method : stmt.methods) {
+                                resolve_function(*method, method->initializer ? INITIALIZER : METHOD);
+                        }
+                        if (stmt.superclass != nullptr) {
+                                end_scope();
+                        }
+
+                        if (v != nullptr) {
+                                v->declaring = nullptr;
+                        }
+                        current_class = enclosing_class;
+                        return {};
+                }
+
+                fn visitReturnStmt(stmt::Return& stmt) -> std::any {
+                        if (current->function == nullptr) {
+                                errors::error(stmt.keyword, "Can't return from top-level code.");
+                        }
+                        if (current->kind == INITIALIZER && stmt.value != nullptr) {
+                                errors::error(stmt.keyword, "Can't return a value from an initializer.");
+                        }
+                        if (stmt.value != nullptr) {
+                                resolve(stmt.value);
+                        }
+                        return {};
+                }
+        };
+}
@@ -1,49 +1,55 @@
 #pragma once
 #include "cpplox.hh"
+#include "errors.hh"
 #include "token.hh"
+#include "unicode.hh"
+#include "stats.hh"
+#include "alloc.hh"
 
 namespace scanner {
         class Scanner {
-                std::wstring source;
+                std::string source;
                 std::vector<token::Token> tokens;
                 size_t start;
                 size_t current;
                 size_t line;
                 size_t comment_embeds;
 
-                const std::unordered_map<std::wstring, token::token_type> keywords {
-                        {L"and",    token::AND},
-                        {L"class",  token::CLASS},
-                        {L"else",   token::ELSE},
-                        {L"false",  token::FALSE},
-                        {L"for",    token::FOR},
-                        {L"fun",    token::FUN},
-                        {L"if",     token::IF},
-                        {L"nil",    token::NIL},
-                        {L"or",     token::OR},
-                        {L"print",  token::PRINT},
-                        {L"return", token::RETURN},
-                        {L"super",  token::SUPER},
-                        {L"this",   token::THIS},
-                        {L"true",   token::TRUE},
-                        {L"var",    token::VAR},
-                        {L"while",  token::WHILE},
+                static inline const std::unordered_map<std::string, token::token_type> keywords {
+                        {"and",    token::AND},
+                        {"class",  token::CLASS},
+                        {"else",   token::ELSE},
+                        {"false",  token::FALSE},
+                        {"for",    token::FOR},
+                        {"fun",    token::FUN},
+                        {"if",     token::IF},
+                        {"import", token::IMPORT},
+                        {"nil",    token::NIL},
+                        {"or",     token::OR},
+                        {"print",  token::PRINT},
+                        {"return", token::RETURN},
+                        {"super",  token::SUPER},
+                        {"this",   token::THIS},
+                        {"true",   token::TRUE},
+                        {"var",    token::VAR},
+                        {"while",  token::WHILE},
                 };
 
                 fn is_at_end() -> bool {
                         return current >= source.length();
                 }
 
-                fn advance() -> wchar_t {
+                fn advance() -> char {
                         return source.at(current++);
                 }
 
-                fn is_alpha_numeric(wchar_t c) -> bool {
-                        return std::iswalpha(c) || std::iswdigit(c);
+                fn is_digit(char c) -> bool {
+                        return c >= '0' && c <= '9';
                 }
 
+
                 fn add_token(token::token_type type, std::any literal) {
-                        std::wstring text = source.substr(start, current-start);
+                        std::string text = source.substr(start, current-start);
                         tokens.push_back(token::Token(type, text, literal, line));
                 }
 
@@ -51,7 +57,7 @@ namespace scanner {
                         add_token(type, std::any());
                 }
 
-                fn match(wchar_t expected) -> bool {
+                fn match(char expected) -> bool {
                         if (source.at(current) != expected || is_at_end()) {
                                 return false;
                         }
@@ -60,14 +66,14 @@ namespace scanner {
                         return true;
                 }
 
-                fn peek() -> wchar_t {
+                fn peek() -> char {
                         if (is_at_end()) {
                                 return '\0';
                         }
                         return source.at(current);
                 }
 
-                fn peek_next() -> wchar_t {
+                fn peek_next() -> char {
                         if (current + 1 >= source.length()) {
                                 return '\0';
                         }
@@ -83,23 +89,23 @@ namespace scanner {
                         }
 
                         if (is_at_end()) {
-                                errors::error(line, L"Unterminated string.");
+                                errors::error(line, "Unterminated string.");
                                 return;
                         }
                         advance();
 
-                        std::wstring v = source.substr(start + 1, current-start - 2);
+                        std::string v = source.substr(start + 1, current-start - 2);
                         add_token(token::STRING, v);
                 }
 
                 fn number() {
-                        while (std::iswdigit(peek())) {
+                        while (is_digit(peek())) {
                                 advance();
                         }
 
-                        if (peek() == '.' && std::iswdigit(peek_next())) {
+                        if (peek() == '.' && is_digit(peek_next())) {
                                 advance();
-                                while (std::iswdigit(peek())) {
+                                while (is_digit(peek())) {
                                         advance();
                                 }
                         }
@@ -109,12 +115,26 @@ namespace scanner {
                         );
                 }
 
+                // XID_Continue*, only non-ascii bytes are decoded
                 fn identifier() {
-                        while (is_alpha_numeric(peek())) {
-                                advance();
+                        while (!is_at_end()) {
+                                auto c = static_cast<unsigned char>(source[current]);
+                                if (c < 0x80) {
+                                        if (!(unicode::ascii_class[c] & unicode::XID_CONTINUE)) {
+                                                break;
+                                        }
+                                        current++;
+                                        continue;
+                                }
+
+                                size_t next = current;
+                                if (!unicode::is_xid_continue(utils::decode_utf8(source, next))) {
+                                        break;
+                                }
+                                current = next;
                         }
 
-                        std::wstring key = source.substr(start, current-start);
+                        std::string key = source.substr(start, current-start);
                         token::token_type type = (
                                 keywords.contains(key)
                         ) ? keywords.at(key)
@@ -131,10 +151,10 @@ namespace scanner {
 
                 fn multiline_comment() {
                         comment_embeds++;
-                        wchar_t ch = advance();
+                        char ch = advance();
 
                         if (is_at_end()) {
-                                errors::error(line, L"Unterminated comment.");
+                                errors::error(line, "Unterminated comment.");
                                 return;
                         }
 
@@ -152,12 +172,15 @@ namespace scanner {
                 }
 
                 fn scan_token() {
-                        wchar_t ch = advance();
+                        char ch = advance();
                         switch (ch) {
                         case '(': add_token(token::LEFT_PAREN); break;
                         case ')': add_token(token::RIGHT_PAREN); break;
                         case '{': add_token(token::LEFT_BRACE); break;
                         case '}': add_token(token::RIGHT_BRACE); break;
+                        case '[': add_token(token::LEFT_BRACKET); break;
+                        case ']': add_token(token::RIGHT_BRACKET); break;
+                        case ':': add_token(token::COLON); break;
                         case ',': add_token(token::COMMA); break;
                         case '.': add_token(token::DOT); break;
                         case '-': add_token(token::MINUS); break;
@@ -203,31 +226,35 @@ namespace scanner {
                                 break;
                         case '"': string(); break;
                         default:
-                                if (std::iswdigit(ch)) {
+                                current = start;
+                                if (is_digit(ch)) {
+                                        current++;
                                         number();
-                                } else if (std::iswalpha(ch)) {
+                                } else if (unicode::is_xid_start(utils::decode_utf8(source, current))) {
                                         identifier();
                                 } else {
-                                        errors::error(line, L"Unexpected character");
+                                        errors::error(line, "Unexpected character");
                                 }
                                 break;
                         }
                 }
 
         public:
-                Scanner(std::wstring& source)
+                Scanner(const std::string& source)
                         : source(source), start(0),
                                 current(0), line(1),
                                 comment_embeds(0)
                 {}
 
                 fn scan_tokens() -> std::vector<token::Token> {
+                        alloc::Scope scope(alloc::SCANNER);
                         while (!is_at_end()) {
                                 start = current;
                                 scan_token();
                         }
 
-                        tokens.push_back(token::Token(token::FILE_EOF, L"", std::any(), line));
+                        tokens.push_back(token::Token(token::FILE_EOF, "", std::any(), line));
+                        STATS_ADD(tokens, tokens.size());
                         return tokens;
                 }
         };
@@ -0,0 +1,246 @@
+#pragma once
+#include "cpplox.hh"
+
+// Bulk kernels over contiguous doubles. The loops are written once with
+// GCC vector extensions; on x86-64 every entry point is cloned for AVX2
+// and the SSE2 baseline and picked at load time, elsewhere the compiler
+// lowers the vectors to whatever the target has, down to scalar code.
+// Reductions use several accumulators, so sums may differ from a
+// sequential sum in the last bits.
+#if defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx2", "default"), flatten))
+#else
+#define SIMD_CLONES __attribute__((flatten))
+#endif
+
+// The helpers return vectors by value, which has a different ABI with and
+// without AVX. They are always inlined so no call crosses that boundary,
+// and the warning about it, reported at the end of the translation unit,
+// is off.
+#define SIMD_INLINE inline __attribute__((always_inline))
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace simd {
+        enum op {
+                ADD, SUB, MUL, DIV,
+                LT, LE, GT, GE,
+                EQ, NE,
+        };
+
+        enum reduction {
+                SUM, MIN, MAX,
+        };
+
+        namespace {
+                typedef double vec __attribute__((vector_size(32)));
+                constexpr size_t width = sizeof(vec) / sizeof(double);
+
+                SIMD_INLINE fn load(const double* p) -> vec {
+                        vec v;
+                        __builtin_memcpy(&v, p, sizeof(v));
+                        return v;
+                }
+
+                SIMD_INLINE fn store(double* p, const vec& v) {
+                        __builtin_memcpy(p, &v, sizeof(v));
+                }
+
+                SIMD_INLINE fn splat(double d) -> vec {
+                        return vec{} + d;
+                }
+
+                // comparisons yield 1.0 / 0.0
+                template<op O, class T>
+                SIMD_INLINE fn apply(const T& a, const T& b) -> T {
+                        if constexpr (O == ADD) {
+                                return a + b;
+                        } else if constexpr (O == SUB) {
+                                return a - b;
+                        } else if constexpr (O == MUL) {
+                                return a * b;
+                        } else if constexpr (O == DIV) {
+                                return a / b;
+                        } else if constexpr (std::is_same_v<T, double>) {
+                                if constexpr (O == LT) return a < b;
+                                if constexpr (O == LE) return a <= b;
+                                if constexpr (O == GT) return a > b;
+                                if constexpr (O == GE) return a >= b;
+                                if constexpr (O == EQ) return a == b;
+                                return a != b;
+                        } else {
+                                if constexpr (O == LT) return __builtin_convertvector(-(a < b), vec);
+                                if constexpr (O == LE) return __builtin_convertvector(-(a <= b), vec);
+                                if constexpr (O == GT) return __builtin_convertvector(-(a > b), vec);
+                                if constexpr (O == GE) return __builtin_convertvector(-(a >= b), vec);
+                                if constexpr (O == EQ) return __builtin_convertvector(-(a == b), vec);
+                                return __builtin_convertvector(-(a != b), vec);
+                        }
+                }
+
+                // AV / BV: a / b is an array, otherwise the scalar as / bs
+                template<op O, bool AV, bool BV>
+                SIMD_INLINE fn map_loop(
+                        const double* a, double as,
+                        const double* b, double bs,
+                        double* out, size_t n
+                ) {
+                        size_t i = 0;
+                        vec va = splat(as);
+                        vec vb = splat(bs);
+                        for (; i + width <= n; i += width) {
+                                if constexpr (AV) va = load(a + i);
+                                if constexpr (BV) vb = load(b + i);
+                                store(out + i, apply<O>(va, vb));
+                        }
+                        for (; i < n; ++i) {
+                                out[i] = apply<O>(AV ? a[i] : as, BV ? b[i] : bs);
+                        }
+                }
+
+                template<op O>
+                SIMD_INLINE fn map_op(
+                        const double* a, double as,
+                        const double* b, double bs,
+                        double* out, size_t n
+                ) {
+                        if (a != nullptr && b != nullptr) {
+                                map_loop<O, true, true>(a, as, b, bs, out, n);
+                        } else if (a != nullptr) {
+                                map_loop<O, true, false>(a, as, b, bs, out, n);
+                        } else {
+                                map_loop<O, false, true>(a, as, b, bs, out, n);
+                        }
+                }
+
+                template<bool AV, bool BV>
+                SIMD_INLINE fn select_loop(
+                        const double* c,
+                        const double* a, double as,
+                        const double* b, double bs,
+                        double* out, size_t n
+                ) {
+                        size_t i = 0;
+                        vec va = splat(as);
+                        vec vb = splat(bs);
+                        for (; i + width <= n; i += width) {
+                                if constexpr (AV) va = load(a + i);
+                                if constexpr (BV) vb = load(b + i);
+                                store(out + i, load(c + i) != 0 ? va : vb);
+                        }
+                        for (; i < n; ++i) {
+                                out[i] = c[i] != 0 ? (AV ? a[i] : as) : (BV ? b[i] : bs);
+                        }
+                }
+
+                template<reduction R>
+                SIMD_INLINE fn combine(const vec& a, const vec& b) -> vec {
+                        if constexpr (R == SUM) {
+                                return a + b;
+                        } else if constexpr (R == MIN) {
+                                return a < b ? a : b;
+                        } else {
+                                return a > b ? a : b;
+                        }
+                }
+
+                template<reduction R>
+                SIMD_INLINE fn combine(double a, double b) -> double {
+                        if constexpr (R == SUM) {
+                                return a + b;
+                        } else if constexpr (R == MIN) {
+                                return a < b ? a : b;
+                        } else {
+                                return a > b ? a : b;
+                        }
+                }
+
+                template<reduction R>
+                SIMD_INLINE fn reduce_loop(const double* a, size_t n) -> double {
+                        double init = (R == SUM) ? 0.0 : a[0];
+                        vec acc0 = splat(init);
+                        vec acc1 = acc0;
+                        size_t i = 0;
+                        for (; i + 2 * width <= n; i += 2 * width) {
+                                acc0 = combine<R>(acc0, load(a + i));
+                                acc1 = combine<R>(acc1, load(a + i + width));
+                        }
+                        acc0 = combine<R>(acc0, acc1);
+                        double r = acc0[0];
+                        for (size_t l = 1; l < width; ++l) {
+                                r = combine<R>(r, acc0[l]);
+                        }
+                        for (; i < n; ++i) {
+                                r = combine<R>(r, a[i]);
+                        }
+                        return r;
+                }
+        }
+
+        // out[i] = a[i] op b[i]; a null a or b stands for the scalar as or bs
+        SIMD_CLONES fn map(
+                op o,
+                const double* a, double as,
+                const double* b, double bs,
+                double* out, size_t n
+        ) -> void {
+                switch (o) {
+                case ADD: return map_op<ADD>(a, as, b, bs, out, n);
+                case SUB: return map_op<SUB>(a, as, b, bs, out, n);
+                case MUL: return map_op<MUL>(a, as, b, bs, out, n);
+                case DIV: return map_op<DIV>(a, as, b, bs, out, n);
+                case LT:  return map_op<LT>(a, as, b, bs, out, n);
+                case LE:  return map_op<LE>(a, as, b, bs, out, n);
+                case GT:  return map_op<GT>(a, as, b, bs, out, n);
+                case GE:  return map_op<GE>(a, as, b, bs, out, n);
+                case EQ:  return map_op<EQ>(a, as, b, bs, out, n);
+                case NE:  return map_op<NE>(a, as, b, bs, out, n);
+                }
+        }
+
+        // out[i] = c[i] != 0 ? a[i] : b[i], a null a or b as in map()
+        SIMD_CLONES fn select(
+                const double* c,
+                const double* a, double as,
+                const double* b, double bs,
+                double* out, size_t n
+        ) -> void {
+                if (a != nullptr && b != nullptr) {
+                        select_loop<true, true>(c, a, as, b, bs, out, n);
+                } else if (a != nullptr) {
+                        select_loop<true, false>(c, a, as, b, bs, out, n);
+                } else if (b != nullptr) {
+                        select_loop<false, true>(c, a, as, b, bs, out, n);
+                } else {
+                        select_loop<false, false>(c, a, as, b, bs, out, n);
+                }
+        }
+
+        // n must be > 0 for MIN and MAX
+        SIMD_CLONES fn reduce(reduction r, const double* a, size_t n) -> double {
+                switch (r) {
+                case SUM: return reduce_loop<SUM>(a, n);
+                case MIN: return reduce_loop<MIN>(a, n);
+                case MAX: return reduce_loop<MAX>(a, n);
+                }
+                return 0.0;
+        }
+
+        SIMD_CLONES fn dot(const double* a, const double* b, size_t n) -> double {
+                vec acc0 = splat(0.0);
+                vec acc1 = acc0;
+                size_t i = 0;
+                for (; i + 2 * width <= n; i += 2 * width) {
+                        acc0 += load(a + i) * load(b + i);
+                        acc1 += load(a + i + width) * load(b + i + width);
+                }
+                acc0 += acc1;
+                double r = 0.0;
+                for (size_t l = 0; l < width; ++l) {
+                        r += acc0[l];
+                }
+                for (; i < n; ++i) {
+                        r += a[i] * b[i];
+                }
+                return r;
+        }
+}
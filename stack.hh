@@ -0,0 +1,281 @@
+#pragma once
+#include "cpplox.hh"
+#include "limits.hh"
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+// Segmented stacks for the recursive parts of the runtime: the parser,
+// the resolver, the evaluator and the destruction of syntax trees. Each
+// of them calls guard() where it recurses; when the thread's stack runs
+// low the rest of the recursion continues on a segment mapped from the
+// heap, and returns to the old stack once it unwinds. Nesting is
+// bounded by memory, not by the size of the first stack.
+//
+// The frames of a thread are spread over the suspended stacks below
+// the running one, each() hands their live ranges to the collector's
+// conservative scan. The segments of a thread are capped, a recursion
+// past them throws limits::exceeded.
+namespace stack {
+        // a recursion is moved once less than red_zone bytes are left
+        constexpr size_t red_zone = 256 << 10;
+        constexpr size_t segment_bytes = 8 << 20;
+        constexpr size_t guard_bytes = 4096;
+
+        // highest address of the stack of this thread
+        fn thread_top() -> uintptr_t {
+                thread_local uintptr_t top = [] {
+                        pthread_attr_t attr;
+                        void* addr = nullptr;
+                        size_t size = 0;
+                        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+                                pthread_attr_getstack(&attr, &addr, &size);
+                                pthread_attr_destroy(&attr);
+                        }
+                        return reinterpret_cast<uintptr_t>(addr) + size;
+                }();
+                return top;
+        }
+
+        class Range {
+        public:
+                uintptr_t low;
+                uintptr_t high;
+                // the heap that last scanned it, see gc::Heap::scan_stack
+                const void* scanned_by = nullptr;
+        };
+
+        class Segment {
+        public:
+                // the lowest page is a guard
+                char* base;
+        };
+
+        class Thread {
+        public:
+                // top of the stack running now
+                uintptr_t top = 0;
+                // the stacks left for a segment, innermost last
+                std::vector<Range> suspended;
+                // segments kept for the next move
+                std::vector<Segment> spare;
+                // bytes of segments in use at most
+                uint64_t max_bytes = limits::Limits().stack_bytes;
+
+                ~Thread() {
+                        for (auto& s : spare) {
+                                ::munmap(s.base, segment_bytes);
+                        }
+                }
+        };
+
+        namespace {
+                // guard() moves below this address; all ones until the
+                // thread's first guard() finds its real stack
+                thread_local uintptr_t limit = std::numeric_limits<uintptr_t>::max();
+
+                fn thread() -> Thread& {
+                        thread_local Thread t;
+                        return t;
+                }
+
+                // what runs on a segment, its exception is rethrown on
+                // the stack that moved
+                class Task {
+                public:
+                        void (*call)(void*);
+                        void* arg;
+                        std::exception_ptr error;
+#ifdef __SANITIZE_ADDRESS__
+                        const void* caller_bottom = nullptr;
+                        size_t caller_size = 0;
+#endif
+                };
+
+                thread_local Task* starting = nullptr;
+        }
+
+        fn take_segment() -> Segment {
+                auto& t = thread();
+                if (!t.spare.empty()) {
+                        auto s = t.spare.back();
+                        t.spare.pop_back();
+                        return s;
+                }
+                auto p = ::mmap(
+                        nullptr, segment_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+                );
+                if (p == MAP_FAILED) {
+                        throw limits::exceeded("Stack limit exceeded.");
+                }
+                ::mprotect(p, guard_bytes, PROT_NONE);
+                return Segment{static_cast<char*>(p)};
+        }
+
+        fn give_segment(Segment s) {
+                auto& t = thread();
+                // a recursion going back and forth over a boundary finds
+                // its segments mapped already
+                if (t.spare.size() < 4) {
+                        t.spare.push_back(s);
+                } else {
+                        ::munmap(s.base, segment_bytes);
+                }
+        }
+
+        fn trampoline() {
+                auto task = starting;
+#ifdef __SANITIZE_ADDRESS__
+                __sanitizer_finish_switch_fiber(nullptr, &task->caller_bottom, &task->caller_size);
+#endif
+                try {
+                        task->call(task->arg);
+                } catch (...) {
+                        task->error = std::current_exception();
+                }
+#ifdef __SANITIZE_ADDRESS__
+                __sanitizer_start_switch_fiber(nullptr, task->caller_bottom, task->caller_size);
+#endif
+        }
+
+        // runs call(arg) on a fresh segment and comes back when it
+        // returns; past the thread's max_bytes only if not limited
+        [[gnu::noinline]]
+        fn move(void (*call)(void*), void* arg, bool limited) -> void {
+                auto& t = thread();
+                // a segment for each stack suspended
+                if (limited && (t.suspended.size() + 1) * segment_bytes > t.max_bytes) {
+                        throw limits::exceeded("Stack limit exceeded.");
+                }
+                auto segment = take_segment();
+                ucontext_t back;
+                ucontext_t to;
+                Task task{call, arg, nullptr};
+
+                getcontext(&to);
+                to.uc_stack.ss_sp = segment.base;
+                to.uc_stack.ss_size = segment_bytes;
+                to.uc_link = &back;
+                makecontext(&to, trampoline, 0);
+
+                // everything from here up, the registers saved in back
+                // included, stays reachable for the collector
+                auto low = std::min({
+                        reinterpret_cast<uintptr_t>(__builtin_frame_address(0)),
+                        reinterpret_cast<uintptr_t>(&back),
+                        reinterpret_cast<uintptr_t>(&to),
+                });
+                t.suspended.push_back({low, t.top});
+                auto old_top = t.top;
+                auto old_limit = limit;
+                t.top = reinterpret_cast<uintptr_t>(segment.base) + segment_bytes;
+                limit = reinterpret_cast<uintptr_t>(segment.base) + guard_bytes + red_zone;
+
+                starting = &task;
+#ifdef __SANITIZE_ADDRESS__
+                void* fake = nullptr;
+                __sanitizer_start_switch_fiber(&fake, segment.base, segment_bytes);
+#endif
+                swapcontext(&back, &to);
+#ifdef __SANITIZE_ADDRESS__
+                __sanitizer_finish_switch_fiber(fake, nullptr, nullptr);
+#endif
+
+                t.top = old_top;
+                limit = old_limit;
+                t.suspended.pop_back();
+                give_segment(segment);
+                if (task.error) {
+                        std::rethrow_exception(task.error);
+                }
+        }
+
+        // finds the stack of a thread on its first guard()
+        [[gnu::noinline]]
+        fn start() {
+                auto& t = thread();
+                if (t.top != 0) {
+                        return;
+                }
+                pthread_attr_t attr;
+                void* addr = nullptr;
+                size_t size = 0;
+                if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+                        pthread_attr_getstack(&attr, &addr, &size);
+                        pthread_attr_destroy(&attr);
+                }
+                t.top = thread_top();
+                limit = addr != nullptr ? reinterpret_cast<uintptr_t>(addr) + std::min(red_zone, size / 2) : 0;
+        }
+
+        // the stack pointer; neither a local's address, which gets every
+        // caller a stack protector, nor the frame address, which keeps a
+        // frame pointer in it
+        [[gnu::always_inline]] inline fn pointer() -> uintptr_t {
+                uintptr_t sp;
+#if defined(__x86_64__)
+                asm("movq %%rsp, %0" : "=r"(sp));
+#elif defined(__aarch64__)
+                asm("mov %0, sp" : "=r"(sp));
+#else
+                sp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+#endif
+                return sp;
+        }
+
+        // the stack is about to run out, or this thread has not looked
+        // for its stack yet
+        [[gnu::always_inline]] inline fn low() -> bool {
+                return pointer() < limit;
+        }
+
+        // the bytes of segments a recursion of this thread may take
+        fn set_limit(uint64_t bytes) {
+                thread().max_bytes = bytes;
+        }
+
+        // f() on a new segment, for a caller that found the stack low()
+        template<class F>
+        [[gnu::noinline]] fn grow(F&& f, bool limited = true) -> decltype(f()) {
+                if (thread().top == 0) {
+                        start();
+                        if (!low()) {
+                                return f();
+                        }
+                }
+
+                using R = decltype(f());
+                if constexpr (std::is_void_v<R>) {
+                        move([](void* p) { (*static_cast<std::remove_reference_t<F>*>(p))(); }, &f, limited);
+                } else {
+                        std::optional<R> result;
+                        auto call = [&] { result.emplace(f()); };
+                        move([](void* p) { (*static_cast<decltype(call)*>(p))(); }, &call, limited);
+                        return std::move(*result);
+                }
+        }
+
+        // f(), on a new segment if the stack is about to run out; one
+        // that must not throw, a destructor, is not limited
+        template<class F>
+        [[gnu::always_inline]] inline fn guard(F&& f, bool limited = true) -> decltype(f()) {
+                if (low()) [[unlikely]] {
+                        return grow(f, limited);
+                }
+                return f();
+        }
+
+        // the live ranges of this thread's stacks, the running one from
+        // low up; a suspended range is not written until it runs again
+        template<class F>
+        fn each(uintptr_t low, F f) {
+                auto& t = thread();
+                Range running{low, t.top != 0 ? t.top : thread_top()};
+                f(running);
+                for (auto& r : t.suspended) {
+                        f(r);
+                }
+        }
+}
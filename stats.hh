@@ -0,0 +1,232 @@
+#pragma once
+#include "cpplox.hh"
+
+// Runtime counters are compiled in only with -DLOX_STATS, otherwise
+// STATS_ADD expands to nothing. Phase timings are always available.
+#ifdef LOX_STATS
+#define STATS_ADD(counter, n) (stats::local.counter += (n))
+#define STATS_LOOP(file, line, n) (stats::loop((file), (line), (n)))
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_LOOP(file, line, n) ((void)0)
+#endif
+
+namespace stats {
+        class Counters {
+        public:
+                uint64_t tokens = 0;
+                uint64_t ast_nodes = 0;
+                // bodies only skimmed by the parser, and those run since
+                uint64_t deferred_bodies = 0;
+                uint64_t expanded_bodies = 0;
+                uint64_t statements = 0;
+                uint64_t env_frames = 0;
+                uint64_t lookups = 0;
+                // enclosing frames walked by all lookups
+                uint64_t lookup_depth = 0;
+                uint64_t concatenations = 0;
+                uint64_t native_calls = 0;
+                uint64_t calls = 0;
+                uint64_t closures = 0;
+                // values copied or shared into closures
+                uint64_t captures = 0;
+                // property sites, see cache.hh
+                uint64_t cache_hits = 0;
+                uint64_t cache_misses = 0;
+                // binary sites, see ast::Quickened
+                uint64_t generic_binaries = 0;
+                uint64_t quickened = 0;
+                uint64_t quick_hits = 0;
+                uint64_t quick_misses = 0;
+
+                fn operator+=(const Counters& o) -> Counters& {
+                        tokens += o.tokens;
+                        ast_nodes += o.ast_nodes;
+                        deferred_bodies += o.deferred_bodies;
+                        expanded_bodies += o.expanded_bodies;
+                        statements += o.statements;
+                        env_frames += o.env_frames;
+                        lookups += o.lookups;
+                        lookup_depth += o.lookup_depth;
+                        concatenations += o.concatenations;
+                        native_calls += o.native_calls;
+                        calls += o.calls;
+                        closures += o.closures;
+                        captures += o.captures;
+                        cache_hits += o.cache_hits;
+                        cache_misses += o.cache_misses;
+                        generic_binaries += o.generic_binaries;
+                        quickened += o.quickened;
+                        quick_hits += o.quick_hits;
+                        quick_misses += o.quick_misses;
+                        return *this;
+                }
+        };
+
+        enum phase {
+                READ, SCAN, PARSE, INTERPRET,
+                PHASES
+        };
+
+        const std::string phase_strs[] = {
+                "read", "scan", "parse", "interpret",
+        };
+
+        // runs and iterations of one loop in the source
+        class Loop {
+        public:
+                uint64_t runs = 0;
+                uint64_t iterations = 0;
+        };
+
+        // module path, nullptr for interactive input, and line
+        using loop_key = std::pair<const std::string*, int>;
+
+        // counters of this thread, merged into totals by flush()
+        thread_local Counters local;
+        thread_local std::map<loop_key, Loop> local_loops;
+
+        // called once per finished loop, not per iteration
+        fn loop(const std::string* file, int line, uint64_t iterations) {
+                auto& l = local_loops[{file, line}];
+                l.runs++;
+                l.iterations += iterations;
+        }
+
+        namespace {
+                std::mutex mtx;
+                Counters totals;
+                std::map<loop_key, Loop> loops;
+                // nanoseconds, summed over all threads
+                std::atomic<int64_t> phase_wall[PHASES];
+                std::atomic<int64_t> phase_cpu[PHASES];
+        }
+
+        fn flush() {
+                std::lock_guard lock(mtx);
+                totals += local;
+                local = Counters();
+                for (auto& [key, l] : local_loops) {
+                        loops[key].runs += l.runs;
+                        loops[key].iterations += l.iterations;
+                }
+                local_loops.clear();
+        }
+
+        fn cpu_now(clockid_t clock) -> int64_t {
+                timespec ts;
+                clock_gettime(clock, &ts);
+                return ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+        }
+
+        fn wall_now() -> int64_t {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()
+                ).count();
+        }
+
+        // times a phase from construction to destruction
+        class Phase {
+                phase p;
+                int64_t wall;
+                int64_t cpu;
+
+        public:
+                Phase(
+                        phase ph
+                ) : p(ph), wall(wall_now()),
+                        cpu(cpu_now(CLOCK_THREAD_CPUTIME_ID))
+                {}
+
+                ~Phase() {
+                        phase_wall[p] += wall_now() - wall;
+                        phase_cpu[p] += cpu_now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+                }
+        };
+
+        // wall and cpu time of the whole process
+        namespace {
+                int64_t start_wall = wall_now();
+        }
+
+        fn report(std::ostream& out) {
+                flush();
+
+                auto ms = [](int64_t ns) { return ns / 1e6; };
+                out << "---- stats ----\n";
+                out << std::format("{:<22}{:>12}{:>12}\n", "phase", "wall ms", "cpu ms");
+                for (size_t p = 0; p < PHASES; ++p) {
+                        out << std::format(
+                                "{:<22}{:>12.3f}{:>12.3f}\n",
+                                phase_strs[p], ms(phase_wall[p]), ms(phase_cpu[p])
+                        );
+                }
+                out << std::format(
+                        "{:<22}{:>12.3f}{:>12.3f}\n",
+                        "total", ms(wall_now() - start_wall),
+                        ms(cpu_now(CLOCK_PROCESS_CPUTIME_ID))
+                );
+
+#ifdef LOX_STATS
+                out << std::format("{:<22}{:>12}\n", "tokens", totals.tokens);
+                out << std::format("{:<22}{:>12}\n", "ast nodes", totals.ast_nodes);
+                out << std::format(
+                        "{:<22}{:>12}   parsed {}\n",
+                        "deferred bodies", totals.deferred_bodies, totals.expanded_bodies
+                );
+                out << std::format("{:<22}{:>12}\n", "statements executed", totals.statements);
+                out << std::format("{:<22}{:>12}\n", "environment frames", totals.env_frames);
+                out << std::format(
+                        "{:<22}{:>12}   avg depth {:.2f}\n",
+                        "variable lookups", totals.lookups,
+                        totals.lookups ? double(totals.lookup_depth) / totals.lookups : 0.0
+                );
+                out << std::format("{:<22}{:>12}\n", "string concatenations", totals.concatenations);
+                out << std::format("{:<22}{:>12}\n", "native calls", totals.native_calls);
+                out << std::format("{:<22}{:>12}\n", "function calls", totals.calls);
+                out << std::format("{:<22}{:>12}\n", "closures", totals.closures);
+                out << std::format("{:<22}{:>12}\n", "captured values", totals.captures);
+                out << std::format(
+                        "{:<22}{:>12}   misses {}\n",
+                        "property cache hits", totals.cache_hits, totals.cache_misses
+                );
+                auto quick_runs = totals.quick_hits + totals.quick_misses;
+                out << std::format(
+                        "{:<22}{:>12}   misses {}, {:.2f}% hit\n",
+                        "quickened binary hits", totals.quick_hits, totals.quick_misses,
+                        quick_runs ? 100.0 * totals.quick_hits / quick_runs : 0.0
+                );
+                out << std::format(
+                        "{:<22}{:>12}   generic runs {}\n",
+                        "quickened sites", totals.quickened, totals.generic_binaries
+                );
+
+                // ten loops with the most iterations
+                std::vector<std::pair<loop_key, Loop>> hot(loops.begin(), loops.end());
+                std::sort(hot.begin(), hot.end(), [](auto& a, auto& b) {
+                        return a.second.iterations > b.second.iterations;
+                });
+                if (hot.size() > 10) {
+                        hot.resize(10);
+                }
+                if (!hot.empty()) {
+                        out << std::format("{:<22}{:>12}{:>14}\n", "hot loops", "runs", "iterations");
+                }
+                for (auto& [key, l] : hot) {
+                        auto file = key.first == nullptr
+                                ? std::string("<stdin>")
+                                : std::filesystem::path(*key.first).filename().string();
+                        out << std::format(
+                                "  {:<20}{:>12}{:>14}\n",
+                                std::format("{}:{}", file, key.second), l.runs, l.iterations
+                        );
+                }
+#else
+                out << "counters              disabled, build with -DLOX_STATS\n";
+#endif
+
+                rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                out << std::format("{:<22}{:>12} KiB\n", "peak rss", usage.ru_maxrss);
+        }
+}
@@ -2,12 +2,23 @@
 #include "cpplox.hh"
 #include "./token.hh"
 #include "./ast.hh"
+#include "stats.hh"
+
+namespace module {
+        class Module;
+}
 
 namespace stmt {
         class Expression;
         class Print;
         class Var;
         class Block;
+        class Import;
+        class If;
+        class While;
+        class Function;
+        class Return;
+        class Class;
 
         template<class R>
         class Visitor {
@@ -16,10 +27,22 @@ namespace stmt {
                 virtual fn visitPrintStmt(Print& stmt) -> R = 0;
                 virtual fn visitVarStmt(Var& stmt) -> R = 0;
                 virtual fn visitBlockStmt(Block& stmt) -> R = 0;
+                virtual fn visitImportStmt(Import& stmt) -> R = 0;
+                virtual fn visitIfStmt(If& stmt) -> R = 0;
+                virtual fn visitWhileStmt(While& stmt) -> R = 0;
+                virtual fn visitFunctionStmt(Function& stmt) -> R = 0;
+                virtual fn visitReturnStmt(Return& stmt) -> R = 0;
+                virtual fn visitClassStmt(Class& stmt) -> R = 0;
         };
 
         class Stmt {
         public:
+                // line of the first token, set by the parser
+                int line = 0;
+
+                Stmt() {
+                        STATS_ADD(ast_nodes, 1);
+                }
                 virtual ~Stmt() = default;
                 virtual fn accept(Visitor<std::any>& visitor) -> std::any = 0;
         };
@@ -56,6 +79,10 @@ namespace stmt {
         public:
                 token::Token name;
                 std::shared_ptr<ast::Expr> initializer;
+                // captured by a closure and assigned, see ast::Variable
+                bool boxed = false;
+                // as in ast::Assign
+                uint32_t trace_name = 0;
 
                 fn accept(Visitor<std::any>& visitor) -> std::any {
                         return visitor.visitVarStmt(*this);
@@ -68,9 +95,26 @@ namespace stmt {
                 {}
         };
 
+        // A body the parser only checked, see parser::Skim. Its tokens
+        // are parsed and resolved by parser::expand() the first time it
+        // runs; tokens is nullptr once that is done, or if it never was
+        // deferred.
+        class Deferred {
+        public:
+                std::shared_ptr<const std::vector<token::Token>> tokens;
+                // the token after the opening brace
+                size_t start = 0;
+                // of a class, resolved with this in scope
+                bool method = false;
+        };
+
         class Block : public Stmt {
         public:
                 std::vector<std::shared_ptr<stmt::Stmt>> statements;
+                // false if no statement declares a name in the block,
+                // it then runs in the enclosing environment
+                bool declares = true;
+                Deferred deferred;
 
                 fn accept(Visitor<std::any>& visitor) -> std::any {
                         return visitor.visitBlockStmt(*this);
@@ -81,4 +125,177 @@ namespace stmt {
                 ) : statements(s)
                 {}
         };
+
+        class Import : public Stmt {
+        public:
+                token::Token keyword;
+                std::string path;
+                // filled by module::Loader before execution,
+                // owned by the loader's module cache
+                module::Module* module = nullptr;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitImportStmt(*this);
+                }
+
+                Import(
+                        token::Token k,
+                        std::string p
+                ) : keyword(k), path(p)
+                {}
+        };
+
+        // Condition of an if or a loop. A comparison is kept apart so
+        // it can be tested on numbers directly, without boxing a bool.
+        class Condition {
+        public:
+                std::shared_ptr<ast::Expr> expr;
+                ast::Binary* comparison = nullptr;
+
+                Condition(
+                        std::shared_ptr<ast::Expr> e
+                ) : expr(e)
+                {
+                        auto b = dynamic_cast<ast::Binary*>(e.get());
+                        if (b == nullptr) {
+                                return;
+                        }
+                        switch (b->op.type) {
+                        case token::GREATER:
+                        case token::GREATER_EQUAL:
+                        case token::LESS:
+                        case token::LESS_EQUAL:
+                        case token::EQUAL_EQUAL:
+                        case token::BANG_EQUAL:
+                                comparison = b;
+                                break;
+                        default:
+                                break;
+                        }
+                }
+        };
+
+        class If : public Stmt {
+        public:
+                Condition condition;
+                std::shared_ptr<Stmt> then_branch;
+                // nullptr without else
+                std::shared_ptr<Stmt> else_branch;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitIfStmt(*this);
+                }
+
+                If(
+                        std::shared_ptr<ast::Expr> c,
+                        std::shared_ptr<Stmt> t,
+                        std::shared_ptr<Stmt> e
+                ) : condition(c), then_branch(t), else_branch(e)
+                {}
+        };
+
+        // while loops, and for loops with their initializer hoisted
+        class While : public Stmt {
+        public:
+                Condition condition;
+                std::shared_ptr<Stmt> body;
+                // for loops only, evaluated after the body
+                std::shared_ptr<ast::Expr> increment;
+                // body if it is a block
+                Block* block;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitWhileStmt(*this);
+                }
+
+                While(
+                        std::shared_ptr<ast::Expr> c,
+                        std::shared_ptr<Stmt> b,
+                        std::shared_ptr<ast::Expr> i = nullptr
+                ) : condition(c), body(b), increment(i),
+                        block(dynamic_cast<Block*>(b.get()))
+                {}
+        };
+
+        class Param {
+        public:
+                token::Token name;
+                bool boxed = false;
+        };
+
+        // A variable of an enclosing function, copied into the closure
+        // when it is created. Boxed variables are shared through their
+        // cell, any other is never assigned and copying is exact.
+        class Capture {
+        public:
+                token::Token name;
+                // the defining environment by name if -1, otherwise
+                // this upvalue of the enclosing closure
+                int upvalue = -1;
+                bool boxed = false;
+        };
+
+        class Function : public Stmt, public std::enable_shared_from_this<Function> {
+        public:
+                token::Token name;
+                std::vector<Param> params;
+                std::vector<std::shared_ptr<Stmt>> body;
+                // filled by the resolver, a deque keeps the flags the
+                // resolver points to in place
+                std::deque<Capture> captures;
+                // the name itself, as in Var
+                bool boxed = false;
+                // init of a class, returns this
+                bool initializer = false;
+                Deferred deferred;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitFunctionStmt(*this);
+                }
+
+                Function(
+                        token::Token n,
+                        std::vector<Param> p,
+                        std::vector<std::shared_ptr<Stmt>> b
+                ) : name(n), params(p), body(b)
+                {}
+        };
+
+        class Return : public Stmt {
+        public:
+                token::Token keyword;
+                // nullptr returns nil
+                std::shared_ptr<ast::Expr> value;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitReturnStmt(*this);
+                }
+
+                Return(
+                        token::Token k,
+                        std::shared_ptr<ast::Expr> v
+                ) : keyword(k), value(v)
+                {}
+        };
+
+        class Class : public Stmt {
+        public:
+                token::Token name;
+                // nullptr without a superclass
+                std::shared_ptr<ast::Variable> superclass;
+                std::vector<std::shared_ptr<Function>> methods;
+                // the name, as in Var
+                bool boxed = false;
+
+                fn accept(Visitor<std::any>& visitor) -> std::any {
+                        return visitor.visitClassStmt(*this);
+                }
+
+                Class(
+                        token::Token n,
+                        std::shared_ptr<ast::Variable> s,
+                        std::vector<std::shared_ptr<Function>> m
+                ) : name(n), superclass(s), methods(m)
+                {}
+        };
 }
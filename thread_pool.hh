@@ -0,0 +1,101 @@
+#pragma once
+#include "cpplox.hh"
+
+namespace thread_pool {
+        class ThreadPool {
+                std::vector<std::thread> workers;
+                std::deque<std::function<void()>> queue;
+                std::mutex mtx;
+                std::condition_variable work_cv;
+                std::condition_variable idle_cv;
+                // queued + running tasks
+                size_t pending;
+                bool stopping;
+                // the first exception a task threw, rethrown by wait()
+                std::exception_ptr error;
+
+                fn work() {
+                        // signals such as the profiler's SIGPROF
+                        // are handled by the main thread
+                        sigset_t all;
+                        sigfillset(&all);
+                        pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+                        while (true) {
+                                std::function<void()> task;
+                                {
+                                        std::unique_lock lock(mtx);
+                                        work_cv.wait(lock, [this] {
+                                                return stopping || !queue.empty();
+                                        });
+                                        if (queue.empty()) {
+                                                return;
+                                        }
+                                        task = std::move(queue.front());
+                                        queue.pop_front();
+                                }
+
+                                std::exception_ptr thrown;
+                                try {
+                                        task();
+                                } catch (...) {
+                                        thrown = std::current_exception();
+                                }
+
+                                std::lock_guard lock(mtx);
+                                if (thrown && !error) {
+                                        error = thrown;
+                                }
+                                if (--pending == 0) {
+                                        idle_cv.notify_all();
+                                }
+                        }
+                }
+
+        public:
+                ThreadPool(
+                        size_t n = std::thread::hardware_concurrency()
+                ) : pending(0), stopping(false)
+                {
+                        n = std::max<size_t>(n, 1);
+                        for (size_t i = 0; i < n; ++i) {
+                                workers.emplace_back([this] { work(); });
+                        }
+                }
+
+                ~ThreadPool() {
+                        {
+                                std::lock_guard lock(mtx);
+                                stopping = true;
+                        }
+                        work_cv.notify_all();
+                        for (auto& worker : workers) {
+                                worker.join();
+                        }
+                }
+
+                ThreadPool(const ThreadPool&) = delete;
+                fn operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+                // tasks may submit more tasks
+                fn submit(std::function<void()> task) {
+                        {
+                                std::lock_guard lock(mtx);
+                                queue.push_back(std::move(task));
+                                pending++;
+                        }
+                        work_cv.notify_one();
+                }
+
+                // blocks until every submitted task, including
+                // ones submitted while waiting, has finished, then
+                // rethrows the first exception of one
+                fn wait() {
+                        std::unique_lock lock(mtx);
+                        idle_cv.wait(lock, [this] { return pending == 0; });
+                        if (error) {
+                                std::rethrow_exception(std::exchange(error, nullptr));
+                        }
+                }
+        };
+}
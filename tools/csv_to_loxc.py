@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Converts a CSV table with a header line to the binary table format of
+# batch.hh, read by cpplox --batch without parsing text. Columns are
+# typed as the CSV reader types them: numbers if every cell is one,
+# booleans if every cell is true or false, strings otherwise.
+#
+#   python3 tools/csv_to_loxc.py orders.csv orders.loxc
+
+import csv
+import struct
+import sys
+
+MAGIC = b'LOXCOL1\n'
+NUMBER, BOOL, STRING = 0, 1, 2
+
+
+def number(cell):
+    # what std::from_chars reads whole; no sign, spaces or underscores
+    if not cell or cell[0] in '+ ' or cell[-1] == ' ' or '_' in cell:
+        return None
+    try:
+        return float(cell)
+    except ValueError:
+        return None
+
+
+def column_kind(cells):
+    if all(number(c) is not None for c in cells):
+        return NUMBER
+    if all(c in ('true', 'false') for c in cells):
+        return BOOL
+    return STRING
+
+
+def main(src, dst):
+    with open(src, newline='', encoding='utf-8') as f:
+        rows = [r for r in csv.reader(f) if r]
+    header, records = rows[0], rows[1:]
+    for i, r in enumerate(records):
+        if len(r) != len(header):
+            sys.exit(f'record {i + 1} has {len(r)} fields, the header {len(header)}')
+    columns = [[r[i] for r in records] for i in range(len(header))]
+    kinds = [column_kind(c) for c in columns]
+
+    with open(dst, 'wb') as out:
+        out.write(MAGIC)
+        out.write(struct.pack('=QI', len(records), len(header)))
+        for name, kind in zip(header, kinds):
+            name = name.encode()
+            out.write(struct.pack('=BI', kind, len(name)))
+            out.write(name)
+        for cells, kind in zip(columns, kinds):
+            if kind == NUMBER:
+                out.write(struct.pack(f'={len(cells)}d', *map(number, cells)))
+            elif kind == BOOL:
+                out.write(bytes(c == 'true' for c in cells))
+            else:
+                for c in cells:
+                    c = c.encode()
+                    out.write(struct.pack('=I', len(c)))
+                    out.write(c)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        sys.exit('usage: csv_to_loxc.py input.csv output.loxc')
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Generates unicode_tables.hh: XID_Start / XID_Continue classes for the
+# scanner, as a two-stage table. CPython's str.isidentifier() is defined
+# by exactly these two properties, so its unicodedata is the source.
+#
+#   python3 tools/gen_unicode_tables.py > unicode_tables.hh
+
+import sys
+import unicodedata
+
+START = 1
+CONTINUE = 2
+BLOCK = 256
+
+
+def char_class(cp):
+    if 0xd800 <= cp < 0xe000:
+        return 0
+    ch = chr(cp)
+    cls = 0
+    if ch.isidentifier() and ch != '_':
+        cls |= START
+    if ('a' + ch).isidentifier():
+        cls |= CONTINUE
+    return cls
+
+
+def pack(classes):
+    # four 2-bit classes per byte, lowest code point in the low bits
+    out = []
+    for i in range(0, len(classes), 4):
+        b = 0
+        for j in range(4):
+            b |= classes[i + j] << (2 * j)
+        out.append(b)
+    return out
+
+
+def rows(values, per_row, fmt):
+    for i in range(0, len(values), per_row):
+        yield '                ' + ', '.join(fmt % v for v in values[i:i + per_row]) + ','
+
+
+def main():
+    stage1 = []
+    blocks = {}
+    for b in range(0x110000 // BLOCK):
+        cls = tuple(char_class(cp) for cp in range(b * BLOCK, (b + 1) * BLOCK))
+        stage1.append(blocks.setdefault(cls, len(blocks)))
+    assert len(blocks) <= 256
+
+    stage2 = []
+    for cls in sorted(blocks, key=blocks.get):
+        stage2 += pack(list(cls))
+
+    ascii = [char_class(cp) for cp in range(128)]
+    ascii[ord('_')] |= START
+
+    w = sys.stdout.write
+    w('#pragma once\n')
+    w('#include "cpplox.hh"\n\n')
+    w('// generated by tools/gen_unicode_tables.py from Unicode %s, do not edit\n'
+      % unicodedata.unidata_version)
+    w('namespace unicode {\n')
+    w('        constexpr uint8_t XID_START = %d;\n' % START)
+    w('        constexpr uint8_t XID_CONTINUE = %d;\n\n' % CONTINUE)
+    w('        // ascii classes, \'_\' is accepted as an identifier start\n')
+    w('        constexpr uint8_t ascii_class[128] = {\n')
+    w('\n'.join(rows(ascii, 16, '%d')) + '\n')
+    w('        };\n\n')
+    w('        // code point >> 8 -> block index into stage2\n')
+    w('        constexpr uint8_t stage1[%d] = {\n' % len(stage1))
+    w('\n'.join(rows(stage1, 16, '%3d')) + '\n')
+    w('        };\n\n')
+    w('        // blocks of 256 two-bit classes, 64 bytes each\n')
+    w('        constexpr uint8_t stage2[%d] = {\n' % len(stage2))
+    w('\n'.join(rows(stage2, 16, '0x%02x')) + '\n')
+    w('        };\n')
+    w('}\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Prints a trace dumped by cpplox --trace, oldest record first: the
+# statements that ran, indented by call depth, the variables they
+# defined or assigned and the runtime error the run ended in. See
+# trace.hh for the format.
+#
+#   python3 tools/lox_trace.py cpplox.trace [--last N]
+
+import os
+import struct
+import sys
+
+MAGIC = b'LOXTRC1\n'
+HEADER = struct.Struct('<8sIIQII')
+RECORD = struct.Struct('<BBHIQ')
+STATEMENT, DEFINE, ASSIGN, ERROR = range(4)
+NIL, BOOL, NUMBER, STRING, OTHER = range(5)
+
+
+def number(bits):
+    n = struct.unpack('<d', struct.pack('<Q', bits))[0]
+    # as print writes them, integral numbers without a fraction
+    if n == int(n) and abs(n) < 1e16:
+        return str(int(n))
+    return repr(n)
+
+
+def value(kind, length, bits):
+    if kind == NIL:
+        return 'nil'
+    if kind == BOOL:
+        return 'true' if bits else 'false'
+    if kind == NUMBER:
+        return number(bits)
+    if kind == STRING:
+        text = struct.pack('<Q', bits)[:min(length, 8)]
+        text = text.decode('utf-8', 'replace')
+        return '"{}{}"'.format(text, '...' if length > 8 else '')
+    return '<object>'
+
+
+def main(path, last):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, size, capacity, written, string_bytes, _ = HEADER.unpack_from(data)
+    if magic != MAGIC or size != RECORD.size:
+        sys.exit('lox_trace: {} is not a cpplox trace'.format(path))
+
+    at = HEADER.size
+    strings = data[at:at + string_bytes].split(b'\0')
+    strings = [s.decode('utf-8', 'replace') for s in strings]
+    at += string_bytes
+
+    def string(i):
+        return strings[i] if 0 < i < len(strings) else '?'
+
+    count = min(written, capacity)
+    first = written - count
+    skip = max(count - last, 0) if last else 0
+    print('{} records written, the last {} kept{}'.format(
+        written, count, ', {} shown'.format(count - skip) if skip else ''))
+
+    depth = 0
+    for i in range(skip, count):
+        k, t, file, arg, bits = RECORD.unpack_from(data, at + i * RECORD.size)
+        n = first + i
+        if k == STATEMENT:
+            depth = bits
+            print('{:>10}  {}{}:{}'.format(n, '  ' * depth, os.path.basename(string(file)), arg))
+        elif k in (DEFINE, ASSIGN):
+            print('{:>10}  {}  {}{} = {}'.format(
+                n, '  ' * depth, 'var ' if k == DEFINE else '', string(arg), value(t, file, bits)))
+        elif k == ERROR:
+            print('{:>10}  {}error at {}:{}: {}'.format(
+                n, '  ' * depth, os.path.basename(string(file)), arg, string(bits)))
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    last = 0
+    if len(args) == 3 and args[1] == '--last':
+        last = int(args[2])
+        args = args[:1]
+    if len(args) != 1:
+        sys.exit('usage: lox_trace.py trace [--last N]')
+    main(args[0], last)
@@ -0,0 +1,288 @@
+#pragma once
+#include "cpplox.hh"
+
+// Execution trace for post-mortem analysis, --trace[=file]. The
+// interpreter writes a 16 byte record for every statement, variable
+// definition, assignment and runtime error into a ring holding the last
+// of them; nothing is allocated or locked while it does. The ring goes
+// to the file when a run ends in a runtime error, on SIGUSR1, and on a
+// fatal signal before its default action. tools/lox_trace.py prints it.
+//
+// A dump is a Header, the strings the records refer to, each ended by a
+// NUL and numbered from 0 in order, then the records, oldest first.
+namespace trace {
+        enum kind : uint8_t {
+                STATEMENT, DEFINE, ASSIGN, ERROR,
+        };
+
+        // of an assigned value; strings keep their first 8 bytes
+        enum type : uint8_t {
+                NIL, BOOL, NUMBER, STRING, OTHER,
+        };
+
+        //             statement      define, assign         error
+        //   file      module         string length          module
+        //   arg       line           name                   line
+        //   value     call depth     number bits, bool or   message
+        //                            first bytes of string
+        class Record {
+        public:
+                kind k;
+                type t;
+                uint16_t file;
+                uint32_t arg;
+                uint64_t value;
+        };
+        static_assert(sizeof(Record) == 16);
+
+        class Header {
+        public:
+                char magic[8];
+                uint32_t record_bytes;
+                uint32_t capacity;
+                // records ever written, the dump holds the last capacity
+                uint64_t written;
+                uint32_t string_bytes;
+                uint32_t reserved;
+        };
+        static_assert(sizeof(Header) == 32);
+
+        constexpr char magic[8] = {'L', 'O', 'X', 'T', 'R', 'C', '1', '\n'};
+
+        // Names, modules and messages of every trace by number, 0 the
+        // empty string and what did not fit. Appended under a lock; a
+        // signal handler writes the bytes out up to used.
+        class Strings {
+                static constexpr size_t max_bytes = 1 << 20;
+
+                std::unique_ptr<char[]> bytes;
+                std::atomic<uint32_t> used = 1;
+                uint32_t count = 1;
+                std::unordered_map<std::string, uint32_t> ids;
+                std::mutex mtx;
+
+        public:
+                Strings(
+                ) : bytes(new char[max_bytes])
+                {
+                        bytes[0] = '\0';
+                }
+
+                fn intern(std::string_view s) -> uint32_t {
+                        std::lock_guard lock(mtx);
+                        auto key = std::string(s);
+                        if (auto it = ids.find(key); it != ids.end()) {
+                                return it->second;
+                        }
+                        auto at = used.load(std::memory_order_relaxed);
+                        if (at + s.size() + 1 > max_bytes) {
+                                return 0;
+                        }
+                        std::memcpy(bytes.get() + at, s.data(), s.size());
+                        bytes[at + s.size()] = '\0';
+                        used.store(at + s.size() + 1, std::memory_order_release);
+                        ids.emplace(std::move(key), count);
+                        return count++;
+                }
+
+                fn data() const -> const char* {
+                        return bytes.get();
+                }
+
+                fn size() const -> uint32_t {
+                        return used.load(std::memory_order_acquire);
+                }
+        };
+
+        fn strings() -> Strings& {
+                static Strings s;
+                return s;
+        }
+
+        class Tracer {
+                static constexpr size_t alt_stack_bytes = 64 << 10;
+
+                std::unique_ptr<Record[]> ring;
+                uint64_t capacity;
+                // written by the interpreter, read by the signal handler
+                // on the same thread
+                uint64_t written = 0;
+                // module of the last statement and its string, at first
+                // interactive input, whose module is nullptr
+                const std::string* file = nullptr;
+                uint16_t file_id;
+                std::string path;
+                // the handler runs here when the stack itself is gone
+                std::unique_ptr<char[]> alt_stack;
+
+                static inline Tracer* active = nullptr;
+
+                static fn on_signal(int sig) {
+                        if (auto t = active) {
+                                t->dump();
+                        }
+                        // blocked until the handler returns, then the
+                        // default action of a fatal one ends the process
+                        if (sig != SIGUSR1) {
+                                ::raise(sig);
+                        }
+                }
+
+                static fn write_all(int fd, const void* p, size_t n) -> bool {
+                        auto at = static_cast<const char*>(p);
+                        while (n > 0) {
+                                auto w = ::write(fd, at, n);
+                                if (w <= 0) {
+                                        return false;
+                                }
+                                at += w;
+                                n -= w;
+                        }
+                        return true;
+                }
+
+                // a record is filled in place, the next one for the
+                // handler only once it is done; one built aside and
+                // copied in is read back before its stores land
+                [[gnu::always_inline]] fn next() -> Record& {
+                        return ring[written & (capacity - 1)];
+                }
+
+                [[gnu::always_inline]] fn commit() {
+                        std::atomic_signal_fence(std::memory_order_release);
+                        written = written + 1;
+                }
+
+                // one type() and compares of addresses; a type_info of
+                // another copy tags the value OTHER, no worse for a trace
+                [[gnu::always_inline]] static fn encode(const std::any& value, Record& r) {
+                        auto t = &value.type();
+                        if (t == &typeid(double)) {
+                                r.t = NUMBER;
+                                std::memcpy(&r.value, std::any_cast<double>(&value), sizeof(double));
+                        } else if (t == &typeid(std::string)) {
+                                auto& s = *std::any_cast<std::string>(&value);
+                                r.t = STRING;
+                                r.file = std::min<size_t>(s.size(), UINT16_MAX);
+                                if (s.size() >= sizeof(r.value)) {
+                                        std::memcpy(&r.value, s.data(), sizeof(r.value));
+                                } else {
+                                        std::memcpy(&r.value, s.data(), s.size());
+                                }
+                        } else if (t == &typeid(bool)) {
+                                r.t = BOOL;
+                                r.value = *std::any_cast<bool>(&value);
+                        } else if (t == &typeid(void)) {
+                                r.t = NIL;
+                        } else {
+                                r.t = OTHER;
+                        }
+                }
+
+                static fn name(const std::string* f) -> uint16_t {
+                        auto id = strings().intern(f != nullptr ? std::string_view(*f) : "<stdin>");
+                        return id <= UINT16_MAX ? id : 0;
+                }
+
+        public:
+                // records is rounded up to a power of two
+                Tracer(
+                        std::string p,
+                        size_t records = 1 << 16
+                ) : ring(new Record[std::bit_ceil(records)]()),
+                        capacity(std::bit_ceil(records)),
+                        file_id(name(nullptr)),
+                        path(std::move(p))
+                {}
+
+                ~Tracer() {
+                        stop();
+                }
+
+                Tracer(const Tracer&) = delete;
+                fn operator=(const Tracer&) -> Tracer& = delete;
+
+                // dumps on SIGUSR1, and on fatal signals of this process
+                fn start() {
+                        active = this;
+                        alt_stack.reset(new char[alt_stack_bytes]);
+                        stack_t ss = {};
+                        ss.ss_sp = alt_stack.get();
+                        ss.ss_size = alt_stack_bytes;
+                        sigaltstack(&ss, nullptr);
+
+                        struct sigaction sa = {};
+                        sa.sa_handler = on_signal;
+                        sigemptyset(&sa.sa_mask);
+                        sa.sa_flags = SA_RESTART;
+                        sigaction(SIGUSR1, &sa, nullptr);
+                        sa.sa_flags = SA_RESETHAND | SA_ONSTACK;
+                        for (int sig : {SIGINT, SIGTERM, SIGSEGV, SIGBUS, SIGFPE, SIGABRT}) {
+                                sigaction(sig, &sa, nullptr);
+                        }
+                }
+
+                fn stop() -> void {
+                        if (active == this) {
+                                active = nullptr;
+                        }
+                }
+
+                // with nothing but open and write, it runs in handlers
+                fn dump() const -> bool {
+                        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                        if (fd < 0) {
+                                return false;
+                        }
+                        auto n = written;
+                        std::atomic_signal_fence(std::memory_order_acquire);
+                        auto& s = strings();
+                        Header h = {};
+                        std::memcpy(h.magic, magic, sizeof(magic));
+                        h.record_bytes = sizeof(Record);
+                        h.capacity = capacity;
+                        h.written = n;
+                        h.string_bytes = s.size();
+
+                        auto count = std::min(n, capacity);
+                        auto first = (n - count) & (capacity - 1);
+                        auto head = std::min(count, capacity - first);
+                        bool ok = write_all(fd, &h, sizeof(h))
+                                && write_all(fd, s.data(), h.string_bytes)
+                                && write_all(fd, &ring[first], head * sizeof(Record))
+                                && write_all(fd, &ring[0], (count - head) * sizeof(Record));
+                        ::close(fd);
+                        return ok;
+                }
+
+                // ---------- probes, called by the interpreter ----------
+
+                [[gnu::always_inline]] fn statement(const std::string* f, int line, uint64_t depth) {
+                        if (f != file) [[unlikely]] {
+                                file = f;
+                                file_id = name(f);
+                        }
+                        next() = Record{STATEMENT, NIL, file_id, uint32_t(line), depth};
+                        commit();
+                }
+
+                // name is the string of the node's name, 0 until its
+                // first traced run
+                [[gnu::always_inline]] fn assign(kind k, uint32_t& name, const std::string& lexeme, const std::any& value) {
+                        if (name == 0) [[unlikely]] {
+                                name = strings().intern(lexeme);
+                        }
+                        auto& r = next();
+                        r = Record{k, NIL, 0, name, 0};
+                        encode(value, r);
+                        commit();
+                }
+
+                // the last record of a run, which is dumped
+                fn error(int line, std::string_view message) {
+                        next() = Record{ERROR, NIL, file_id, uint32_t(line), strings().intern(message)};
+                        commit();
+                        dump();
+                }
+        };
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "cpplox.hh"
+#include "unicode_tables.hh"
+
+// Identifier classes after Unicode UAX #31, independent of the C locale.
+// ASCII is a single table lookup, everything else goes through the
+// two-stage table in unicode_tables.hh.
+namespace unicode {
+        constexpr fn char_class(char32_t c) -> uint8_t {
+                if (c < 0x80) {
+                        return ascii_class[c];
+                }
+                if (c >= 0x110000) {
+                        return 0;
+                }
+                auto block = stage1[c >> 8];
+                auto packed = stage2[block * 64 + ((c & 0xff) >> 2)];
+                return (packed >> ((c & 3) * 2)) & 3;
+        }
+
+        constexpr fn is_xid_start(char32_t c) -> bool {
+                return char_class(c) & XID_START;
+        }
+
+        constexpr fn is_xid_continue(char32_t c) -> bool {
+                return char_class(c) & XID_CONTINUE;
+        }
+
+        static_assert(is_xid_start('a') && is_xid_start('_') && !is_xid_start('1'));
+        static_assert(is_xid_continue('1') && !is_xid_continue('+'));
+        static_assert(is_xid_start(U'ж') && is_xid_start(U'語'));
+        static_assert(!is_xid_start(U'€') && !is_xid_continue(0x110000));
+}
@@ -3,71 +3,89 @@
 
 // 💠
 namespace utils {
-        namespace {
-                std::wstring_convert<std::codecvt_utf8<wchar_t>> u8str_conv;
-        }
-
-        fn to_wstring(std::any& value) -> std::wstring {
-                if (value.type() == typeid(std::wstring)) {
-                        return std::any_cast<std::wstring>(value);
+        fn to_string(std::any& value) -> std::string {
+                if (value.type() == typeid(std::string)) {
+                        return std::any_cast<std::string>(value);
                 } else if (value.type() == typeid(double)) {
-                        return std::to_wstring(
+                        return std::to_string(
                                 std::any_cast<double>(value)
                         );
                 } else if (value.type() == typeid(int)) {
-                        return std::to_wstring(
+                        return std::to_string(
                                 std::any_cast<int>(value)
                         );
                 }
-                return L"empty";
+                return "empty";
         }
 
-        fn to_string(std::wstring wstr) -> std::string {
-                return u8str_conv.to_bytes(wstr);
-        }
+        // decodes one utf-8 sequence at pos and moves pos past it,
+        // malformed bytes decode to U+FFFD one byte at a time
+        fn decode_utf8(const std::string& str, size_t& pos) -> char32_t {
+                auto b0 = static_cast<unsigned char>(str[pos]);
+                if (b0 < 0x80) {
+                        pos++;
+                        return b0;
+                }
 
-        fn to_wstring(char* str) -> std::wstring {
-                return u8str_conv.from_bytes(str);
-        }
+                size_t len = (b0 >= 0xf0) ? 4
+                           : (b0 >= 0xe0) ? 3
+                           : (b0 >= 0xc0) ? 2
+                           : 0;
+                if (len == 0 || pos + len > str.length()) {
+                        pos++;
+                        return 0xfffd;
+                }
 
-        fn to_wstring(std::string str) -> std::wstring {
-                return u8str_conv.from_bytes(str.c_str());
+                char32_t cp = b0 & (0x7f >> len);
+                for (size_t i = 1; i < len; ++i) {
+                        auto b = static_cast<unsigned char>(str[pos + i]);
+                        if ((b & 0xc0) != 0x80) {
+                                pos++;
+                                return 0xfffd;
+                        }
+                        cp = (cp << 6) | (b & 0x3f);
+                }
+                pos += len;
+                return cp;
         }
 
-        fn get_file(std::wstring& path) -> std::wstring {
-                std::wifstream f(to_string(path));
+        fn get_file(const std::string& path) -> std::string {
+                std::ifstream f(path, std::ios::binary);
                 if (!f.is_open()) {
                         throw std::runtime_error(
                                 std::format(
                                         "utils: file '{}' is inaccessable",
-                                        to_string(path)
+                                        path
                                 )
                         );
                 }
-                std::wstringstream str;
-                str << f.rdbuf();
-                return str.str();
+                std::string str;
+                f.seekg(0, std::ios::end);
+                str.resize(f.tellg());
+                f.seekg(0, std::ios::beg);
+                f.read(str.data(), str.size());
+                return str;
         }
 
-        fn get_file_lines(std::wstring& path) -> std::vector<std::wstring> {
-                std::vector<std::wstring> lines;
-                std::wifstream f(to_string(path));
+        fn get_file_lines(const std::string& path) -> std::vector<std::string> {
+                std::vector<std::string> lines;
+                std::ifstream f(path);
                 if (!f.is_open()) {
                         throw std::runtime_error(
                                 std::format(
                                         "utils: file '{}' is inaccessable",
-                                        to_string(path)
+                                        path
                                 )
                         );
                 }
-                for (std::wstring line; std::getline(f, line);) {
+                for (std::string line; std::getline(f, line);) {
                         lines.push_back(line);
                 }
                 return lines;
         }
 
-        fn panic(std::wstring msg) {
-                std::wcout << msg << std::endl;
+        fn panic(std::string msg) {
+                std::cout << msg << std::endl;
                 //std::abort();
                 std::exit(1);
         }